@@ -240,7 +240,17 @@ void ActionQueue::runTrees ()
 {
 	TreeMacro	theMacro;
 	theMacro.copyContents (mContents.begin(), mContents.end());
-	theMacro.execute ();
+	// the macro only borrows the actions, so it mustn't delete them even
+	// if the run is cut short
+	try
+	{
+		theMacro.execute ();
+	}
+	catch (...)
+	{
+		theMacro.orphanAll();
+		throw;
+	}
 	theMacro.orphanAll();
 }
 
@@ -250,7 +260,15 @@ void ActionQueue::runN (int iLoops)
 {
 	RunNMacro	theMacro (iLoops);
 	theMacro.copyContents (mContents.begin(), mContents.end());
-	theMacro.execute ();
+	try
+	{
+		theMacro.execute ();
+	}
+	catch (...)
+	{
+		theMacro.orphanAll();
+		throw;
+	}
 	theMacro.orphanAll();
 }
 
@@ -260,7 +278,15 @@ void ActionQueue::runAndRestore (int iLoops)
 {
 	RunAndRestoreMacro	theMacro (iLoops);
 	theMacro.copyContents (mContents.begin(), mContents.end());
-	theMacro.execute ();
+	try
+	{
+		theMacro.execute ();
+	}
+	catch (...)
+	{
+		theMacro.orphanAll();
+		throw;
+	}
 	theMacro.orphanAll();
 }
 
@@ -18,13 +18,50 @@ Credits:
 #include "MesaGlobals.h"
 #include "TaxaTraitMatrix.h"
 #include "TreeWrangler.h"
+#include "CharEvolScheme.h"
 #include "Reporter.h"
+#include <algorithm>
 
 using std::string;
 
 
 // *** CONSTANTS & DEFINES
 
+// *** INTERNALS *********************************************************/
+
+template <typename MATRIX>
+typename MATRIX::size_type
+findTraitRow (MATRIX* iDataP, nodeiter_t iNodeIter, unsigned long& ioRow,
+	unsigned long& ioStamp)
+//: return the row of this matrix that holds the data for this node
+// The row is remembered by the node and only looked up by name again if
+// rows in the matrix have been moved or renamed since, so in the course of
+// a simulation this is a single indexed load.
+{
+	if ((ioStamp != iDataP->getRowStamp()) or (iDataP->countRows() <= ioRow))
+	{
+		std::string theNodeName = iNodeIter->second.mData.mName;
+		ioRow = iDataP->findRowNameIndex (theNodeName.c_str());
+		ioStamp = iDataP->getRowStamp();
+	}
+	return ioRow;
+}
+
+ContTraitMatrix::size_type findContRow (nodeiter_t iNodeIter)
+{
+	MesaTreeNode& theNode = iNodeIter->second.mData;
+	return findTraitRow (MesaGlobals::mContDataP, iNodeIter, theNode.mContRow,
+		theNode.mContRowStamp);
+}
+
+DiscTraitMatrix::size_type findDiscRow (nodeiter_t iNodeIter)
+{
+	MesaTreeNode& theNode = iNodeIter->second.mData;
+	return findTraitRow (MesaGlobals::mDiscDataP, iNodeIter, theNode.mDiscRow,
+		theNode.mDiscRowStamp);
+}
+
+
 // *** FUNCTIONS *********************************************************/
 
 /*
@@ -41,14 +78,12 @@ BasicMacro* castAsMacro (BasicAction* iActionP)
 
 void setContData (nodeiter_t iNodeIter, int iColIndex, conttrait_t& iNewVal)
 {
-	std::string theNodeName = MesaGlobals::mTreeDataP->getActiveTreeP()->getNodeName (iNodeIter);
-	MesaGlobals::mContDataP->getData (theNodeName.c_str(), iColIndex) = iNewVal;
+	MesaGlobals::mContDataP->referData (findContRow (iNodeIter), iColIndex) = iNewVal;
 }
 
 void setDiscData (nodeiter_t iNodeIter, int iColIndex, disctrait_t& iNewVal)
 {
-	std::string theNodeName = MesaGlobals::mTreeDataP->getActiveTreeP()->getNodeName (iNodeIter);
-	MesaGlobals::mDiscDataP->getData (theNodeName.c_str(), iColIndex) = iNewVal;
+	MesaGlobals::mDiscDataP->referData (findDiscRow (iNodeIter), iColIndex) = iNewVal;
 }
 
 conttrait_t getContData (const char* iTaxaName, int iColIndex)
@@ -60,8 +95,8 @@ conttrait_t getContData (const char* iTaxaName, int iColIndex)
 conttrait_t getContData (nodeiter_t iLeafIter, int iColIndex)
 //: return the continuous data of this leaf at this column
 {
-	std::string theNodeName = MesaGlobals::mTreeDataP->getActiveTreeP()->getNodeName (iLeafIter);
-	return getContData (theNodeName.c_str(), iColIndex);
+	syncNodeTraits (iLeafIter);
+	return MesaGlobals::mContDataP->getData (findContRow (iLeafIter), iColIndex);
 }
 
 
@@ -74,33 +109,84 @@ disctrait_t getDiscData (const char* iTaxaName, int iColIndex)
 disctrait_t getDiscData (nodeiter_t iLeafIter, int iColIndex)
 //: return the continuous data of this leaf at this column
 {
-	std::string theNodeName = (MesaGlobals::mTreeDataP->getActiveTreeP())->getLeafName (iLeafIter);
-	return getDiscData (theNodeName.c_str(), iColIndex);
+	assert (getActiveTreeP()->isLeaf (iLeafIter));
+	syncNodeTraits (iLeafIter);
+	return MesaGlobals::mDiscDataP->getData (findDiscRow (iLeafIter), iColIndex);
 }
 
 
 disctrait_t& referDiscState (const char* iTaxaName, int iColIndex)
 {
-	return MesaGlobals::mDiscDataP->getData (iTaxaName, iColIndex);
+	DiscTraitMatrix* theDataP = MesaGlobals::mDiscDataP;
+	return theDataP->referData (theDataP->findRowNameIndex (iTaxaName), iColIndex);
 }
 
 disctrait_t& referDiscState (nodeiter_t& iNode, int iColIndex)
 {
-	std::string theNodeName;
-	theNodeName = MesaGlobals::mTreeDataP->getActiveTreeP()->getNodeName (iNode);
-	return referDiscState (theNodeName.c_str(), iColIndex);
+	syncNodeTraits (iNode);
+	return MesaGlobals::mDiscDataP->referData (findDiscRow (iNode), iColIndex);
 }
 
 conttrait_t& referContState (const char* iTaxaName, int iColIndex)
 {
-	return MesaGlobals::mContDataP->getData (iTaxaName, iColIndex);
+	ContTraitMatrix* theDataP = MesaGlobals::mContDataP;
+	return theDataP->referData (theDataP->findRowNameIndex (iTaxaName), iColIndex);
 }
 
 conttrait_t& referContState (nodeiter_t& iNode, int iColIndex)
+//: the traits of this node, to be written to
+// Its whole row is saved for rolling back, so the other columns of the
+// row may be written through this too.
 {
-	std::string theNodeName;
-	theNodeName = MesaGlobals::mTreeDataP->getActiveTreeP()->getNodeName (iNode);
-	return referContState (theNodeName.c_str(), iColIndex);
+	syncNodeTraits (iNode);
+	return MesaGlobals::mContDataP->referData (findContRow (iNode), iColIndex);
+}
+
+
+void deferTraitEvolution (TraitEvolScheme* iSchemeP)
+//: evolve this scheme's trait lazily for the rest of the epoch
+// Rather than being stepped across every leaf at every event, the trait
+// of a node is drawn once for all the time since it was last brought up
+// to date, when it is read, when it speciates or when the epoch ends.
+// Only valid for schemes where consecutive changes sum to a single draw
+// (see TraitEvolScheme::isLazy).
+{
+	assert (iSchemeP->isLazy ());
+	std::vector<TraitEvolScheme*>& theSchemes = MesaGlobals::mLazySchemes;
+	if (std::find (theSchemes.begin(), theSchemes.end(), iSchemeP) == theSchemes.end())
+		theSchemes.push_back (iSchemeP);
+}
+
+void syncNodeTraits (nodeiter_t iNodeIter)
+//: bring any lazily evolved traits of this node up to date
+{
+	std::vector<TraitEvolScheme*>& theSchemes = MesaGlobals::mLazySchemes;
+	if (theSchemes.empty())
+		return;
+
+	MesaTree* theTreeP = getActiveTreeP();
+	mesatime_t theStamp = iNodeIter->second.mData.mTraitStamp;
+	mesatime_t theNow = theTreeP->getLineageClock (iNodeIter);
+	if (theNow <= theStamp)
+		return;
+	mesatime_t theElapsed = theNow - theStamp;
+	// stamp first, as the schemes read the old state back through here
+	theTreeP->setTraitStamp (iNodeIter, theNow);
+	std::vector<TraitEvolScheme*>::iterator p;
+	for (p = theSchemes.begin(); p != theSchemes.end(); p++)
+		(*p)->evolveChars (iNodeIter, theElapsed);
+}
+
+void syncAllTraits ()
+//: bring every node's lazily evolved traits up to date and stop deferring
+// Must be called before the tree clock is reset at the end of an epoch.
+{
+	if (MesaGlobals::mLazySchemes.empty())
+		return;
+	MesaTree* theTreeP = getActiveTreeP();
+	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+		syncNodeTraits (q);
+	MesaGlobals::mLazySchemes.clear();
 }
 
 
@@ -136,8 +222,7 @@ int getRichnessData (nodeiter_t iLeafIter, int iRichCol)
 	}
 	else
 	{
-		std::string theNodeName = theTreeP->getLeafName (iLeafIter);
-		conttrait_t theRichness = getContData (theNodeName.c_str(), iRichCol);
+		conttrait_t theRichness = getContData (iLeafIter, iRichCol);
 		return int (theRichness);
 	}
 }
@@ -211,23 +296,41 @@ void speciate (nodeiter_t iLeafIter)
 		MesaTree* theTreeP = getActiveTreeP ();
 		assert (theTreeP->isLeaf (iLeafIter));
 
-		// get name of old taxa and generate new ones
+		// generate names for the new taxa
 		// static IdGenerator theTaxaNames ("tx");
-		std::string theParName = theTreeP->getLeafName (iLeafIter);
 		std::string theChildName1 = getNextFakeName ();
 		std::string theChildName2 = getNextFakeName ();
 		
+		// lazy traits must be current before the children copy them
+		syncNodeTraits (iLeafIter);
+		
 		// split the parent node in the tree and name the children
 		nodeiter_t theNewNode1, theNewNode2;
 		theTreeP->speciate (iLeafIter, theNewNode1, theNewNode2);
 		theTreeP->setNodeName (theNewNode1, theChildName1.c_str());
 		theTreeP->setNodeName (theNewNode2, theChildName2.c_str());
 		
-		// clone the data in the wranglers
-		MesaGlobals::mContDataP->cloneRow (theParName.c_str(), theChildName1.c_str());
-		MesaGlobals::mContDataP->cloneRow (theParName.c_str(), theChildName2.c_str());
-		MesaGlobals::mDiscDataP->cloneRow (theParName.c_str(), theChildName1.c_str());
-		MesaGlobals::mDiscDataP->cloneRow (theParName.c_str(), theChildName2.c_str());
+		// clone the data in the wranglers, and tell the children their rows
+		ContTraitMatrix* theContDataP = MesaGlobals::mContDataP;
+		if (0 < theContDataP->countTaxa())
+		{
+			ContTraitMatrix::size_type theParRow = findContRow (iLeafIter);
+			MesaTreeNode& theChild1 = theNewNode1->second.mData;
+			MesaTreeNode& theChild2 = theNewNode2->second.mData;
+			theChild1.mContRow = theContDataP->cloneRow (theParRow, theChildName1.c_str());
+			theChild2.mContRow = theContDataP->cloneRow (theParRow, theChildName2.c_str());
+			theChild1.mContRowStamp = theChild2.mContRowStamp = theContDataP->getRowStamp();
+		}
+		DiscTraitMatrix* theDiscDataP = MesaGlobals::mDiscDataP;
+		if (0 < theDiscDataP->countTaxa())
+		{
+			DiscTraitMatrix::size_type theParRow = findDiscRow (iLeafIter);
+			MesaTreeNode& theChild1 = theNewNode1->second.mData;
+			MesaTreeNode& theChild2 = theNewNode2->second.mData;
+			theChild1.mDiscRow = theDiscDataP->cloneRow (theParRow, theChildName1.c_str());
+			theChild2.mDiscRow = theDiscDataP->cloneRow (theParRow, theChildName2.c_str());
+			theChild1.mDiscRowStamp = theChild2.mDiscRowStamp = theDiscDataP->getRowStamp();
+		}
 	}
 	catch (...)
 	{
@@ -25,6 +25,7 @@ Credits:
 
 //class BasicAction;
 //class BasicMacro;
+class TraitEvolScheme;
 
 
 // *** FUNCTIONS *********************************************************/
@@ -44,6 +45,10 @@ conttrait_t&  referContState (nodeiter_t& iNode, int iColIndex);
 void setContData (nodeiter_t iNodeIter, int iColIndex, conttrait_t& iNewVal);
 void setDiscData (nodeiter_t iNodeIter, int iColIndex, disctrait_t& iNewVal);
 
+void			deferTraitEvolution (TraitEvolScheme* iSchemeP);
+void			syncNodeTraits (nodeiter_t iNodeIter);
+void			syncAllTraits ();
+
 int			getRichnessData (int iLeafId, int iRichCol);
 int			getRichnessData (nodeiter_t iLeafIter, int iRichCol);
 
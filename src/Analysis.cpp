@@ -24,7 +24,11 @@ Credits:
 #include "ExecutionError.h"
 #include "StringUtils.h"
 #include "ManipAction.h"
+#include "TreeSnapshot.h"
+#include "NexusWriter.h"
+#include "MesaUtils.h"
 #include <sstream>
+#include <fstream>
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
@@ -118,6 +122,70 @@ size_type BasicAnalysis::getDepth (size_type iIndex)
 	return 0;
 }
 
+void BasicAnalysis::executeAsPass ()
+//: run this analysis by itself, through its visitor
+{
+	TreePass thePass;
+	bool theIsAdopted = thePass.adoptAnalysis (this);
+	assert (theIsAdopted);
+	theIsAdopted = theIsAdopted; // just to shut compiler up
+	thePass.run();
+}
+
+
+// *** SHARED TREE PASS **************************************************/
+
+TreePass::~TreePass ()
+{
+	for (std::vector<TreeVisitor*>::size_type i = 0; i < mVisitors.size(); i++)
+		delete mVisitors[i];
+	delete mSnapshotP;
+}
+
+
+TreeSnapshot& TreePass::getSnapshot ()
+//: a snapshot of the tree, made the first time any analysis asks for one
+{
+	assert (mTreeP != NULL);
+	if (mSnapshotP == NULL)
+		mSnapshotP = new TreeSnapshot (*mTreeP);
+	return *mSnapshotP;
+}
+
+
+bool TreePass::adoptAnalysis (BasicAction* iActionP)
+//: add this action to the pass, if it is an analysis that can be
+{
+	BasicAnalysis* theAnalysisP = castAsAnalysis (iActionP);
+	if (theAnalysisP == NULL)
+		return false;
+	TreeVisitor* theVisitorP = theAnalysisP->makeVisitor();
+	if (theVisitorP == NULL)
+		return false;
+	mVisitors.push_back (theVisitorP);
+	return true;
+}
+
+
+void TreePass::run ()
+//: sweep the active tree once, then have each analysis report in turn
+{
+	mTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
+
+	for (nodeiter_t q = mTreeP->begin(); q != mTreeP->end(); q++)
+	{
+		for (std::vector<TreeVisitor*>::size_type i = 0; i < mVisitors.size(); i++)
+			mVisitors[i]->visitNode (*this, q);
+	}
+
+	for (std::vector<TreeVisitor*>::size_type i = 0; i < mVisitors.size(); i++)
+		mVisitors[i]->finish (*this);
+
+	delete mSnapshotP;
+	mSnapshotP = NULL;
+	mTreeP = NULL;
+}
+
 
 // *** AGE *************************************************************/
 
@@ -158,7 +226,8 @@ void TreeInfoAnalysis::execute ()
 	*/
 	if (mCalcAge)
 		// MesaGlobals::mReporterP->print (theTreeP->getTreeAge(), "phylogenetic age");
-		MesaGlobals::mReporterP->print (theTreeP->getPhyloAge(), "phylogenetic age");
+		MesaGlobals::mReporterP->print (TreeSnapshot (*theTreeP).getPhyloAge(),
+			"phylogenetic age");
 
 	if (mCalcPaleo)
 	{
@@ -180,7 +249,7 @@ const char* TreeInfoAnalysis::describeAnalysis ()
 
 void NodeInfoAnalysis::execute ()
 //: calculate the age of every node
-// TO DO: cache lengths to save time
+// The times are read from a snapshot of the tree, made once.
 {
 	ReporterPrefix	thePrefix ("node information");
 
@@ -197,6 +266,7 @@ void NodeInfoAnalysis::execute ()
 	stringvec_t		theLabels;
 	vector<double>	theAges, theTimesToParent, theTimesToRoot;
 	vector<int>		theChildrenCnt, theLeaveCnt, theSubtreeSz, theSiblingCnt, theHeights;
+	TreeSnapshot	theSnapshot (*theTreeP);
 
 	// for every node
 
@@ -225,9 +295,10 @@ void NodeInfoAnalysis::execute ()
 			continue;
 
 		// do analysis
+		TreeSnapshot::size_type theIndex = theSnapshot.getIndex (q);
 		theLabels.push_back (getNodeLabel (q));
 		if (mCalcAges)
-			theAges.push_back (theTreeP->getTimeSinceNodeOrigin (q));
+			theAges.push_back (theSnapshot.getTimeSinceNodeOrigin (theIndex));
 		// if (mCalcTimeToParent)
 			theTimesToParent.push_back (theTreeP->getEdgeWeight (q));
 		if (mCalcChildren)
@@ -241,7 +312,7 @@ void NodeInfoAnalysis::execute ()
 		if (mCalcHeight)
 			theHeights.push_back (theTreeP->getHeight (q));
 		if (mCalcTimeToRoot)
-			theTimesToRoot.push_back (theTreeP->getTimeFromNodeToRoot (q));
+			theTimesToRoot.push_back (theSnapshot.getTimeFromNodeToRoot (theIndex));
 	}
 
 	// print out results
@@ -297,7 +368,7 @@ const char*  NodeInfoAnalysis::describeAnalysis ()
 
 void XNodeInfoAnalysis::execute ()
 //: calculate the age of every node
-// TO DO: cache lengths to save time
+// The times are read from a snapshot of the tree, made once.
 {
 	ReporterPrefix	thePrefix ("node information");
 
@@ -308,6 +379,7 @@ void XNodeInfoAnalysis::execute ()
 	// grab the nodes
 	nodearr_t theSelectedNodes;
 	mNodeSelectorP->selectNodes (theTreeP, theSelectedNodes);
+	TreeSnapshot theSnapshot (*theTreeP);
 
 	stringvec_t		theLabels;
 	vector<double>	theAges, theTimesToParent, theTimesToRoot;
@@ -320,11 +392,12 @@ void XNodeInfoAnalysis::execute ()
 	for (p = theSelectedNodes.begin(); p != theSelectedNodes.end(); p++)
 	{
 		nodeiter_t q = *p;
+		TreeSnapshot::size_type theIndex = theSnapshot.getIndex (q);
 
 		// do analysis
 		// theLabels.push_back (getNodeLabel (q));
 		if (mCalcAges)
-			theAges.push_back (theTreeP->getTimeSinceNodeOrigin (q));
+			theAges.push_back (theSnapshot.getTimeSinceNodeOrigin (theIndex));
 		// if (mCalcTimeToParent)
 			theTimesToParent.push_back (theTreeP->getEdgeWeight (q));
 		if (mCalcChildren)
@@ -338,7 +411,7 @@ void XNodeInfoAnalysis::execute ()
 		if (mCalcHeight)
 			theHeights.push_back (theTreeP->getHeight (q));
 		if (mCalcTimeToRoot)
-			theTimesToRoot.push_back (theTreeP->getTimeFromNodeToRoot (q));
+			theTimesToRoot.push_back (theSnapshot.getTimeFromNodeToRoot (theIndex));
 	}
 
 	// print out results
@@ -527,19 +600,60 @@ the distances between nodes are large, then GD will tend towards 1.0.
 For example, if all branchlengths are 0.7, in a tree of 20 tips, the
 GD is effectively 1.0.
 */
-void GeneticDiversityAnalysis::execute ()
+class GeneticDiversityVisitor: public TreeVisitor
+//: multiply up the complements of the branch lengths
+// As MesaTree::calcGeneticDiversity().
 {
-	ReporterPrefix	thePrefix ("genetic diversity");
+public:
+	GeneticDiversityVisitor ()
+		: mProduct (1.0), mDistancesAreAllelic (true)
+		{}
 
-	MesaTree* theTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
-	double		theAnswer = theTreeP->calcGeneticDiversity();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
+
+private:
+	double   mProduct;
+	bool     mDistancesAreAllelic;
+};
+
+void GeneticDiversityVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	if (not mDistancesAreAllelic)
+		return;
+
+	MesaTree& theTree = ioPass.getTree();
+	MesaTree::weight_type theDistance = theTree.getTimeFromNodeToParent (iNodeIter);
+	if (1.0 <= theDistance)
+	{
+		mDistancesAreAllelic = false;
+		return;
+	}
+	assert (0.0 <= theDistance);
+	if ((not theTree.isRoot (iNodeIter)) and (0.0 < theDistance))
+		mProduct *= (1.0 - theDistance);
+}
 
-	if (theAnswer == 0.0)
+void GeneticDiversityVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("genetic diversity");
+
+	if (not mDistancesAreAllelic)
 		MesaGlobals::mReporterP->printNotApplicable ("non-allelic distances in the tree");
-	else if (theAnswer == 1.0)
+	else if (mProduct == 1.0)
 		MesaGlobals::mReporterP->printNotApplicable ("no distances in the tree");
 	else
-		MesaGlobals::mReporterP->print (theAnswer);
+		MesaGlobals::mReporterP->print (1.0 - mProduct);
+}
+
+void GeneticDiversityAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* GeneticDiversityAnalysis::makeVisitor ()
+{
+	return new GeneticDiversityVisitor;
 }
 
 
@@ -550,17 +664,49 @@ const char* GeneticDiversityAnalysis::describeAnalysis ()
 
 
 
-void PhyloDiversityAnalysis::execute ()
+class PhyloDiversityVisitor: public TreeVisitor
+//: sum the branch lengths below the root
+// As MesaTree::calcPhyloDiversity().
 {
-	ReporterPrefix	thePrefix ("phylogenetic diversity");
+public:
+	PhyloDiversityVisitor ()
+		: mSum (0.0)
+		{}
 
-	MesaTree* theTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
-	double theAnswer = theTreeP->calcPhyloDiversity();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
+
+private:
+	double   mSum;
+};
+
+void PhyloDiversityVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	MesaTree& theTree = ioPass.getTree();
+	MesaTree::weight_type theDistance = theTree.getTimeFromNodeToParent (iNodeIter);
+	assert (0.0 <= theDistance);
+	if (not theTree.isRoot (iNodeIter))
+		mSum += theDistance;
+}
+
+void PhyloDiversityVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("phylogenetic diversity");
 
-	if (theAnswer == 0.0)
+	if (mSum == 0.0)
 		MesaGlobals::mReporterP->printNotApplicable ("no distances in the tree");
 	else
-		MesaGlobals::mReporterP->print (theAnswer);
+		MesaGlobals::mReporterP->print (mSum);
+}
+
+void PhyloDiversityAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* PhyloDiversityAnalysis::makeVisitor ()
+{
+	return new PhyloDiversityVisitor;
 }
 
 
@@ -1795,46 +1941,65 @@ const char* SlowinskiGuyerAnalysis::describeAnalysis ()
 
 
 // *** SHAO/SOKAL N BAR
-void ShaosNbarAnalysis::execute ()
+class ShaosNbarVisitor: public TreeVisitor
+//: sum the heights of the leaves
 {
-	ReporterPrefix	thePrefix ("Shao & Sokal's Nbar imbalance");
+public:
+	ShaosNbarVisitor ()
+		: mSumHt (0), mNumLeaves (0)
+		{}
 
-	MesaTree* theTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
 
-	// handle simple case of a single node
-	if (theTreeP->countNodes() <= 1)
-	{
-		MesaGlobals::mReporterP->printNotApplicable ("tree is too small");
+private:
+	long   mSumHt;
+	long   mNumLeaves;
+};
 
-		return;
+void ShaosNbarVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	MesaTree& theTree = ioPass.getTree();
+	if (theTree.isLeaf (iNodeIter))
+	{
+		mNumLeaves++;
+		MesaTree::size_type theHt = theTree.getHeight (iNodeIter);
+		mSumHt += theHt; // number of intervening nodes
 	}
+}
 
-	// clauclate Nbar
-	long	theSumHt = 0;
-	long	theNumLeaves = 0;
+void ShaosNbarVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("Shao & Sokal's Nbar imbalance");
 
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+	// handle simple case of a single node
+	if (ioPass.getTree().countNodes() <= 1)
 	{
-		if (theTreeP->isLeaf (q))
-		{
-			theNumLeaves++;
-			MesaTree::size_type theHt = theTreeP->getHeight (q);
-			theSumHt += theHt; // number of intervening nodes
-		}
+		MesaGlobals::mReporterP->printNotApplicable ("tree is too small");
+		return;
 	}
 
-	double theAnswer = double (theSumHt) / double (theNumLeaves);
+	double theAnswer = double (mSumHt) / double (mNumLeaves);
 
 	// calculate the expected
 	double theExpected = 0.0;
-	for (int i = 2; i <= theNumLeaves; i++)
+	for (int i = 2; i <= mNumLeaves; i++)
 		theExpected += 1 / double (i);
 	theExpected *= 2.0;
 
 	// output results
 	MesaGlobals::mReporterP->print (theAnswer, "observed");
 	MesaGlobals::mReporterP->print (theExpected, "expected");
+}
 
+void ShaosNbarAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* ShaosNbarAnalysis::makeVisitor ()
+{
+	return new ShaosNbarVisitor;
 }
 
 const char* ShaosNbarAnalysis::describeAnalysis ()
@@ -1844,36 +2009,45 @@ const char* ShaosNbarAnalysis::describeAnalysis ()
 
 
 // *** SHAO/SOKAL SIGMA SQUARED
-void ShaosSigmaSqAnalysis::execute ()
+class ShaosSigmaSqVisitor: public TreeVisitor
+//: collect the number of nodes between each leaf & the root
 {
-	ReporterPrefix	thePrefix ("sigma squared imbalance");
+public:
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
 
-	MesaTree* theTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
+private:
+	vector<int>   mNVec;
+};
+
+void ShaosSigmaSqVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	MesaTree& theTree = ioPass.getTree();
+	if (theTree.isLeaf (iNodeIter))
+	{
+		MesaTree::size_type theHt = theTree.getHeight (iNodeIter);
+		mNVec.push_back (theHt - 1); // number of intervening nodes
+	}
+}
+
+void ShaosSigmaSqVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("sigma squared imbalance");
 
 	// handle simple case of a single node
-	if (theTreeP->countNodes() <= 1)
+	if (ioPass.getTree().countNodes() <= 1)
 	{
 		MesaGlobals::mReporterP->printNotApplicable ("tree is too small");
 		return;
 	}
 
-	// calculate N for each leaf
-	vector<int>	theNVec;
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
-	{
-		if (theTreeP->isLeaf (q))
-		{
-			MesaTree::size_type theHt = theTreeP->getHeight (q);
-			theNVec.push_back (theHt - 1); // number of intervening nodes
-		}
-	}
-	long theNumLeaves = theNVec.size();
+	long theNumLeaves = mNVec.size();
 
 	// calculate Nbar
 	double theNbar = 0.0;
 	for (long i = 0; i < theNumLeaves; i++)
 	{
-		theNbar += double (theNVec[i]);
+		theNbar += double (mNVec[i]);
 	}
 	theNbar /= double (theNumLeaves);
 
@@ -1881,7 +2055,7 @@ void ShaosSigmaSqAnalysis::execute ()
 	double theSumSqDiffs = 0.0;
 	for (long i = 0; i < theNumLeaves; i++)
 	{
-		double theDiff = theNVec[i] - theNbar;
+		double theDiff = mNVec[i] - theNbar;
 		theSumSqDiffs += (theDiff * theDiff);
 	}
 
@@ -1892,6 +2066,16 @@ void ShaosSigmaSqAnalysis::execute ()
 	MesaGlobals::mReporterP->print (theAnswer);
 }
 
+void ShaosSigmaSqAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* ShaosSigmaSqAnalysis::makeVisitor ()
+{
+	return new ShaosSigmaSqVisitor;
+}
+
 const char* ShaosSigmaSqAnalysis::describeAnalysis ()
 {
 	return "Shao & Sokal's sigma-squared imbalance";
@@ -1899,59 +2083,76 @@ const char* ShaosSigmaSqAnalysis::describeAnalysis ()
 
 
 // *** COLLESS' C
-void CollessCAnalysis::execute ()
+class CollessCVisitor: public TreeVisitor
+//: sum the difference in leaves between the two subtrees of every node
 // TO DO: currently we ignore polytomies. Should we assume they are
 // balanced?
 {
-	ReporterPrefix	thePrefix ("Colless' C imbalance");
+public:
+	CollessCVisitor ()
+		: mTreeHasNoPolytomies (true), mTotal (0)
+		{}
 
-	MesaTree* theTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
 
-	// for every internal node
-	bool theTreeHasNoPolytomies = true;
-	long theTotal = 0;
+private:
+	bool   mTreeHasNoPolytomies;
+	long   mTotal;
+};
 
-	nodeiter_t q = theTreeP->begin();
-	while ((q != theTreeP->end()) and theTreeHasNoPolytomies)
-	{
-		if (not theTreeP->isLeaf (q))
-		{
-			if (theTreeP->countChildren (q) != 2)
-			{
-				theTreeHasNoPolytomies = false;
-				break;
-			}
-			else
-			{
-				nodeiter_t theLeftSubtreeIter = theTreeP->getChild (q, 0);
-				long theBigTips = theTreeP->countLeaves (theLeftSubtreeIter);
-				nodeiter_t theRightSubtreeIter = theTreeP->getChild (q, 1);
-				long theSmallTips = theTreeP->countLeaves (theRightSubtreeIter);
+void CollessCVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	MesaTree& theTree = ioPass.getTree();
+	if ((not mTreeHasNoPolytomies) or theTree.isLeaf (iNodeIter))
+		return;
 
-				theTotal += abs (theBigTips - theSmallTips);
-			}
-		}
+	if (theTree.countChildren (iNodeIter) != 2)
+	{
+		mTreeHasNoPolytomies = false;
+	}
+	else
+	{
+		nodeiter_t theLeftSubtreeIter = theTree.getChild (iNodeIter, 0);
+		long theBigTips = theTree.countLeaves (theLeftSubtreeIter);
+		nodeiter_t theRightSubtreeIter = theTree.getChild (iNodeIter, 1);
+		long theSmallTips = theTree.countLeaves (theRightSubtreeIter);
 
-		q++;
+		mTotal += abs (theBigTips - theSmallTips);
 	}
+}
+
+void CollessCVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("Colless' C imbalance");
 
 	// output results
-	if (not theTreeHasNoPolytomies)
+	if (not mTreeHasNoPolytomies)
 		MesaGlobals::mReporterP->printNotApplicable ("tree contains polytomies");
 	else
 	{
-		int theNumTips = theTreeP->countLeaves();
+		int theNumTips = ioPass.getTree().countLeaves();
 		if (theNumTips <= 2)
 			MesaGlobals::mReporterP->printNotApplicable ("tree is too small");
 		else
 		{
 			double theAnswer = (2.0 / double ((theNumTips - 1) * (theNumTips - 2))) *
-				theTotal;
+				mTotal;
 			MesaGlobals::mReporterP->print (theAnswer);
 		}
 	}
 }
 
+void CollessCAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* CollessCAnalysis::makeVisitor ()
+{
+	return new CollessCVisitor;
+}
+
 const char* CollessCAnalysis::describeAnalysis ()
 {
 	return "Colless' C imbalance";
@@ -1959,41 +2160,48 @@ const char* CollessCAnalysis::describeAnalysis ()
 
 
 // *** SHAO & SOKAL's B1
-void B1Analysis::execute ()
+class B1Visitor: public TreeVisitor
+//: sum the reciprocal of the reach of every internal node
 {
-	ReporterPrefix	thePrefix ("B1 balance");
+public:
+	B1Visitor ()
+		: mAnswer (0.0)
+		{}
 
-	MesaTree* theTreeP = getActiveTreeP();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
 
-	double theAnswer = 0.0;
+private:
+	double   mAnswer;
+};
 
-	// for every internal node
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
-	{
-		// if a tip or root, don't process
-		if (theTreeP->isRoot (q) or theTreeP->isLeaf (q))
-			continue;
+void B1Visitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	// if a tip or root, don't process
+	MesaTree& theTree = ioPass.getTree();
+	if (theTree.isRoot (iNodeIter) or theTree.isLeaf (iNodeIter))
+		return;
 
-		// find out the subtended tips
-		nodeidvec_t theLeafIds;
-		theTreeP->collectLeaveIds (q->first, theLeafIds);
+	// how far is it from the furthest subtended tip to this node?
+	long theMaxDist = long (theTree.getNodeReach (iNodeIter));
 
-		// how far is it from the tips to this node?
-		long theMaxDist = 1;
-		for (unsigned int i = 0; i < theLeafIds.size(); i++)
-		{
-			nodeiter_t theChildIter = theTreeP->getIter (theLeafIds[i]);
-			long theDist = theTreeP->getDistance (theChildIter, q);
-			if (theMaxDist < theDist)
-				theMaxDist = theDist;
-		}
+	mAnswer += 1.0 / double (theMaxDist);
+}
 
-		theAnswer += 1.0 / double (theMaxDist);
-	}
+void B1Visitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("B1 balance");
+	MesaGlobals::mReporterP->print (mAnswer);
+}
 
-	// output results
-	MesaGlobals::mReporterP->print (theAnswer);
+void B1Analysis::execute ()
+{
+	executeAsPass ();
+}
 
+TreeVisitor* B1Analysis::makeVisitor ()
+{
+	return new B1Visitor;
 }
 
 const char* B1Analysis::describeAnalysis ()
@@ -2003,27 +2211,46 @@ const char* B1Analysis::describeAnalysis ()
 
 
 // *** SHAO & SOKAL's B2
-void B2Analysis::execute ()
+class B2Visitor: public TreeVisitor
+//: sum the height of every leaf, weighted by its chance of being reached
 {
-	ReporterPrefix	thePrefix ("B2 balance");
+public:
+	B2Visitor ()
+		: mAnswer (0.0)
+		{}
 
-	MesaTree* theTreeP = getActiveTreeP();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
 
-	double theAnswer = 0.0;
+private:
+	double   mAnswer;
+};
 
-	// for every internal node
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+void B2Visitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	MesaTree& theTree = ioPass.getTree();
+	if (theTree.isLeaf (iNodeIter))
 	{
-		if (theTreeP->isLeaf (q))
-		{
-			long theHt = theTreeP->getHeight (q);
-			if (theHt != 0)
-				theAnswer += double (theHt) / pow (2.0, double (theHt));
-		}
+		long theHt = theTree.getHeight (iNodeIter);
+		if (theHt != 0)
+			mAnswer += double (theHt) / pow (2.0, double (theHt));
 	}
+}
 
-	// output results
-	MesaGlobals::mReporterP->print (theAnswer);
+void B2Visitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("B2 balance");
+	MesaGlobals::mReporterP->print (mAnswer);
+}
+
+void B2Analysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* B2Analysis::makeVisitor ()
+{
+	return new B2Visitor;
 }
 
 const char* B2Analysis::describeAnalysis ()
@@ -2034,7 +2261,8 @@ const char* B2Analysis::describeAnalysis ()
 
 // *** OTHER TREE SHAPE ANALYSES ******************************************/
 
-void StemminessAnalysis::execute ()
+class StemminessVisitor: public TreeVisitor
+//: sum the stemminess of every internal node below the root
 /*
 Note this assumes that the tree is ultrametric. If not - well, you're
 fairly fucked.
@@ -2050,99 +2278,131 @@ give a more consistent answer.
 TO DO: get rid of the counting of internal nodes.
 */
 {
-	ReporterPrefix	thePrefix ("Stemminess");
-
-	// For every internal node, divide the length of the branch above
-	// a node by the age of its parent (i.e. the time from when the
-	// parent splits to the present), then calculate the sum of these
-	// So as to efficiently and correctly calculate the node age (time
-	// since splitting), get the age of the tree (less the branchlength
-	// on the root) and subtract the time from the node to the root.
+public:
+	StemminessVisitor ()
+		: mAnswer (0.0), mNumInternalNodes (0)
+		{}
 
-	MesaTree*    theTreeP = getActiveTreeP();
-	double       theAnswer = 0.0;
-	int          theNumInternalNodes = 0;
-	nodeiter_t   theRootIter = theTreeP->getRoot();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
 
-	// get age of root
-	mesatime_t theRootAge = theTreeP->getRootAge();
+private:
+	double   mAnswer;
+	int      mNumInternalNodes;
+};
 
+void StemminessVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+// For every internal node, divide the length of the branch above a node
+// by the age of its parent (i.e. the time from when the parent splits to
+// the present), then calculate the sum of these. So as to efficiently and
+// correctly calculate the node age (time since splitting), get the age of
+// the tree (less the branchlength on the root) and subtract the time from
+// the node to the root. Both are read from a snapshot of the tree.
+{
 	// for every internal node that is not the root
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
-	{
-		if (theTreeP->isInternal(q) and (q != theRootIter)) // 01.6.18
-		{
-			theNumInternalNodes++;
+	const TreeSnapshot& theSnapshot = ioPass.getSnapshot();
+	TreeSnapshot::size_type theIndex = theSnapshot.getIndex (iNodeIter);
+	if (theSnapshot.isRoot (theIndex) or theSnapshot.isLeaf (theIndex)) // 01.6.18
+		return;
 
-			nodeiter_t theParent = theTreeP->getParent (q);
+	mNumInternalNodes++;
 
-			/*
-			// 01.10.16
-			time_t theParAge = theTreeP->getNodeAge (theParentIter);
-			time_t theBranchLen = theTreeP->getEdgeWeight (q);
-			*/
+	TreeSnapshot::size_type theParent = theSnapshot.getParent (theIndex);
+	mesatime_t theBranchLen = theSnapshot.getEdgeWeight (theIndex);
+	mesatime_t theParAge = theSnapshot.getRootAge() -
+		theSnapshot.getTimeFromNodeToRoot (theParent);
+	assert (0 <= theBranchLen);
+	assert (0 <= theParAge);
 
-			mesatime_t theBranchLen = theTreeP->getTimeFromNodeToParent (q);
-			mesatime_t theParAge = theRootAge -
-				theTreeP->getTimeFromNodeToRoot (theParent);
-			assert (0 <= theBranchLen);
-			assert (0 <= theParAge);
+	// get steminess of this node
+	MesaTree::weight_type theStemminess;
+	if ((theParAge == 0.0) or (theBranchLen == 0.0))
+		theStemminess = 0.0;
+	else
+		theStemminess = theBranchLen / theParAge;
+	assert (0.0 <= theStemminess);
 
-			// get steminess of this node
-			MesaTree::weight_type theStemminess;
-			if ((theParAge == 0.0) or (theBranchLen == 0.0))
-				theStemminess = 0.0;
-			else
-				theStemminess = theBranchLen / theParAge;
-			assert (0.0 <= theStemminess);
+	// add to running total
+	mAnswer += theStemminess;
+	assert (0.0 <= mAnswer);
+}
 
-			// add to running total
-			theAnswer += theStemminess;
-			assert (0.0 <= theAnswer);
-		}
-	}
+void StemminessVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("Stemminess");
 
 	// calculate results
+	double theAnswer = mAnswer;
 	bool theTreeHasNoLengths = (theAnswer == 0.0);
 	if (not theTreeHasNoLengths)
-		theAnswer /= MesaTree::weight_type (theNumInternalNodes);
+		theAnswer /= MesaTree::weight_type (mNumInternalNodes);
 
 	// Postconditions & return:
-	assert (0 <= theNumInternalNodes);
-	assert (theNumInternalNodes = theTreeP->countInternalNodes() - 1);
+	assert (0 <= mNumInternalNodes);
 	assert (0.0 <= theAnswer);
 
 	if (theTreeHasNoLengths)
 		MesaGlobals::mReporterP->printNotApplicable ("tree has no lengths");
-	else if (theNumInternalNodes == 0)
+	else if (mNumInternalNodes == 0)
 		MesaGlobals::mReporterP->printNotApplicable ("tree too small");
 	else
 		MesaGlobals::mReporterP->print (theAnswer);
 }
 
+void StemminessAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* StemminessAnalysis::makeVisitor ()
+{
+	return new StemminessVisitor;
+}
+
 const char* StemminessAnalysis::describeAnalysis ()
 {
 	return "stemminess";
 }
 
 
-void ResolutionAnalysis::execute ()
+class ResolutionVisitor: public TreeVisitor
 //: calculate the resolution of the tree using Colless' 1980 measure
 // Note that we check to see the tree is rooted here, which is moot in reality
 // CHANGE:
 // 01.6.18: now the root is correctly identified as an internal node
 {
-	ReporterPrefix	thePrefix ("resolution");
+public:
+	ResolutionVisitor ()
+		: mNumInternalNodes (0), mNumLeaves (0)
+		{}
 
-	MesaTree* theTreeP = getActiveTreeP();
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
+
+private:
+	long   mNumInternalNodes;
+	long   mNumLeaves;
+};
+
+void ResolutionVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	if (ioPass.getTree().isLeaf (iNodeIter))
+		mNumLeaves++;
+	else
+		mNumInternalNodes++;
+}
+
+void ResolutionVisitor::finish (TreePass& ioPass)
+{
+	ReporterPrefix	thePrefix ("resolution");
 
-	double theNumInternalBranches = theTreeP->countInternalNodes() - 1;
+	double theNumInternalBranches = mNumInternalNodes - 1;
 	int theCorrection;
-	if (theTreeP->isTreeRooted())
+	if (ioPass.getTree().isTreeRooted())
 		theCorrection = 2;
 	else
 		theCorrection = 3;
-	double theMaxIntBranches = theTreeP->countLeaves() - theCorrection;
+	double theMaxIntBranches = mNumLeaves - theCorrection;
 
 	if (theMaxIntBranches <= 0.0)
 		MesaGlobals::mReporterP->printNotApplicable ("tree too small");
@@ -2150,37 +2410,58 @@ void ResolutionAnalysis::execute ()
 		MesaGlobals::mReporterP->print (theNumInternalBranches / theMaxIntBranches);
 }
 
+void ResolutionAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* ResolutionAnalysis::makeVisitor ()
+{
+	return new ResolutionVisitor;
+}
+
 const char* ResolutionAnalysis::describeAnalysis ()
 {
 	return "resolution";
 }
 
 
-void UltrametricAnalysis::execute ()
+class UltrametricVisitor: public TreeVisitor
+//: collect the time from each tip to the root
+{
+public:
+	void visitNode (TreePass& ioPass, nodeiter_t iNodeIter);
+	void finish (TreePass& ioPass);
+
+private:
+	vector <MesaTree::weight_type>   mTipLengths;
+};
+
+void UltrametricVisitor::visitNode (TreePass& ioPass, nodeiter_t iNodeIter)
+{
+	if (ioPass.getTree().isLeaf (iNodeIter))
+	{
+		const TreeSnapshot& theSnapshot = ioPass.getSnapshot();
+		TreeSnapshot::size_type theIndex = theSnapshot.getIndex (iNodeIter);
+		mTipLengths.push_back (theSnapshot.getTimeFromNodeToRoot (theIndex));
+	}
+}
+
+void UltrametricVisitor::finish (TreePass& ioPass)
 //: calculate that it is ultrametric within limits
 {
 	ReporterPrefix	thePrefix ("ultrametric");
 
-	MesaTree* theTreeP = getActiveTreeP();
-	if (theTreeP->countNodes () <= 1)
+	if (ioPass.getTree().countNodes () <= 1)
 	{
 		MesaGlobals::mReporterP->printNotApplicable ("tree too small");
 		return;
 	}
 
-	vector <MesaTree::weight_type> theTipLengths;
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
-	{
-		if (theTreeP->isLeaf (q))
-		{
-			theTipLengths.push_back (theTreeP->getTimeFromNodeToRoot (q));
-		}
-	}
-
 	// now we have a list of lengths tip to root
 	MesaTree::weight_type theMin, theMax, theDiff;
-	theMin = *(min_element (theTipLengths.begin(), theTipLengths.end()));
-	theMax = *(max_element (theTipLengths.begin(), theTipLengths.end()));
+	theMin = *(min_element (mTipLengths.begin(), mTipLengths.end()));
+	theMax = *(max_element (mTipLengths.begin(), mTipLengths.end()));
 	theDiff = (theMax - theMin) / theMax;
 
 	if (theMin == theMax)
@@ -2195,6 +2476,16 @@ void UltrametricAnalysis::execute ()
 		MesaGlobals::mReporterP->print (false);
 }
 
+void UltrametricAnalysis::execute ()
+{
+	executeAsPass ();
+}
+
+TreeVisitor* UltrametricAnalysis::makeVisitor ()
+{
+	return new UltrametricVisitor;
+}
+
 
 const char* UltrametricAnalysis::describeAnalysis ()
 {
@@ -2202,6 +2493,96 @@ const char* UltrametricAnalysis::describeAnalysis ()
 }
 
 
+// *** DISTANCE MATRIX *************************************************/
+
+static void writeBinaryDistances (std::ofstream& ioOutFile,
+	const TreeSnapshot& iSnapshot, stringvec_t& iLeafNames)
+//: write the distances between leaves as a packed lower triangle
+// The file is the tag "MESADIST", the number of leaves as a 4-byte int,
+// the name of each leaf ended by a null, and then the distance from each
+// leaf to every one before it, row after row, as 8-byte doubles. All
+// numbers are in the byte order of the machine writing them.
+{
+	ioOutFile.write ("MESADIST", 8);
+	long theNumLeaves = long (iSnapshot.countLeaves());
+	unsigned int theCount = (unsigned int) theNumLeaves;
+	assert (sizeof (theCount) == 4);
+	ioOutFile.write ((const char*) &theCount, 4);
+	for (long i = 0; i < theNumLeaves; i++)
+		ioOutFile.write (iLeafNames[i].c_str(), iLeafNames[i].size() + 1);
+
+	vector<TreeSnapshot::weight_type> theRow;
+	for (long i = 1; i < theNumLeaves; i++)
+	{
+		iSnapshot.getLeafDistances (i, theRow);
+		ioOutFile.write ((const char*) &theRow[0],
+			std::streamsize (theRow.size() * sizeof (TreeSnapshot::weight_type)));
+	}
+}
+
+
+void PatristicDistanceAnalysis::execute ()
+//: write the matrix of distances between the tips to a numbered file
+// As a Nexus distances block or a binary file. The distances are worked
+// out a row at a time & written straight out, so the memory used grows
+// with the number of tips, not its square. The number of tips & the file
+// are reported.
+{
+	ReporterPrefix	thePrefix ("patristic distances");
+
+	MesaTree* theTreeP = getActiveTreeP();
+	if (theTreeP->countLeaves() < 2)
+	{
+		MesaGlobals::mReporterP->printNotApplicable ("tree too small");
+		return;
+	}
+
+	TreeSnapshot theSnapshot (*theTreeP);
+	stringvec_t theLeafNames;
+	for (TreeSnapshot::size_type i = 0; i < theSnapshot.countLeaves(); i++)
+	{
+		nodeiter_t theLeafIter = theSnapshot.getIter (theSnapshot.getLeaf (i));
+		theLeafNames.push_back (theTreeP->getNodeName (theLeafIter));
+	}
+
+	string theFileName = concatIntToString (mBaseFileName.c_str(), ++mReps);
+	theFileName += mWriteBinary ? ".dist" : ".nex";
+	std::ofstream theOutFile;
+	if (mWriteBinary)
+		theOutFile.open (theFileName.c_str(), std::ios::out | std::ios::binary);
+	else
+		theOutFile.open (theFileName.c_str());
+	if (not theOutFile.is_open())
+		throw ExecutionError ("couldn't open file for distances");
+
+	if (mWriteBinary)
+	{
+		writeBinaryDistances (theOutFile, theSnapshot, theLeafNames);
+		theOutFile.close();
+	}
+	else
+	{
+		// the writer closes the file when it goes
+		NexusWriter theWriter (theOutFile);
+		theWriter.writeDistances (theSnapshot, theLeafNames);
+	}
+
+	MesaGlobals::mReporterP->print (long (theLeafNames.size()), "tips");
+	MesaGlobals::mReporterP->print (theFileName, "file");
+}
+
+const char* PatristicDistanceAnalysis::describeAnalysis ()
+{
+	static string theDescStr;
+	theDescStr = "patristic distances (";
+	theDescStr += mWriteBinary ? "binary" : "nexus";
+	theDescStr += " files named ";
+	theDescStr += mBaseFileName;
+	theDescStr += ")";
+	return theDescStr.c_str();
+}
+
+
 // *** SITE ANALYSES *************************************************/
 
 void SiteComplementarityAnalysis::execute ()
@@ -2276,23 +2657,24 @@ void ComparativeAnalysis::execute ()
 	ReporterPrefix	thePrefix ("Stemminess");
 
 	MesaTree* theTreeP = getActiveTreeP();
+	TreeSnapshot theSnapshot (*theTreeP);
 
 	double theAnswer = 0.0;
 	int theNumInternalNodes = 0;
 
-	// for every internal node:
+	// for every internal node but the root, which has no parent:
 	// divide the length of the branch by the age of it's parent
 	// calculate the sum of these
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+	for (TreeSnapshot::size_type i = 1; i < theSnapshot.countNodes(); i++)
 	{
-		if (theTreeP->isInternal (q))
+		if (not theSnapshot.isLeaf (i))
 		{
 			theNumInternalNodes++;
 			// get age of parent
-			nodeiter_t theParentIter = theTreeP->getParent (q);
-			MesaTree::weight_type theParAge = theTreeP->getNodeAge (theParentIter);
+			TreeSnapshot::size_type theParent = theSnapshot.getParent (i);
+			MesaTree::weight_type theParAge = theSnapshot.getNodeAge (theParent);
 			// get branch length
-			MesaTree::weight_type theBranchLen = theTreeP->getEdgeWeight (q);
+			MesaTree::weight_type theBranchLen = theSnapshot.getEdgeWeight (i);
 			// get steminess of this node
 			MesaTree::weight_type theStemminess = theBranchLen / theParAge;
 			// add to running total
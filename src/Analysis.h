@@ -23,10 +23,16 @@ Credits:
 #include <vector>
 #include <algorithm>
 #include "StringUtils.h"
+#include "MesaGlobals.h"
 
 
 // *** CONSTANTS & DEFINES
 
+class TreeSnapshot;
+class TreeVisitor;
+class TreePass;
+
+
 // *** BASIC ANALYSIS ****************************************************/
 
 class BasicAnalysis: public BasicAction
@@ -47,8 +53,70 @@ public:
 	void                  deleteElement (size_type iIndex);
 	size_type             getDepth (size_type iIndex);
 
+	// SHARED PASSES
+	// those that can be run in a TreePass return a new visitor for it
+	virtual TreeVisitor*  makeVisitor ()
+		{ return NULL; }
+
 	// DEPRECIATED & DEBUG
 	void	validate	() {}
+
+	// INTERNALS
+protected:
+	void                  executeAsPass ();
+};
+
+
+// *** SHARED TREE PASS **************************************************/
+
+class TreeVisitor
+//: the part of an analysis that can be run in a pass shared with others
+// Results should only be reported by finish().
+{
+public:
+	// LIFECYCLE
+	virtual ~TreeVisitor ()
+		{}
+
+	// SERVICES
+	virtual void   visitNode (TreePass& ioPass, nodeiter_t iNodeIter) = 0;
+	virtual void   finish (TreePass& ioPass) = 0;
+};
+
+
+class TreePass
+//: a single sweep of the active tree, shared by several analyses
+// Most analyses look at every node in turn along with some totals over its
+// subtree, so a run of them can share one sweep rather than each walking
+// the tree. The subtree totals are those kept by the tree, worked out in
+// one post-order walk for all of them, & those that need the ages of nodes
+// share a snapshot of the tree. The analyses report in the order added.
+{
+public:
+	// LIFECYCLE
+	TreePass ()
+		: mTreeP (NULL), mSnapshotP (NULL)
+		{}
+	~TreePass ();
+
+	// ACCESSORS
+	bool              isEmpty () const
+		{ return mVisitors.empty(); }
+	MesaTree&         getTree ()
+		{ return *mTreeP; }
+	TreeSnapshot&     getSnapshot ();
+
+	// MUTATORS
+	bool              adoptAnalysis (BasicAction* iActionP);
+
+	// SERVICES
+	void              run ();
+
+	// INTERNALS
+private:
+	std::vector<TreeVisitor*>   mVisitors;
+	MesaTree*                   mTreeP;       // only while running
+	TreeSnapshot*               mSnapshotP;   // made when first asked for
 };
 
 
@@ -235,8 +303,7 @@ public:
 	virtual void selectNodes (MesaTree* iTargetTree, nodearr_t& oSelectedNodes)
 	{
 		iTargetTree->getLiveLeaves (oSelectedNodes);
-		std::random_shuffle (oSelectedNodes.begin(), oSelectedNodes.end());
-		sbl::shuffle (oSelectedNodes.begin(), oSelectedNodes.end());
+		MesaGlobals::mRng.Shuffle (oSelectedNodes.begin(), oSelectedNodes.end());
 		oSelectedNodes.resize (mTipsSelectedCount);
 	}
 
@@ -331,6 +398,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -346,6 +414,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -586,6 +655,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -601,6 +671,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -617,6 +688,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -633,6 +705,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -649,6 +722,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -667,6 +741,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -683,6 +758,7 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
@@ -698,12 +774,36 @@ public:
 
 	// SERVICE
 	void execute ();
+	TreeVisitor* makeVisitor ();
 
 	// I/O
 	const char* describeAnalysis ();
 };
 
 
+class PatristicDistanceAnalysis: public BasicAnalysis
+//: write the distances between all the tips of the tree to a file
+{
+public:
+	// LIFECYCLE
+	PatristicDistanceAnalysis (const char* iBaseFileCstr, bool iWriteBinary)
+		: mBaseFileName (iBaseFileCstr), mReps (0), mWriteBinary (iWriteBinary)
+		{}
+
+	// SERVICE
+	void execute ();
+
+	// I/O
+	const char* describeAnalysis ();
+
+	// INTERNALS
+private:
+	std::string   mBaseFileName;
+	int           mReps;          // how many times has this been called
+	bool          mWriteBinary;
+};
+
+
 // *** COMPARATIVE ANALYSES **********************************************/
 
 class SiteComplementarityAnalysis: public BasicAnalysis
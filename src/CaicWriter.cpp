@@ -18,10 +18,18 @@ To Do:
 // *** INCLUDES
 
 #include "CaicWriter.h"
+#include "TreeSnapshot.h"
+#include "CaicCode.h"
 #include <algorithm>
+#include <utility>
 
 using std::sort;
 using std::endl;
+using std::pair;
+using std::make_pair;
+using std::string;
+using std::vector;
+using sbl::CaicCode;
 
 
 // *** CONSTANTS & DEFINES
@@ -106,35 +114,52 @@ void CaicWriter::writeTrees (TreeWrangler& iWrangler)
 // TO DO: make sure minimum length is 2.0
 
 	MesaTree* theTreeP = iWrangler.getActiveTreeP ();
-
-	// gather & sort the caic codes
-	stringvec_t theCaicCodes;
-	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
-		theCaicCodes.push_back (theTreeP->getNodeLabelCaic (q));
+	TreeSnapshot theSnapshot (*theTreeP);
+	typedef TreeSnapshot::size_type   index_t;
+
+	// gather & sort the caic codes, keeping the node each is for
+	// The snapshot lists parents first, so the code of each node can be
+	// made from that of its parent & where it is among the children.
+	index_t theNumNodes = theSnapshot.countNodes();
+	stringvec_t theNodeCodes (theNumNodes);
+	vector< pair<string, index_t> > theCaicCodes;
+	theCaicCodes.reserve (theNumNodes);
+	for (index_t i = 0; i < theNumNodes; i++)
+	{
+		if (not theSnapshot.isRoot (i))
+		{
+			index_t theParent = theSnapshot.getParent (i);
+			index_t theChildIndex = i - theSnapshot.getChild (theParent, 0);
+			theNodeCodes[i] = theNodeCodes[theParent] +
+				CaicCode::indexToChar (theChildIndex);
+		}
+		theCaicCodes.push_back (make_pair (theNodeCodes[i], i));
+	}
 	sort (theCaicCodes.begin(), theCaicCodes.end());
 
 	// get data for nodes
-	stringvec_t::iterator p;
+	vector< pair<string, index_t> >::iterator p;
 	for (p = theCaicCodes.begin(); p != theCaicCodes.end(); p++)
 	{
 		// do branch-length file
 		// write code
-		(*mBlenStreamP) << p->c_str() << "\t";
-		nodeiter_t theCurrNode = theTreeP->getNodeByCaicCode (p->c_str());
+		(*mBlenStreamP) << p->first.c_str() << "\t";
+		index_t theCurrIndex = p->second;
+		nodeiter_t theCurrNode = theSnapshot.getIter (theCurrIndex);
 		// write distance to parent
-		if (theTreeP->isRoot (theCurrNode))
+		if (theSnapshot.isRoot (theCurrIndex))
 			(*mBlenStreamP) << "0";
 		else
-			(*mBlenStreamP) << theTreeP->getTimeFromNodeToParent (theCurrNode);
+			(*mBlenStreamP) << theSnapshot.getEdgeWeight (theCurrIndex);
 		// write age
 		(*mBlenStreamP) << "\t";
 		// (*mBlenStreamP) << theTreeP->getTimeSinceNodeOrigin (theCurrNode) << endl;
-		(*mBlenStreamP) << theTreeP->getTimeSinceNodeTerminus (theCurrNode) << endl;
+		(*mBlenStreamP) << theSnapshot.getTimeSinceNodeTerminus (theCurrIndex) << endl;
 
 		// do phyl file
-		if (theTreeP->isLeaf (theCurrNode))
+		if (theSnapshot.isLeaf (theCurrIndex))
 		{
-			(*mPhylStreamP) << p->c_str() << endl;
+			(*mPhylStreamP) << p->first.c_str() << endl;
 			(*mPhylStreamP) << theTreeP->getLeafName(theCurrNode) << endl;
 		}
 	}
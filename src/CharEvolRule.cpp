@@ -36,7 +36,7 @@ bool SpCharEvolRule::isTriggered
 	ioFiringLeaves = ioFiringLeaves; // just to shut compiler up
 	// Main:
 	// ioFiringLeaf = ioFiringLeaf; // to shut compiler up
-	return (isSpeciationRule (iFiringRuleP));
+	return respondsTo (iFiringRuleP->getEventKind ());
 }
 
 
@@ -377,12 +377,15 @@ bool TerminalCharEvolRule::isTriggered
 
 	// ioFiringLeaf = ioFiringLeaf;
 
-	// trigger if its the end of epoch
-	EndOfEpochRule* theRuleP = dynamic_cast<EndOfEpochRule*> (iFiringRuleP);
-	if (theRuleP != NULL)
-		return true;
+	return respondsTo (iFiringRuleP->getEventKind ());
+}
 
-	return isSpeciationOrKillRule (iFiringRuleP);
+bool TerminalCharEvolRule::respondsTo (evolevent_t iEvent)
+//: speciation, extinction and the end of the epoch
+{
+	return ((iEvent == kEvolEvent_Speciation) or
+		(iEvent == kEvolEvent_Extinction) or
+		(iEvent == kEvolEvent_EndOfEpoch));
 }
 
 
@@ -413,6 +416,28 @@ bool GradualCharEvolRule::isTriggered
 	return true;
 }
 
+void GradualCharEvolRule::startEpoch ()
+//: hand the schemes that allow it over to be evolved lazily
+// This must be before the first event, as that may be a speciation that
+// needs the parent's trait brought up to date.
+{
+	SchemeArr::iterator p;
+	for (p = mSchemes.begin(); p != mSchemes.end(); p++)
+	{
+		if ((*p)->isLazy ())
+			deferTraitEvolution (*p);
+	}
+}
+
+void GradualCharEvolRule::takeChangedLeaves (nodearr_t& oLeaves)
+//: hand over the leaves whose stored traits the last call changed
+// Only the schemes that are not deferred touch the trait matrices, so
+// if every scheme is lazy this is empty.
+{
+	oLeaves.swap (mChangedLeaves);
+	mChangedLeaves.clear();
+}
+
 const char* GradualCharEvolRule::describeRule ()
 {
 	return "trait evolution (gradual)";
@@ -427,18 +452,19 @@ void GradualCharEvolRule::commitAction (nodearr_t& iNodes, mesatime_t iTime)
 	iNodes = iNodes; // just to shut compiler up
 
 	// Main:
-	nodeiter_t theNode;
-	for (theNode = theTreeP->begin(); theNode != theTreeP->end(); theNode++)
-	{
-		if (theTreeP->isNodeAlive (theNode))
-		{
-			SchemeArr::iterator p;
-			for (p = mSchemes.begin(); p != mSchemes.end(); p++)
-			{
-				TraitEvolScheme* theSchemeP = *p;
-				theSchemeP->evolveChars (theNode, iTime);
-			}
-		}
+	// lazy schemes were deferred at the start of the epoch (see
+	// ActionUtils) and leave the stored traits alone, the rest evolve
+	// every living leaf in bulk
+	mChangedLeaves.clear();
+	SchemeArr::iterator p;
+	for (p = mSchemes.begin(); p != mSchemes.end(); p++)
+	{
+		TraitEvolScheme* theSchemeP = *p;
+		if (theSchemeP->isLazy ())
+			continue;
+		if (mChangedLeaves.empty())
+			theTreeP->getLiveLeaves (mChangedLeaves);
+		theSchemeP->evolveCharsBatch (mChangedLeaves, iTime);
 	}
 
 	// nodeiter_t iNode = iNodes[0]; // what was this about?
@@ -34,6 +34,8 @@ class SpCharEvolRule: public ConditionalRule
 public:
 	typedef ConditionalRule::size_type   size_type;
 	virtual bool isTriggered (EvolRule* iFiringRuleP, nodearr_t& ioFiringLeaves);
+	virtual bool respondsTo (evolevent_t iEvent)
+		{ return (iEvent == kEvolEvent_Speciation); }
 		
 private:
 };
@@ -90,6 +92,7 @@ public:
 	// accept defaults
 			
 	bool          isTriggered (EvolRule* iRuleP, nodearr_t& ioFiringLeaves);
+	bool          respondsTo (evolevent_t iEvent);
 	const char*   describeRule ();
 	void          commitAction (nodearr_t& iNode, mesatime_t iTime);
 };
@@ -101,8 +104,17 @@ class GradualCharEvolRule: public SymmetricSceRule
 {
 public:
 	bool          isTriggered (EvolRule* iRuleP, nodearr_t& ioFiringLeaves);
+	bool          respondsTo (evolevent_t iEvent)
+		{ iEvent = iEvent; return true; }
+	bool          changesOtherLeaves ()
+		{ return true; }
+	void          takeChangedLeaves (nodearr_t& oLeaves);
+	void          startEpoch ();
 	const char*   describeRule ();
 	void          commitAction (nodearr_t& iNode, mesatime_t iTime);
+
+private:
+	nodearr_t     mChangedLeaves;
 };
 
 
@@ -18,6 +18,8 @@ Credits:
 #include "ActionUtils.h"
 #include "StringUtils.h"
 #include "EvolRule.h"
+#include "Numerics.h"
+#include <algorithm>
 
 
 // *** CONSTANTS & DEFINES
@@ -31,6 +33,15 @@ const char* TraitEvolScheme::describe ()
 	return "char evolution scheme";
 }
 
+void TraitEvolScheme::evolveCharsBatch (nodearr_t& ioLeaves, mesatime_t iTime)
+//: evolve the trait across a whole set of leaves
+// Schemes that can draw their variates in bulk override this, otherwise
+// it is just each leaf in turn.
+{
+	for (nodearr_t::iterator p = ioLeaves.begin(); p != ioLeaves.end(); p++)
+		evolveChars (*p, iTime);
+}
+
 
 // *** NULL CLASS ********************************************************/
 
@@ -92,60 +103,105 @@ disctrait_t getState (long iIndex)
 */
 
 
-// *** MARKOVIAN DISC
+// *** RATE MATRIX
 
-void MarkovianCeScheme::evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime)
+void RateMatrixCeScheme::evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime)
+//: draw the state at the end of this interval
+// This replaces comparing a single wait with the interval, which missed
+// multiple changes and so needed the interval to be kept short.
 {
-	/*
-	Arse. We didn't make use of time here, and that introduced problems when
-	doing gradual eveolution of discrete traits. What I'll do now is compare the wait to the
-	time.
-	*/
-	/*
-	original
+	// Preconditions:
+	assert (0.0 <= iTime);
+	if (iTime == 0.0)
+		return;
 
-	iTime = iTime;
-	// disctrait_t theOldState = referState (ioLeafIter);
-	disctrait_t theOldState = getDiscData (ioLeafIter, mColIndex);
-	if (mCharStates.isMember (theOldState) and (MesaGlobals::mRng.UniformFloat () <= mProb))
+	// Main:
+	disctrait_t& theState = referState (ioLeafIter);
+	CharStateSet::iterator theOldIter = std::find (mCharStates.begin(),
+		mCharStates.end(), theState);
+	if (theOldIter == mCharStates.end())
+		return;
+
+	if (mJumpCumProbs.empty())
+		makeJumpProbs ();
+	if (mJumpRate == 0.0)
+		return;
+
+	long theNumStates = (long) mCharStates.size();
+	long theOldIndex = theOldIter - mCharStates.begin();
+	long theNewIndex = theOldIndex;
+	long theNumJumps = MesaGlobals::mRng.PoissonWhole (mJumpRate * iTime);
+	for (long n = 0; n < theNumJumps; n++)
+	{
+		const double* theRowP = &mJumpCumProbs[theNewIndex * theNumStates];
+		double theDraw = MesaGlobals::mRng.UniformFloat ();
+		theNewIndex = 0;
+		while ((theNewIndex < (theNumStates - 1)) and (theRowP[theNewIndex] <= theDraw))
+			theNewIndex++;
+	}
+	if (theNewIndex != theOldIndex)
+		theState = mCharStates[theNewIndex];
+}
+
+void RateMatrixCeScheme::makeJumpProbs ()
+//: work out the uniform jump rate & the cumulative jump probabilities
+// Each row of I + Q/rate is a distribution, stored as running sums so a
+// jump is one uniform draw.
+{
+	long theNumStates = (long) mCharStates.size();
+	std::vector<double> theRates (theNumStates * theNumStates, 0.0);
+	mJumpRate = 0.0;
+	for (long i = 0; i < theNumStates; i++)
 	{
-		disctrait_t theNewState = "";
-		long theNumStates = mCharStates.size();
-		while (theNewState == theOldState)
+		double theRowSum = 0.0;
+		for (long j = 0; j < theNumStates; j++)
 		{
-			long theChoice = MesaGlobals::mRng.UniformWhole (theNumStates);
-			theNewState = mCharStates[theChoice];
+			if (i != j)
+			{
+				double theRate = getRate (i, j);
+				assert (0.0 <= theRate);
+				theRates[(i * theNumStates) + j] = theRate;
+				theRowSum += theRate;
+			}
 		}
-
-		// referState (ioLeafIter) = theNewState;
-		setDiscData (ioLeafIter, mColIndex, theNewState);
+		mJumpRate = std::max (mJumpRate, theRowSum);
 	}
-	*/
 
-
-	iTime = iTime;
-	// disctrait_t theOldState = referState (ioLeafIter);
-	disctrait_t theOldState = getDiscData (ioLeafIter, mColIndex);
-	double theTimeToEvent = calcWaitFromRate (mProb);
-	if (mCharStates.isMember (theOldState) and (theTimeToEvent <= iTime))
+	mJumpCumProbs.assign (theNumStates * theNumStates, 0.0);
+	for (long i = 0; i < theNumStates; i++)
 	{
-		disctrait_t theNewState = theOldState;
-		long theNumStates = mCharStates.size();
-		while (theNewState == theOldState)
+		double theRowSum = 0.0;
+		for (long j = 0; j < theNumStates; j++)
+			theRowSum += theRates[(i * theNumStates) + j];
+		double theCumProb = 0.0;
+		for (long j = 0; j < theNumStates; j++)
 		{
-			long theChoice = MesaGlobals::mRng.UniformWhole (theNumStates);
-			theNewState = mCharStates[theChoice];
+			if (mJumpRate == 0.0)
+				theCumProb += (i == j) ? 1.0 : 0.0;
+			else if (i == j)
+				theCumProb += 1.0 - (theRowSum / mJumpRate);
+			else
+				theCumProb += theRates[(i * theNumStates) + j] / mJumpRate;
+			mJumpCumProbs[(i * theNumStates) + j] = theCumProb;
 		}
-
-		// referState (ioLeafIter) = theNewState;
-		setDiscData (ioLeafIter, mColIndex, theNewState);
 	}
 }
 
+
+// *** MARKOVIAN DISC
+
+double MarkovianCeScheme::getRate (long iFromIndex, long iToIndex)
+//: leave at the given rate for any other state equally
+{
+	iFromIndex = iFromIndex;
+	iToIndex = iToIndex; // just to shut compiler up
+	return mProb / double (mCharStates.size() - 1);
+}
+
 const char* MarkovianCeScheme::describe ()
 {
 	static std::string theMsg;
-	theMsg = "discrete markovian change scheme (p=";
+	theMsg = "discrete markovian change scheme (rate ";
 	theMsg.append (sbl::toString (mProb));
 	theMsg.append (")");
 	return theMsg.c_str();
@@ -154,32 +210,21 @@ const char* MarkovianCeScheme::describe ()
 
 // *** RANKED MARKOVIAN
 
-void RankedMarkovianCeScheme::evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime)
+double RankedMarkovianCeScheme::getRate (long iFromIndex, long iToIndex)
+//: rise or fall to the neighbouring states only
 {
-	iTime = iTime;
-	disctrait_t theOldState = referState (ioLeafIter);
-	if (mCharStates.isMember (theOldState))
-	{
-		float theProb = MesaGlobals::mRng.UniformFloat ();
-		if (theProb <= mProbRise)
-		{
-			referState (ioLeafIter) = *(mCharStates.nextState (theOldState.c_str()));
-		}
-		else if (theProb <= (mProbRise + mProbFall))
-		{
-			referState (ioLeafIter) = *(mCharStates.prevState (theOldState.c_str()));
-		}
-		else
-		{
-			// nothing happens
-		}
-	}
+	if (iToIndex == (iFromIndex + 1))
+		return mProbRise;
+	else if (iToIndex == (iFromIndex - 1))
+		return mProbFall;
+	else
+		return 0.0;
 }
 
 const char* RankedMarkovianCeScheme::describe ()
 {
 	static std::string theMsg;
-	theMsg = "discrete ranked markovian change scheme (p=";
+	theMsg = "discrete ranked markovian change scheme (rates ";
 	theMsg.append (sbl::toString (mProbFall));
 	theMsg.append (", ");
 	theMsg.append (sbl::toString (mProbRise));
@@ -271,6 +316,74 @@ void ContBrownianScheme::evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime)
 		referState (ioLeafIter) = theNewState;
 }
 
+void ContBrownianScheme::evolveCharsBatch (nodearr_t& ioLeaves, mesatime_t iTime)
+//: evolve every leaf at once, drawing all the normal deviates in one go
+// The bounds are treated as in evolveChars, a rejected state for
+// kEvolBound_Replace being redrawn singly.
+{
+	// Preconditions:
+	assert (0.0 <= iTime);
+	long theNumLeaves = (long) ioLeaves.size();
+	if (theNumLeaves == 0)
+		return;
+
+	// Main:
+	if (mIsPunct)
+		iTime = 1.0;
+	double theMean = mMean * iTime;
+	double theStdDev = mStdDev * std::sqrt (iTime);
+	mDeviates.resize (theNumLeaves);
+	MesaGlobals::mRng.FillStdNormal (&mDeviates[0], theNumLeaves);
+
+	for (long i = 0; i < theNumLeaves; i++)
+	{
+		nodeiter_t& theLeaf = ioLeaves[i];
+		conttrait_t theOldState = getContData (theLeaf, mColIndex);
+		conttrait_t theNewState = applyChange (theOldState,
+			theMean + (theStdDev * mDeviates[i]));
+
+		switch (mBoundsBehaviour)
+		{
+			case kEvolBound_Ignore:
+				break;
+
+			case kEvolBound_Truncate:
+				if (mRange.hasUpper() and (mRange.getUpper() < theNewState))
+					theNewState = mRange.getUpper();
+				if (mRange.hasLower() and (theNewState < mRange.getLower()))
+					theNewState = mRange.getLower();
+				break;
+
+			case kEvolBound_Replace:
+				while (not mRange.isWithin (theNewState))
+				{
+					theNewState = applyChange (theOldState,
+						theMean + (theStdDev * MesaGlobals::mRng.StdNormal()));
+				}
+				break;
+
+			default:
+				assert (false);
+		}
+
+		setContData (theLeaf, mColIndex, theNewState);
+		referState (theLeaf) = theNewState;
+	}
+}
+
+bool ContBrownianScheme::isLazy ()
+//: can the change over several intervals be drawn as one?
+// Brownian increments over consecutive intervals sum to a single normal
+// draw over the whole, but not if each step is clipped or redrawn at a
+// bound, or if the change is per event (punctuated) rather than per time.
+{
+	if (mIsPunct)
+		return false;
+	if (mBoundsBehaviour == kEvolBound_Ignore)
+		return true;
+	return (not mRange.hasUpper()) and (not mRange.hasLower());
+}
+
 conttrait_t ContBrownianScheme::proposeNewState (nodeiter_t& ioLeafIter, mesatime_t iTime)
 {
 	// get old state
@@ -280,7 +393,13 @@ conttrait_t ContBrownianScheme::proposeNewState (nodeiter_t& ioLeafIter, mesatim
 	// generate change
 	double theChange = MesaGlobals::mRng.gaussian (mMean * iTime, mStdDev * std::sqrt (iTime));
 	// generate & return putative new state
-	return (theOldState + theChange);
+	return applyChange (theOldState, theChange);
+}
+
+conttrait_t ContBrownianScheme::applyChange (conttrait_t iOldState, double iChange)
+//: the state reached by a given change from the old one
+{
+	return (iOldState + iChange);
 }
 
 const char* ContBrownianScheme::describe ()
@@ -303,17 +422,10 @@ void ContBrownianScheme::validate ()
 
 // *** LOG NORMAL
 
-conttrait_t ContLogNormalScheme::proposeNewState (nodeiter_t& ioLeafIter, mesatime_t iTime)
+conttrait_t ContLogNormalScheme::applyChange (conttrait_t iOldState, double iChange)
+//: the change is brownian on the log scale
 {
-	// get old state
-	conttrait_t theOldState = getContData (ioLeafIter, mColIndex);
-	if (mIsPunct)
-		iTime = 1.0;
-	// generate change
-	double theChange = MesaGlobals::mRng.gaussian (mMean * iTime, mStdDev * std::sqrt (iTime));
-	conttrait_t theNewState = std::exp (std::log (theOldState) + theChange);
-	// generate & return putative new state
-	return (theNewState);
+	return std::exp (std::log (iOldState) + iChange);
 }
 
 const char* ContLogNormalScheme::describe ()
@@ -329,6 +441,86 @@ const char* ContLogNormalScheme::describe ()
 
 
 
+// *** MULTIVARIATE BROWNIAN
+
+ContMultiBrownianScheme::ContMultiBrownianScheme (const std::vector<int>& iColIndices,
+	const std::vector<double>& iMeans, const std::vector<double>& iCovariances)
+	: TraitEvolScheme (iColIndices[0])
+	, mColIndices (iColIndices)
+	, mMeans (iMeans)
+{
+	long theNumCols = (long) mColIndices.size();
+	assert (1 < theNumCols);
+	assert ((long) mMeans.size() == theNumCols);
+	bool theIsFactored = choleskyFactor (iCovariances, theNumCols, mFactor);
+	assert (theIsFactored);
+	theIsFactored = theIsFactored; // just to shut compiler up
+}
+
+void ContMultiBrownianScheme::evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime)
+{
+	// Preconditions:
+	assert (0.0 <= iTime);
+	if (iTime == 0.0)
+		return;
+
+	// Main:
+	mDeviates.resize (mColIndices.size());
+	MesaGlobals::mRng.FillStdNormal (&mDeviates[0], (long) mDeviates.size());
+	applyChange (ioLeafIter, iTime, &mDeviates[0]);
+}
+
+void ContMultiBrownianScheme::evolveCharsBatch (nodearr_t& ioLeaves, mesatime_t iTime)
+//: evolve every leaf, drawing the deviates for all of them at once
+{
+	// Preconditions:
+	assert (0.0 <= iTime);
+	if ((iTime == 0.0) or ioLeaves.empty())
+		return;
+
+	// Main:
+	long theNumCols = (long) mColIndices.size();
+	long theNumLeaves = (long) ioLeaves.size();
+	mDeviates.resize (theNumLeaves * theNumCols);
+	MesaGlobals::mRng.FillStdNormal (&mDeviates[0], (long) mDeviates.size());
+	for (long i = 0; i < theNumLeaves; i++)
+		applyChange (ioLeaves[i], iTime, &mDeviates[i * theNumCols]);
+}
+
+void ContMultiBrownianScheme::applyChange (nodeiter_t& ioLeafIter, mesatime_t iTime,
+	const double* iDeviatesP)
+//: add the change over this time, given the deviates, to a leaf's traits
+{
+	long theNumCols = (long) mColIndices.size();
+	double theRootTime = std::sqrt (iTime);
+	// rows of the trait matrix are contiguous, so work on it directly
+	conttrait_t* theRowP = &referContState (ioLeafIter, 0);
+	const double* theFactorRowP = &mFactor[0];
+	for (long i = 0; i < theNumCols; i++, theFactorRowP += theNumCols)
+	{
+		double theSum = 0.0;
+		for (long j = 0; j <= i; j++)
+			theSum += theFactorRowP[j] * iDeviatesP[j];
+		theRowP[mColIndices[i]] += (mMeans[i] * iTime) + (theRootTime * theSum);
+	}
+}
+
+const char* ContMultiBrownianScheme::describe ()
+{
+	static std::string theMsg;
+	theMsg = "cont correlated brownian change scheme (traits ";
+	for (unsigned long i = 0; i < mColIndices.size(); i++)
+	{
+		if (i != 0)
+			theMsg.append (", ");
+		theMsg.append (sbl::toString (mColIndices[i] + 1));
+	}
+	theMsg.append (")");
+	return theMsg.c_str();
+}
+
+
+
 // *** SCHEME STORAGE
 // so the schemes within are disposed of automgaically
 
@@ -53,6 +53,9 @@ public:
 			ioLeafIter = ioLeafIter; // to shut compiler up
 			assert (false);
 		}	
+	virtual void evolveCharsBatch (nodearr_t& ioLeaves, mesatime_t iTime);
+	virtual bool isLazy ()
+		{ return false; }
 	// int& referColIndex ();
 	virtual const char* describe ();
 	
@@ -89,43 +92,66 @@ public:
 };
 
 
-class MarkovianCeScheme: public DiscCeScheme
+class RateMatrixCeScheme: public DiscCeScheme
+//: continuous-time change between states, as given by a rate matrix
+// The state at the end of an interval is drawn exactly by uniformization:
+// a Poisson number of jumps at the fastest rate of leaving any state, each
+// taken by the matrix of jump probabilities I + Q/rate. That matrix is
+// worked out once, so an interval costs nothing beyond its jumps.
+{
+public:
+	RateMatrixCeScheme (int iColIndex, CharStateSet iStateSet)
+		: DiscCeScheme (iColIndex, iStateSet)
+		, mJumpRate (0.0)
+		{}
+
+	void evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	bool isLazy ()
+		{ return true; }
+
+	virtual double   getRate (long iFromIndex, long iToIndex) = 0;
+
+private:
+	void   makeJumpProbs ();
+
+	double                mJumpRate;
+	std::vector<double>   mJumpCumProbs;
+};
+
+
+class MarkovianCeScheme: public RateMatrixCeScheme
 //: an equal chance of going to any other possible state
 {
 public:
 	MarkovianCeScheme (int iColIndex, CharStateSet iStateSet, float iProb)
-		: DiscCeScheme (iColIndex, iStateSet)
+		: RateMatrixCeScheme (iColIndex, iStateSet)
 		, mProb (iProb)
 	{
 		assert (0.0 < mProb);
-		assert (mProb <= 1.0);
 	}
 
-	void evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	double getRate (long iFromIndex, long iToIndex);
 	const char* describe ();
 			
 	float mProb;
 };
 
 
-class RankedMarkovianCeScheme: public DiscCeScheme
-//: an equal chance of going to any other possible state
+class RankedMarkovianCeScheme: public RateMatrixCeScheme
+//: change only to the next state up or down
 {
 public:
 	RankedMarkovianCeScheme
 		(int iColIndex, CharStateSet iStateSet, float iProbFall, float iProbRise)
-		: DiscCeScheme (iColIndex, iStateSet)
+		: RateMatrixCeScheme (iColIndex, iStateSet)
 		, mProbRise (iProbRise)
 		, mProbFall (iProbFall)
 	{
-		assert (0.0 < iProbRise);
-		assert (iProbRise < 1.0);
-		assert (0.0 < iProbFall);
-		assert (iProbFall < 1.0);
-		assert ((iProbRise + iProbFall) <= 1.0);
+		assert (0.0 <= iProbRise);
+		assert (0.0 <= iProbFall);
 	}
 
-	void evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	double getRate (long iFromIndex, long iToIndex);
 	const char* describe ();
 		
 	float mProbRise, mProbFall;
@@ -185,7 +211,10 @@ public:
 		{ validate (); }
 					
 	void evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	void evolveCharsBatch (nodearr_t& ioLeaves, mesatime_t iTime);
+	bool isLazy ();
 	virtual conttrait_t proposeNewState (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	virtual conttrait_t applyChange (conttrait_t iOldState, double iChange);
 	const char* describe ();
 	void validate ();
 	
@@ -194,6 +223,9 @@ public:
 	bool              mIsPunct;
 	contcharrange_t   mRange;
 	evolbound_t       mBoundsBehaviour;
+
+private:
+	std::vector<double>   mDeviates;
 };
 
 
@@ -208,10 +240,37 @@ public:
 		: ContBrownianScheme (iColIndex, iMean, iStdDev, iIsPunct, iRange, iBoundsBehaviour)
 		{ validate (); }
 					
-	virtual conttrait_t    proposeNewState (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	virtual conttrait_t    applyChange (conttrait_t iOldState, double iChange);
 	virtual const char*   describe ();
 };
 
+
+class ContMultiBrownianScheme: public TraitEvolScheme
+//: correlated brownian change across a block of continuous traits
+// The covariance matrix (per unit time) is factored once, so a change is
+// the means plus the factor times a vector of standard normal deviates.
+{
+public:
+	ContMultiBrownianScheme (const std::vector<int>& iColIndices,
+		const std::vector<double>& iMeans, const std::vector<double>& iCovariances);
+
+	void evolveChars (nodeiter_t& ioLeafIter, mesatime_t iTime);
+	void evolveCharsBatch (nodearr_t& ioLeaves, mesatime_t iTime);
+	bool isLazy ()
+		{ return true; }
+	const char* describe ();
+
+	std::vector<int>      mColIndices;
+	std::vector<double>   mMeans;
+	std::vector<double>   mFactor;   // lower triangular, row by row
+
+private:
+	std::vector<double>   mDeviates;
+
+	void applyChange (nodeiter_t& ioLeafIter, mesatime_t iTime,
+		const double* iDeviatesP);
+};
+
 					
 					
 // *** SCHEME STORAGE
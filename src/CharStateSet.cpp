@@ -38,10 +38,11 @@ bool CharStateSet::isMember (const char* iSearchCStr)
 	return (find (iSearchCStr) != end());
 }
 
-bool CharStateSet::isMember (std::string& iSearchStr)
+bool CharStateSet::isMember (const disctrait_t& iSearchState)
 //: is this state a member of the set?
+// States are interned, so this compares codes rather than strings.
 {
-	return (isMember (iSearchStr.c_str()));
+	return (std::find (begin(), end(), iSearchState) != end());
 }
 
 iterator CharStateSet::find (const char* iSearchCStr)
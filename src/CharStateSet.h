@@ -38,7 +38,7 @@ public:
 	
 	// ACCESS
 	bool          isMember (const char* iSearchCStr);
-	bool          isMember (disctrait_t& iSearchStr);
+	bool          isMember (const disctrait_t& iSearchState);
 	iterator      find (const char* iSearchCStr);
 	iterator      nextState (const char* iStateCStr);
 	iterator      prevState (const char* iStateCStr);
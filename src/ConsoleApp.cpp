@@ -827,7 +827,7 @@ int ConsoleApp::askChoice (const char *iPromptCstr, char *iChoiceCstr, char iDef
 }
 */
 
-int ConsoleApp::askChoice (const char *iPromptCstr, char *iChoiceCstr, int iDefChoice)
+int ConsoleApp::askChoice (const char *iPromptCstr, const char *iChoiceCstr, int iDefChoice)
 //: ask the user to choose one of the chars in the string and returns it's index
 // A simplification of askMultiChoice().
 {
@@ -128,7 +128,7 @@ public:
 	bool			askYesNo (const char* iPromptCStr, bool iCurrentState);
 	bool			askEitherOr (const char *iPrompt, char iChoice1, char iChoice2);
 
-	int			askChoice (const char *iPrompt, char *iChoiceStr, int iCurrChoice = -1);
+	int			askChoice (const char *iPrompt, const char *iChoiceStr, int iCurrChoice = -1);
 //@}
 
 /// @name DEPRECATED & DEBUG
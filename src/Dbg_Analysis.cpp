@@ -0,0 +1,353 @@
+/**************************************************************************
+Dbg_Analysis.cpp - test harness for the analyses of trees
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <http://www.agapow.net/software/mesa>
+
+About:
+- Checks that what the analyses work out from a snapshot of a tree is
+  what walking the tree itself gives, that the distances written out
+  read back as they should, & that analyses sharing a pass over the tree
+  report as if run one by one.
+- Built & run by "make check", in place of main.cpp.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#ifdef MESA_DBG_CHECK
+
+#include "Dbg_Check.h"
+#include "ActionUtils.h"
+#include "Analysis.h"
+#include "Macro.h"
+#include "MesaGlobals.h"
+#include "MesaTree.h"
+#include "MesaUtils.h"
+#include "TreeSnapshot.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+
+// *** TEST FUNCTIONS ****************************************************/
+
+static void growTree (long iNumLeaves)
+//: grow the active tree to this many living leaves, killing some on the way
+// So the branches differ in length & some leaves are dead.
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	for (long i = 0; long (theTreeP->countAliveLeaves ()) < iNumLeaves; i++)
+	{
+		speciate (theTreeP->getLiveLeaf ((i * 7) % theTreeP->countAliveLeaves ()));
+		theTreeP->ageAllLeaves (0.05 * (1 + (i % 3)));
+		if ((i % 5 == 4) and (2 < theTreeP->countAliveLeaves ()))
+		{
+			nodeiter_t theLeaf = theTreeP->getLiveLeaf (i % theTreeP->countAliveLeaves ());
+			theTreeP->killLeaf (theLeaf);
+		}
+	}
+}
+
+
+static nodeiter_t walkCommonAncestor (MesaTree* iTreeP, nodeiter_t iNodeA,
+	nodeiter_t iNodeB)
+//: the most recent common ancestor of two nodes, by walking to the root
+{
+	vector<nodeiter_t> theLineage (1, iNodeA);
+	while (not iTreeP->isRoot (theLineage.back()))
+		theLineage.push_back (iTreeP->getParent (theLineage.back()));
+	while (std::find (theLineage.begin(), theLineage.end(), iNodeB) == theLineage.end())
+		iNodeB = iTreeP->getParent (iNodeB);
+	return iNodeB;
+}
+
+
+static long walkSteps (MesaTree* iTreeP, nodeiter_t iNode, nodeiter_t iAncestor)
+//: the number of branches from a node up to its ancestor, by walking
+{
+	long theSteps = 0;
+	for (; iNode != iAncestor; theSteps++)
+		iNode = iTreeP->getParent (iNode);
+	return theSteps;
+}
+
+
+static void testSnapshotAncestry ()
+//: ancestry & distances from a snapshot must be as walking the tree gives
+// Over every pair of nodes, living & dead, including a node with itself.
+{
+	DbgModel theModel;
+	growTree (60);
+	MesaTree* theTreeP = getActiveTreeP ();
+	TreeSnapshot theSnap (*theTreeP);
+
+	bool theIsAncestryOk = true, theIsMrcaOk = true;
+	bool theIsTimeOk = true, theIsStepsOk = true;
+	for (TreeSnapshot::size_type i = 0; i < theSnap.countNodes(); i++)
+	{
+		nodeiter_t theNodeA = theSnap.getIter (i);
+		theIsTimeOk = theIsTimeOk and (std::fabs (theSnap.getTimeFromNodeToRoot (i) -
+			theTreeP->getTimeFromNodeToRoot (theNodeA)) < 1.0e-9);
+		for (TreeSnapshot::size_type j = 0; j < theSnap.countNodes(); j++)
+		{
+			nodeiter_t theNodeB = theSnap.getIter (j);
+			theIsAncestryOk = theIsAncestryOk and
+				(theSnap.isAncestorOf (i, j) == theTreeP->isAncestorOf (theNodeA, theNodeB));
+
+			nodeiter_t theMrca = walkCommonAncestor (theTreeP, theNodeA, theNodeB);
+			theIsMrcaOk = theIsMrcaOk and
+				(theSnap.getIter (theSnap.getCommonAncestor (i, j)) == theMrca);
+
+			double theTime = theTreeP->getTimeFromNodeToAncestor (theNodeA, theMrca) +
+				theTreeP->getTimeFromNodeToAncestor (theNodeB, theMrca);
+			theIsTimeOk = theIsTimeOk and
+				(std::fabs (theSnap.getTimeBetweenNodes (i, j) - theTime) < 1.0e-9);
+
+			long theSteps = walkSteps (theTreeP, theNodeA, theMrca) +
+				walkSteps (theTreeP, theNodeB, theMrca);
+			theIsStepsOk = theIsStepsOk and
+				(long (theSnap.getStepsBetweenNodes (i, j)) == theSteps);
+		}
+	}
+	check (0 < theTreeP->countLeaves () - theTreeP->countAliveLeaves (),
+		"snapshot tree has dead leaves");
+	check (theIsAncestryOk, "snapshot ancestry as walked");
+	check (theIsMrcaOk, "snapshot common ancestors as walked");
+	check (theIsTimeOk, "snapshot patristic distances as walked");
+	check (theIsStepsOk, "snapshot steps between nodes as walked");
+}
+
+
+typedef std::map<string, nodeiter_t>   leafnames_t;
+
+static void nameLeaves (MesaTree* iTreeP, leafnames_t& oLeaves)
+//: index the leaves of the tree by name
+{
+	vector<nodeiter_t> theLeaves;
+	iTreeP->getLeaves (theLeaves);
+	for (vector<nodeiter_t>::size_type i = 0; i < theLeaves.size(); i++)
+		oLeaves[iTreeP->getNodeName (theLeaves[i])] = theLeaves[i];
+}
+
+
+static bool isDistanceRight (MesaTree* iTreeP, leafnames_t& iLeaves,
+	const string& iNameA, const string& iNameB, double iDist)
+//: is this the distance between the named leaves, walking the tree?
+// To a part in 10^5, as the Nexus file is written to 6 figures.
+{
+	if ((iLeaves.count (iNameA) == 0) or (iLeaves.count (iNameB) == 0))
+		return false;
+	nodeiter_t theLeafA = iLeaves[iNameA];
+	nodeiter_t theLeafB = iLeaves[iNameB];
+	nodeiter_t theMrca = walkCommonAncestor (iTreeP, theLeafA, theLeafB);
+	double theDist = iTreeP->getTimeFromNodeToAncestor (theLeafA, theMrca) +
+		iTreeP->getTimeFromNodeToAncestor (theLeafB, theMrca);
+	return (std::fabs (iDist - theDist) <= 1.0e-5 * std::max (1.0, theDist));
+}
+
+
+static bool readBinaryDistances (const char* iPathCstr, MesaTree* iTreeP,
+	leafnames_t& iLeaves)
+//: does the binary file hold every leaf & the right distances between them?
+{
+	std::ifstream theInFile (iPathCstr, std::ios::in | std::ios::binary);
+	char theTag[8];
+	unsigned int theCount = 0;
+	theInFile.read (theTag, 8);
+	theInFile.read ((char*) &theCount, 4);
+	if ((not theInFile) or (std::strncmp (theTag, "MESADIST", 8) != 0) or
+		(theCount != iLeaves.size()))
+		return false;
+
+	vector<string> theNames (theCount);
+	for (unsigned int i = 0; i < theCount; i++)
+		std::getline (theInFile, theNames[i], '\0');
+	bool theIsOk = true;
+	for (unsigned int i = 1; i < theCount; i++)
+	{
+		for (unsigned int j = 0; j < i; j++)
+		{
+			double theDist = -1.0;
+			theInFile.read ((char*) &theDist, sizeof (theDist));
+			theIsOk = theIsOk and
+				isDistanceRight (iTreeP, iLeaves, theNames[i], theNames[j], theDist);
+		}
+	}
+	theInFile.get ();
+	return theIsOk and theInFile.eof ();
+}
+
+
+static bool readNexusDistances (const char* iPathCstr, MesaTree* iTreeP,
+	leafnames_t& iLeaves)
+//: does the Nexus file hold every leaf & the right distances between them?
+{
+	std::ifstream theInFile (iPathCstr);
+	string theLine;
+	while (std::getline (theInFile, theLine) and (theLine != "\tMATRIX"))
+		;
+	vector<string> theNames;
+	bool theIsOk = true;
+	while (std::getline (theInFile, theLine) and (theLine != "\t;"))
+	{
+		// the name, the distances to the leaves before & the diagonal
+		vector<string> theFields;
+		string::size_type theStart = theLine.find_first_not_of ('\t');
+		while (theStart != string::npos)
+		{
+			string::size_type theStop = theLine.find ('\t', theStart);
+			theFields.push_back (theLine.substr (theStart, theStop - theStart));
+			theStart = (theStop == string::npos) ? theStop : theStop + 1;
+		}
+		string theName = theFields.empty() ? string() : theFields[0];
+		if ((1 < theName.size()) and (theName[0] == '\''))
+			theName = theName.substr (1, theName.size() - 2);
+		if (theFields.size() != theNames.size() + 2)
+			return false;
+		for (vector<string>::size_type j = 0; j < theNames.size(); j++)
+			theIsOk = theIsOk and isDistanceRight (iTreeP, iLeaves, theName,
+				theNames[j], std::atof (theFields[j + 1].c_str()));
+		theIsOk = theIsOk and (std::atof (theFields.back().c_str()) == 0.0);
+		theNames.push_back (theName);
+	}
+	std::sort (theNames.begin(), theNames.end());
+	return theIsOk and (theNames.size() == iLeaves.size()) and
+		(std::unique (theNames.begin(), theNames.end()) == theNames.end());
+}
+
+
+static void testDistanceWriter ()
+//: the distances written out must be those between the leaves of the tree
+// Read back from both the binary & the Nexus files.
+{
+	DbgModel theModel;
+	growTree (40);
+	MesaTree* theTreeP = getActiveTreeP ();
+	leafnames_t theLeaves;
+	nameLeaves (theTreeP, theLeaves);
+
+	PatristicDistanceAnalysis theBinary ("Dbg_Dist", true);
+	string theReport = reportAction (&theBinary);
+	check (readBinaryDistances ("Dbg_Dist1.dist", theTreeP, theLeaves),
+		"binary distances read back as walked");
+	check (theReport.find ("tips\t" + concatIntToString ("", theLeaves.size())) !=
+		string::npos, "distances report the number of tips");
+	std::remove ("Dbg_Dist1.dist");
+
+	PatristicDistanceAnalysis theNexus ("Dbg_Dist", false);
+	reportAction (&theNexus);
+	check (readNexusDistances ("Dbg_Dist1.nex", theTreeP, theLeaves),
+		"Nexus distances read back as walked");
+	std::remove ("Dbg_Dist1.nex");
+}
+
+
+static const long kNumPassAnalyses = 10;
+
+static BasicAnalysis* makePassAnalysis (long iIndex)
+//: a new one of the analyses that can share a pass over the tree
+{
+	switch (iIndex)
+	{
+		case 0: return new GeneticDiversityAnalysis;
+		case 1: return new PhyloDiversityAnalysis;
+		case 2: return new ShaosNbarAnalysis;
+		case 3: return new ShaosSigmaSqAnalysis;
+		case 4: return new CollessCAnalysis;
+		case 5: return new B1Analysis;
+		case 6: return new B2Analysis;
+		case 7: return new StemminessAnalysis;
+		case 8: return new ResolutionAnalysis;
+		default: return new UltrametricAnalysis;
+	}
+}
+
+
+static string reportFused (long iBreakAt)
+//: report every pass analysis from one macro, so they share passes
+// With some other analysis between those before & after the break.
+{
+	RunOnceMacro theMacro;
+	for (long i = 0; i < kNumPassAnalyses; i++)
+	{
+		if (i == iBreakAt)
+			theMacro.adoptAction (new TreeInfoAnalysis (true, true, true, false, true));
+		theMacro.adoptAction (makePassAnalysis (i));
+	}
+	return reportAction (&theMacro);
+}
+
+
+static string reportSingly (long iBreakAt)
+//: report every pass analysis as reportFused does, but each from its own macro
+{
+	string theReport;
+	for (long i = 0; i < kNumPassAnalyses; i++)
+	{
+		RunOnceMacro theMacro;
+		if (i == iBreakAt)
+			theMacro.adoptAction (new TreeInfoAnalysis (true, true, true, false, true));
+		theMacro.adoptAction (makePassAnalysis (i));
+		theReport += reportAction (&theMacro);
+	}
+	return theReport;
+}
+
+
+static void testSharedPass ()
+//: analyses sharing a pass over the tree must report as if run one by one
+// Whether or not the tree keeps its subtree totals, & after it changes.
+{
+	DbgModel theModel;
+	growTree (50);
+	MesaTree* theTreeP = getActiveTreeP ();
+	string theFused = reportFused (kNumPassAnalyses);
+	check (not theFused.empty(), "shared pass reports");
+	check (theFused == reportSingly (kNumPassAnalyses),
+		"shared pass reports as analyses run singly");
+	check (reportFused (4) == reportSingly (4),
+		"shared passes either side of another analysis report as run singly");
+
+	bool theSavedKeep = MesaGlobals::mPrefs.mKeepSubtreeTotals;
+	MesaGlobals::mPrefs.mKeepSubtreeTotals = true;
+	check (reportFused (kNumPassAnalyses) == theFused,
+		"shared pass reports the same with subtree totals kept");
+	speciate (theTreeP->getLiveLeaf (0));
+	nodeiter_t theLeaf = theTreeP->getLiveLeaf (1);
+	theTreeP->killLeaf (theLeaf);
+	theTreeP->ageAllLeaves (0.5);
+	string theChanged = reportFused (kNumPassAnalyses);
+	check ((theChanged != theFused) and
+		(theChanged == reportSingly (kNumPassAnalyses)),
+		"shared pass after the tree changes reports as run singly");
+	MesaGlobals::mPrefs.mKeepSubtreeTotals = theSavedKeep;
+}
+
+
+// *** MAIN BODY *********************************************************/
+
+int main ()
+{
+	testSnapshotAncestry ();
+	testDistanceWriter ();
+	testSharedPass ();
+	return (gNumFailures == 0) ? 0 : 1;
+}
+
+
+#endif
+// *** END ***************************************************************/
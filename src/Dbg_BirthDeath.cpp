@@ -0,0 +1,247 @@
+/**************************************************************************
+Dbg_BirthDeath.cpp - test harness for the engines that grow trees
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <http://www.agapow.net/software/mesa>
+
+About:
+- Checks that the engines that take shortcuts through an epoch grow trees
+  like those grown event by event, over many replicates from a fixed seed,
+  and that the trees they grow are whole.
+- Built & run by "make check", in place of main.cpp.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#ifdef MESA_DBG_CHECK
+
+#include "Dbg_Check.h"
+#include "ActionUtils.h"
+#include "Epoch.h"
+#include "EvolRule.h"
+#include "MesaGlobals.h"
+#include "MesaTree.h"
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+using std::string;
+using std::vector;
+
+
+// *** CONSTANTS & DEFINES
+
+static const long kNumReps = 4000;
+static const long kNumCladeReps = 50;
+
+
+// *** TEST FUNCTIONS ****************************************************/
+
+struct TreeMeans
+//: what the trees grown by an epoch come to on average
+{
+	double	mAlive;
+	double	mTips;
+	double	mLength;   // the summed lengths of the branches
+};
+
+
+static bool isTreeWhole (MesaTree* iTreeP, double iMinAge, long iNumAlive)
+//: are the branches of a grown tree sensible and do the living reach the end?
+// Every branch must have a length, and the living leaves all be as far
+// from the root and further than the dead, at no less than the given age.
+// A count of living leaves, if given, must be met by a tree not dead.
+{
+	double theLiveDist = -1.0;
+	double theDeadDist = 0.0;
+	for (nodeiter_t q = iTreeP->begin(); q != iTreeP->end(); q++)
+	{
+		if (iTreeP->getEdgeWeight (q) < 0.0)
+			return false;
+		if (not iTreeP->isLeaf (q))
+			continue;
+		double theDist = iTreeP->getTimeFromNodeToRoot (q);
+		if (not iTreeP->isNodeAlive (q))
+			theDeadDist = std::max (theDeadDist, theDist);
+		else if (theLiveDist < 0.0)
+			theLiveDist = theDist;
+		else if (1.0e-9 < std::fabs (theDist - theLiveDist))
+			return false;
+	}
+	if (theLiveDist < 0.0)
+		return true;
+	bool theIsWhole = (theDeadDist <= theLiveDist + 1.0e-9) and
+		(iMinAge <= theLiveDist + iTreeP->getEdgeWeight (iTreeP->getRoot ()));
+	if (0 < iNumAlive)
+		theIsWhole = theIsWhole and (long (iTreeP->countAliveLeaves ()) == iNumAlive);
+	return theIsWhole;
+}
+
+
+static bool growReplicates (EpochMacro& iEpoch, long iNumReps, double iMinAge,
+	long iNumAlive, TreeMeans& oMeans)
+//: run the epoch many times from the tree as it is, & average the trees
+// Returns whether every tree was whole (see isTreeWhole).
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	bool theIsWhole = true;
+	oMeans.mAlive = oMeans.mTips = oMeans.mLength = 0.0;
+	MesaTree::UndoMark theMark = theTreeP->markUndo ();
+	for (long i = 0; i < iNumReps; i++)
+	{
+		iEpoch.execute ();
+		oMeans.mAlive += double (theTreeP->countAliveLeaves ()) / iNumReps;
+		oMeans.mTips += double (theTreeP->countLeaves ()) / iNumReps;
+		double theLength = 0.0;
+		for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+			theLength += theTreeP->getEdgeWeight (q);
+		oMeans.mLength += theLength / iNumReps;
+		theIsWhole = theIsWhole and isTreeWhole (theTreeP, iMinAge, iNumAlive);
+		theTreeP->rollbackUndo (theMark);
+	}
+	theTreeP->releaseUndo (theMark);
+	return theIsWhole;
+}
+
+
+static bool areMeansClose (TreeMeans& iMeansA, TreeMeans& iMeansB, double iTolerance)
+//: do these averages agree to within this fraction?
+{
+	return (std::fabs (iMeansA.mAlive - iMeansB.mAlive) <= iTolerance * iMeansA.mAlive) and
+		(std::fabs (iMeansA.mTips - iMeansB.mTips) <= iTolerance * iMeansA.mTips) and
+		(std::fabs (iMeansA.mLength - iMeansB.mLength) <= iTolerance * iMeansA.mLength);
+}
+
+
+static void testDrawnBirthDeath ()
+//: plain birth-death epochs drawn whole must grow trees as those stepped
+{
+	DbgModel theModel;
+	MesaGlobals::mRng.SetSeed (1234);
+	TreeMeans theStepped, theDrawn;
+
+	// to a time limit, led in from a single leaf
+	EpochTimeLimit theTimeEpoch (2.5, false);
+	theTimeEpoch.adoptAction (new MarkovSpRule (1.0));
+	theTimeEpoch.adoptAction (new MarkovKillRule (0.3));
+	growReplicates (theTimeEpoch, kNumReps, 2.5, 0, theStepped);
+	theTimeEpoch.setEngine (kEpochEngine_Direct);
+	check (growReplicates (theTimeEpoch, kNumReps, 2.5, 0, theDrawn),
+		"birth-death drawn to a time limit is whole");
+	check (areMeansClose (theStepped, theDrawn, 0.1),
+		"birth-death drawn to a time limit is as stepped");
+
+	// to a count of living leaves, drawn all together
+	EpochPopLimit thePopEpoch (20, false, kNodetype_Living, false);
+	thePopEpoch.adoptAction (new MarkovSpRule (1.0));
+	thePopEpoch.adoptAction (new MarkovKillRule (0.3));
+	growReplicates (thePopEpoch, kNumReps, 0.0, 20, theStepped);
+	thePopEpoch.setEngine (kEpochEngine_Direct);
+	check (growReplicates (thePopEpoch, kNumReps, 0.0, 20, theDrawn),
+		"birth-death drawn to a count is whole");
+	check (areMeansClose (theStepped, theDrawn, 0.05),
+		"birth-death drawn to a count is as stepped");
+}
+
+
+static void testCladeBirthDeath ()
+//: timed epochs from enough leaves to grow apart must grow as stepped
+{
+	DbgModel theModel;
+	MesaGlobals::mRng.SetSeed (1234);
+	MesaTree* theTreeP = getActiveTreeP ();
+	while (theTreeP->countAliveLeaves () < 300)
+		speciate (theTreeP->getLiveLeaf (0));
+	TreeMeans theStepped, theDrawn;
+	
+	EpochTimeLimit theEpoch (0.5, false);
+	theEpoch.adoptAction (new MarkovSpRule (1.0));
+	theEpoch.adoptAction (new MarkovKillRule (0.3));
+	growReplicates (theEpoch, kNumCladeReps, 0.5, 0, theStepped);
+	theEpoch.setEngine (kEpochEngine_Direct);
+	check (growReplicates (theEpoch, kNumCladeReps, 0.5, 0, theDrawn),
+		"birth-death grown clade by clade is whole");
+	check (areMeansClose (theStepped, theDrawn, 0.02),
+		"birth-death grown clade by clade is as stepped");
+}
+
+
+static double readErrorBound (const string& iReport)
+//: the error bound that tau-leaping reported, or -1 if none
+{
+	const string kTitle ("tau-leaping error bound\t");
+	string::size_type thePos = iReport.find (kTitle);
+	if (thePos == string::npos)
+		return -1.0;
+	return std::atof (iReport.c_str() + thePos + kTitle.size());
+}
+
+
+static void testTauLeap ()
+//: tau-leaping must grow trees as those stepped, within the bound it reports
+// The bound is the largest relative change in the rates over any leap,
+// which for plain birth-death is that in the number alive, so should
+// follow the tolerance the leaps are chosen by.
+{
+	DbgModel theModel;
+	MesaGlobals::mRng.SetSeed (1234);
+	MesaTree* theTreeP = getActiveTreeP ();
+	while (theTreeP->countAliveLeaves () < 300)
+		speciate (theTreeP->getLiveLeaf (0));
+	TreeMeans theStepped, theLeapt;
+	
+	EpochTimeLimit theEpoch (1.0, false);
+	theEpoch.adoptAction (new MarkovSpRule (1.0));
+	theEpoch.adoptAction (new MarkovKillRule (0.3));
+	
+	// the bound at two tolerances
+	theEpoch.setEngine (kEpochEngine_TauLeap);
+	MesaTree::UndoMark theMark = theTreeP->markUndo ();
+	theEpoch.setTauTolerance (0.1);
+	double theCoarseBound = readErrorBound (reportAction (&theEpoch));
+	theTreeP->rollbackUndo (theMark);
+	theEpoch.setTauTolerance (0.02);
+	double theFineBound = readErrorBound (reportAction (&theEpoch));
+	theTreeP->rollbackUndo (theMark);
+	theTreeP->releaseUndo (theMark);
+	check ((0.0 < theFineBound) and (theFineBound < theCoarseBound),
+		"tau-leaping error bound follows the tolerance");
+	check ((theCoarseBound <= 3 * 0.1) and (theFineBound <= 3 * 0.02),
+		"tau-leaping error bound is near the tolerance");
+	
+	// the trees, reporting to nowhere
+	pref_analysisout_t theSavedOut = MesaGlobals::mPrefs.mAnalysisOut;
+	MesaGlobals::mPrefs.mAnalysisOut = kPrefAnalysisOut_AllFile;
+	progcallback_t theNoCb;
+	Reporter theReporter (theNoCb);
+	MesaGlobals::mReporterP = &theReporter;
+	theEpoch.setEngine (kEpochEngine_Classic);
+	growReplicates (theEpoch, kNumCladeReps, 1.0, 0, theStepped);
+	theEpoch.setEngine (kEpochEngine_TauLeap);
+	check (growReplicates (theEpoch, kNumCladeReps, 1.0, 0, theLeapt),
+		"birth-death tau-leapt is whole");
+	check (areMeansClose (theStepped, theLeapt, 0.03),
+		"birth-death tau-leapt is as stepped");
+	MesaGlobals::mReporterP = NULL;
+	MesaGlobals::mPrefs.mAnalysisOut = theSavedOut;
+}
+
+
+// *** MAIN BODY *********************************************************/
+
+int main ()
+{
+	testDrawnBirthDeath ();
+	testCladeBirthDeath ();
+	testTauLeap ();
+	return (gNumFailures == 0) ? 0 : 1;
+}
+
+
+#endif
+// *** END ***************************************************************/
@@ -0,0 +1,100 @@
+/**************************************************************************
+Dbg_Check.h - what the test harnesses run by "make check" share
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <http://www.agapow.net/software/mesa>
+
+About:
+- Each harness is built with MESA_DBG_CHECK defined, in place of main.cpp,
+  and includes this once.
+
+**************************************************************************/
+
+#pragma once
+#ifndef DBG_CHECK_H
+#define DBG_CHECK_H
+
+
+// *** INCLUDES
+
+#include "Action.h"
+#include "MesaGlobals.h"
+#include "Reporter.h"
+#include "TaxaTraitMatrix.h"
+#include "TreeWrangler.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+
+// *** TEST FUNCTIONS ****************************************************/
+
+static int gNumFailures = 0;
+
+static void check (bool iIsOk, const char* iDescCstr)
+{
+	std::cout << (iIsOk ? "ok: " : "FAILED: ") << iDescCstr << std::endl;
+	if (not iIsOk)
+		gNumFailures++;
+}
+
+
+class DbgModel
+//: a tree & trait data that stand in as the globals while a check runs
+{
+public:
+	DbgModel ()
+	{
+		MesaGlobals::mTreeDataP = &mTrees;
+		MesaGlobals::mContDataP = &mContData;
+		MesaGlobals::mDiscDataP = &mDiscData;
+		mTrees.seedTree ();
+	}
+	~DbgModel ()
+	{
+		MesaGlobals::mTreeDataP = NULL;
+		MesaGlobals::mContDataP = NULL;
+		MesaGlobals::mDiscDataP = NULL;
+	}
+
+	TreeWrangler		mTrees;
+	ContTraitMatrix	mContData;
+	DiscTraitMatrix	mDiscData;
+};
+
+
+static std::string reportAction (BasicAction* iActionP)
+//: run an action & return what it reported to the results file
+{
+	const char* kOutPath = "Dbg_Check.out";
+	pref_analysisout_t theSavedOut = MesaGlobals::mPrefs.mAnalysisOut;
+	MesaGlobals::mPrefs.mAnalysisOut = kPrefAnalysisOut_AllFile;
+	progcallback_t theNoCb;
+	std::ofstream theOutStream (kOutPath);
+	Reporter theReporter (theNoCb);
+	theReporter.setFileStream (&theOutStream);
+	MesaGlobals::mReporterP = &theReporter;
+
+	iActionP->execute ();
+
+	theReporter.setFileStream (NULL);
+	theOutStream.close ();
+	MesaGlobals::mReporterP = NULL;
+	MesaGlobals::mPrefs.mAnalysisOut = theSavedOut;
+
+	std::ifstream theInStream (kOutPath);
+	std::stringstream theBuffer;
+	theBuffer << theInStream.rdbuf();
+	theInStream.close ();
+	std::remove (kOutPath);
+	return theBuffer.str();
+}
+
+
+#endif
+// *** END ***************************************************************/
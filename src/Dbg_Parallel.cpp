@@ -0,0 +1,140 @@
+/**************************************************************************
+Dbg_Parallel.cpp - test harness for work farmed out to other processes
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <http://www.agapow.net/software/mesa>
+
+About:
+- Checks that what is run in parallel reports just what it would have
+  if run in this process, given the same seed.
+- Built & run by "make check", in place of main.cpp.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#ifdef MESA_DBG_CHECK
+
+#include "Dbg_Check.h"
+#include "ActionUtils.h"
+#include "Analysis.h"
+#include "CharEvolRule.h"
+#include "CharEvolScheme.h"
+#include "Epoch.h"
+#include "EvolRule.h"
+#include "Macro.h"
+#include "MesaGlobals.h"
+#include "MesaTree.h"
+#include <string>
+
+using std::string;
+
+
+// *** TEST FUNCTIONS ****************************************************/
+
+static string runReplicates (BasicMacro* iMacroP, int iNumWorkers)
+//: run a run & restore from a fixed seed with this many processes
+{
+	MesaGlobals::mPrefs.mNumWorkers = iNumWorkers;
+	MesaGlobals::mRng.SetSeed (1234);
+	string theReport = reportAction (iMacroP);
+	MesaGlobals::mPrefs.mNumWorkers = 1;
+	return theReport;
+}
+
+
+static void addReplicateAnalyses (BasicMacro* iMacroP)
+//: report on each replicate in ways that don't depend on the names made
+{
+	iMacroP->adoptAction (new TreeInfoAnalysis (true, true, true, false, true));
+	iMacroP->adoptAction (new PhyloDiversityAnalysis);
+}
+
+
+static void testParallelReplicates ()
+//: replicates run in parallel must report as those run serially
+{
+	DbgModel theModel;
+
+	// a plain birth-death epoch, whose replicates are batched when serial
+	RunAndRestoreMacro theBdMacro (6);
+	EpochMacro* theEpochP = new EpochPopLimit (25, false, kNodetype_Living, false);
+	theEpochP->setEngine (kEpochEngine_Direct);
+	theEpochP->adoptAction (new MarkovSpRule (1.0));
+	theEpochP->adoptAction (new MarkovKillRule (0.3));
+	theBdMacro.adoptAction (theEpochP);
+	addReplicateAnalyses (&theBdMacro);
+
+	string theSerial = runReplicates (&theBdMacro, 1);
+	check (not theSerial.empty(), "replicates report");
+	check (runReplicates (&theBdMacro, 3) == theSerial,
+		"parallel birth-death replicates report as serial");
+
+	// an epoch with a trait evolving along the branches
+	MesaTree* theTreeP = getActiveTreeP ();
+	nodeiter_t theRoot = theTreeP->getRoot ();
+	stringvec_t theNames (1, theTreeP->getNodeName (theRoot));
+	theModel.mContData.resize (1, 1, 0.0);
+	theModel.mContData.setRowNames (theNames);
+
+	RunAndRestoreMacro theTraitMacro (6);
+	theEpochP = new EpochTimeLimit (3.0, false);
+	theEpochP->adoptAction (new MarkovSpRule (1.0));
+	theEpochP->adoptAction (new MarkovKillRule (0.3));
+	GradualCharEvolRule* theTraitRuleP = new GradualCharEvolRule ();
+	SchemeArr theSchemes;
+	contcharrange_t theRange;
+	theSchemes.adopt (new ContBrownianScheme (0, 0.0, 1.0, false, theRange,
+		kEvolBound_Ignore));
+	theTraitRuleP->adoptScheme (theSchemes);
+	theEpochP->adoptAction (theTraitRuleP);
+	theTraitMacro.adoptAction (theEpochP);
+	addReplicateAnalyses (&theTraitMacro);
+
+	theSerial = runReplicates (&theTraitMacro, 1);
+	check (runReplicates (&theTraitMacro, 3) == theSerial,
+		"parallel replicates with traits report as serial");
+	check (theModel.mContData.getData (0UL, 0UL) == 0.0,
+		"replicates leave the traits as they were");
+}
+
+
+static void testParallelClades ()
+//: clades of a timed epoch grown in parallel must give the tree grown serially
+{
+	DbgModel theModel;
+	MesaTree* theTreeP = getActiveTreeP ();
+	while (theTreeP->countAliveLeaves () < 300)
+		speciate (theTreeP->getLiveLeaf (0));
+	
+	// a single replicate, so it is the clades that are shared out
+	RunAndRestoreMacro theMacro (1);
+	EpochMacro* theEpochP = new EpochTimeLimit (1.0, false);
+	theEpochP->setEngine (kEpochEngine_Direct);
+	theEpochP->adoptAction (new MarkovSpRule (1.0));
+	theEpochP->adoptAction (new MarkovKillRule (0.3));
+	theMacro.adoptAction (theEpochP);
+	addReplicateAnalyses (&theMacro);
+	
+	string theSerial = runReplicates (&theMacro, 1);
+	check (runReplicates (&theMacro, 3) == theSerial,
+		"clades grown in parallel give the tree grown serially");
+}
+
+
+// *** MAIN BODY *********************************************************/
+
+int main ()
+{
+	testParallelReplicates ();
+	testParallelClades ();
+	return (gNumFailures == 0) ? 0 : 1;
+}
+
+
+#endif
+// *** END ***************************************************************/
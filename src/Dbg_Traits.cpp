@@ -0,0 +1,254 @@
+/**************************************************************************
+Dbg_Traits.cpp - test harness for the evolution of traits
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <http://www.agapow.net/software/mesa>
+
+About:
+- Checks that the shortcuts taken in evolving traits give what the
+  step-by-step evolution would, over many leaves from a fixed seed.
+- Built & run by "make check", in place of main.cpp.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#ifdef MESA_DBG_CHECK
+
+#include "Dbg_Check.h"
+#include "ActionUtils.h"
+#include "CharEvolScheme.h"
+#include "MesaGlobals.h"
+#include "MesaTree.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using std::vector;
+
+
+// *** CONSTANTS & DEFINES
+
+static const long kNumLeaves = 2048;
+static const long kNumDiscDraws = 100000;
+
+
+// *** TEST FUNCTIONS ****************************************************/
+
+static void growLeaves (long iNumLeaves)
+//: split the living leaves of the active tree until there are this many
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	while (long (theTreeP->countAliveLeaves ()) < iNumLeaves)
+		speciate (theTreeP->getLiveLeaf (0));
+}
+
+
+static void summarizeCont (vector<nodeiter_t>& iNodes, double& oMean, double& oVar)
+//: the mean & variance of the first continuous trait over these nodes
+{
+	double theSum = 0.0, theSumSq = 0.0;
+	vector<nodeiter_t>::iterator q;
+	for (q = iNodes.begin(); q != iNodes.end(); q++)
+	{
+		double theVal = getContData (*q, 0);
+		theSum += theVal;
+		theSumSq += theVal * theVal;
+	}
+	oMean = theSum / iNodes.size();
+	oVar = (theSumSq / iNodes.size()) - (oMean * oMean);
+}
+
+
+static void evolveBrownian (ContBrownianScheme& iScheme, bool iIsLazy,
+	double oMeans[2], double oVars[2])
+//: evolve every leaf for 1.0, killing half of them at 0.5, & summarize both
+// The survivors come first.
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	vector<nodeiter_t> theLeaves;
+	theTreeP->getLiveLeaves (theLeaves);
+	vector<nodeiter_t> theSurvivors, theCasualties;
+	for (vector<nodeiter_t>::size_type i = 0; i < theLeaves.size(); i++)
+		((i % 2) ? theCasualties : theSurvivors).push_back (theLeaves[i]);
+
+	if (iIsLazy)
+		deferTraitEvolution (&iScheme);
+	for (int theStep = 0; theStep < 10; theStep++)
+	{
+		if (theStep == 5)
+		{
+			vector<nodeiter_t>::iterator q;
+			for (q = theCasualties.begin(); q != theCasualties.end(); q++)
+			{
+				nodeiter_t theLeaf = *q;
+				theTreeP->killLeaf (theLeaf);
+			}
+		}
+		theTreeP->ageAllLeaves (0.1);
+		if (not iIsLazy)
+		{
+			vector<nodeiter_t> theLiveLeaves;
+			theTreeP->getLiveLeaves (theLiveLeaves);
+			iScheme.evolveCharsBatch (theLiveLeaves, 0.1);
+		}
+	}
+	syncAllTraits ();
+	theTreeP->syncAllLeafAges ();
+
+	summarizeCont (theSurvivors, oMeans[0], oVars[0]);
+	summarizeCont (theCasualties, oMeans[1], oVars[1]);
+}
+
+
+static void testLazyBrownian ()
+//: a Brownian trait drawn lazily must match one evolved at every step
+// Including on leaves that died along the way, which stop evolving then.
+{
+	DbgModel theModel;
+	MesaGlobals::mRng.SetSeed (1234);
+	MesaTree* theTreeP = getActiveTreeP ();
+	nodeiter_t theRoot = theTreeP->getRoot ();
+	stringvec_t theNames (1, theTreeP->getNodeName (theRoot));
+	theModel.mContData.resize (1, 1, 0.0);
+	theModel.mContData.setRowNames (theNames);
+	growLeaves (kNumLeaves);
+	ContTraitMatrix theSavedContData = theModel.mContData;
+
+	contcharrange_t theRange;
+	ContBrownianScheme theScheme (0, 0.2, 1.0, false, theRange, kEvolBound_Ignore);
+	double theEagerMeans[2], theEagerVars[2], theLazyMeans[2], theLazyVars[2];
+
+	MesaTree::UndoMark theMark = theTreeP->markUndo ();
+	evolveBrownian (theScheme, false, theEagerMeans, theEagerVars);
+	theTreeP->rollbackUndo (theMark);
+	theModel.mContData = theSavedContData;
+	evolveBrownian (theScheme, true, theLazyMeans, theLazyVars);
+	theTreeP->rollbackUndo (theMark);
+	theTreeP->releaseUndo (theMark);
+	theModel.mContData = theSavedContData;
+
+	// the survivors drift by 0.2 with a variance of 1, the dead half that
+	check ((std::fabs (theEagerMeans[0] - 0.2) < 0.1) and
+		(std::fabs (theEagerVars[0] - 1.0) < 0.15) and
+		(std::fabs (theEagerMeans[1] - 0.1) < 0.1) and
+		(std::fabs (theEagerVars[1] - 0.5) < 0.1), "eager Brownian change");
+	check ((std::fabs (theLazyMeans[0] - 0.2) < 0.1) and
+		(std::fabs (theLazyVars[0] - 1.0) < 0.15) and
+		(std::fabs (theLazyMeans[1] - 0.1) < 0.1) and
+		(std::fabs (theLazyVars[1] - 0.5) < 0.1), "lazy Brownian change");
+	check ((std::fabs (theLazyMeans[0] - theEagerMeans[0]) < 0.1) and
+		(std::fabs (theLazyVars[0] - theEagerVars[0]) < 0.15) and
+		(std::fabs (theLazyMeans[1] - theEagerMeans[1]) < 0.1) and
+		(std::fabs (theLazyVars[1] - theEagerVars[1]) < 0.1),
+		"lazy Brownian change matches eager");
+}
+
+
+static void calcRankedProbs (double iRise, double iFall, double iTime,
+	vector<double>& oProbs)
+//: the chance of going between 3 ranked states in this time, as exp (Qt)
+// By squaring I + Qt/2^20 twenty times, which is close enough to check by.
+{
+	const long kNumStates = 3;
+	const int kNumSquarings = 20;
+	double theStep = iTime / (1L << kNumSquarings);
+	oProbs.assign (kNumStates * kNumStates, 0.0);
+	for (long i = 0; i < kNumStates; i++)
+	{
+		double theRise = (i < kNumStates - 1) ? iRise : 0.0;
+		double theFall = (0 < i) ? iFall : 0.0;
+		if (theRise != 0.0)
+			oProbs[(i * kNumStates) + i + 1] = theRise * theStep;
+		if (theFall != 0.0)
+			oProbs[(i * kNumStates) + i - 1] = theFall * theStep;
+		oProbs[(i * kNumStates) + i] = 1.0 - ((theRise + theFall) * theStep);
+	}
+	for (int n = 0; n < kNumSquarings; n++)
+	{
+		vector<double> theSquare (kNumStates * kNumStates, 0.0);
+		for (long i = 0; i < kNumStates; i++)
+			for (long j = 0; j < kNumStates; j++)
+				for (long k = 0; k < kNumStates; k++)
+					theSquare[(i * kNumStates) + j] +=
+						oProbs[(i * kNumStates) + k] * oProbs[(k * kNumStates) + j];
+		oProbs.swap (theSquare);
+	}
+}
+
+
+static void drawRankedStates (RateMatrixCeScheme& iScheme, int iNumSteps,
+	double iTime, vector<double>& oFreqs)
+//: how often a leaf that starts at the middle state ends at each
+// Over many draws, each time in this many equal steps.
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	nodeiter_t theRoot = theTreeP->getRoot ();
+	oFreqs.assign (iScheme.mCharStates.size(), 0.0);
+	for (long n = 0; n < kNumDiscDraws; n++)
+	{
+		disctrait_t theStart = iScheme.mCharStates[1];
+		setDiscData (theRoot, 0, theStart);
+		for (int theStep = 0; theStep < iNumSteps; theStep++)
+			iScheme.evolveChars (theRoot, iTime / iNumSteps);
+		disctrait_t theEnd = getDiscData (theRoot, 0);
+		CharStateSet::iterator q = std::find (iScheme.mCharStates.begin(),
+			iScheme.mCharStates.end(), theEnd);
+		oFreqs[q - iScheme.mCharStates.begin()] += 1.0 / kNumDiscDraws;
+	}
+}
+
+
+static void testUniformizedDiscrete ()
+//: a discrete trait drawn by uniformization must change as exp (Qt) says
+// Ranked states leave the middle faster than either end, so the jumps
+// that go nowhere are needed to get it right, and it must come out the
+// same drawn in one interval or in several.
+{
+	DbgModel theModel;
+	MesaGlobals::mRng.SetSeed (1234);
+	MesaTree* theTreeP = getActiveTreeP ();
+	nodeiter_t theRoot = theTreeP->getRoot ();
+	stringvec_t theNames (1, theTreeP->getNodeName (theRoot));
+	theModel.mDiscData.resize (1, 1, disctrait_t ("b"));
+	theModel.mDiscData.setRowNames (theNames);
+
+	CharStateSet theStates;
+	theStates.addState ("a");
+	theStates.addState ("b");
+	theStates.addState ("c");
+	RankedMarkovianCeScheme theScheme (0, theStates, 0.3, 0.7);
+	vector<double> theExpected, theOnce, theStepped;
+	calcRankedProbs (0.7, 0.3, 2.5, theExpected);
+	drawRankedStates (theScheme, 1, 2.5, theOnce);
+	drawRankedStates (theScheme, 5, 2.5, theStepped);
+
+	bool theIsOnceOk = true, theIsSteppedOk = true;
+	for (long j = 0; j < 3; j++)
+	{
+		// from the middle state
+		double theProb = theExpected[3 + j];
+		theIsOnceOk = theIsOnceOk and (std::fabs (theOnce[j] - theProb) < 0.01);
+		theIsSteppedOk = theIsSteppedOk and (std::fabs (theStepped[j] - theProb) < 0.01);
+	}
+	check (theIsOnceOk, "uniformized discrete change over one interval");
+	check (theIsSteppedOk, "uniformized discrete change over several intervals");
+}
+
+
+// *** MAIN BODY *********************************************************/
+
+int main ()
+{
+	testLazyBrownian ();
+	testUniformizedDiscrete ();
+	return (gNumFailures == 0) ? 0 : 1;
+}
+
+
+#endif
+// *** END ***************************************************************/
@@ -0,0 +1,301 @@
+/**************************************************************************
+Dbg_Undo.cpp - test harness for rolling back changes to the model
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <http://www.agapow.net/software/mesa>
+
+About:
+- Checks that what an epoch does to a tree & its traits is undone by a
+  rollback, so a restarted epoch or the next replicate of a run & restore
+  starts afresh.
+- Built & run by "make check", in place of main.cpp.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#ifdef MESA_DBG_CHECK
+
+#include "Dbg_Check.h"
+#include "ActionUtils.h"
+#include "CharEvolScheme.h"
+#include "MesaGlobals.h"
+#include "MesaTree.h"
+#include "SimpleTree.h"
+#include "TaxaTraitMatrix.h"
+#include "TreeWrangler.h"
+#include <cmath>
+#include <vector>
+
+
+// *** TEST FUNCTIONS ****************************************************/
+
+static void testTraitStampRollback ()
+//: lazy traits must evolve again after the epoch that evolved them is undone
+{
+	// a single living root, with one continuous trait at 0
+	TreeWrangler theTrees;
+	ContTraitMatrix theContData;
+	DiscTraitMatrix theDiscData;
+	MesaGlobals::mTreeDataP = &theTrees;
+	MesaGlobals::mContDataP = &theContData;
+	MesaGlobals::mDiscDataP = &theDiscData;
+	theTrees.seedTree ();
+	MesaTree* theTreeP = getActiveTreeP ();
+	nodeiter_t theRoot = theTreeP->getRoot ();
+	stringvec_t theNames (1, theTreeP->getNodeName (theRoot));
+	theContData.resize (1, 1, 0.0);
+	theContData.setRowNames (theNames);
+
+	contcharrange_t theRange;
+	ContBrownianScheme theScheme (0, 0.0, 1.0, false, theRange, kEvolBound_Ignore);
+
+	// evolve as an epoch would, then roll it all back
+	MesaTree::UndoMark theMark = theTreeP->markUndo ();
+	ContTraitMatrix::UndoMark theContMark = theContData.markUndo ();
+	deferTraitEvolution (&theScheme);
+	theTreeP->ageAllLeaves (1.0);
+	syncNodeTraits (theRoot);
+	check (getContData (theRoot, 0) != 0.0, "trait evolves");
+	syncAllTraits ();
+	theTreeP->syncAllLeafAges ();
+	theTreeP->rollbackUndo (theMark);
+	theContData.rollbackUndo (theContMark);
+	check (theRoot->second.mData.mTraitStamp == 0.0, "rollback restores trait stamp");
+	check (getContData (theRoot, 0) == 0.0, "rollback restores trait");
+
+	// and evolve again
+	deferTraitEvolution (&theScheme);
+	theTreeP->ageAllLeaves (1.0);
+	syncNodeTraits (theRoot);
+	check (getContData (theRoot, 0) != 0.0, "trait evolves again after rollback");
+	syncAllTraits ();
+	theTreeP->syncAllLeafAges ();
+	theTreeP->releaseUndo (theMark);
+	theContData.releaseUndo (theContMark);
+
+	MesaGlobals::mTreeDataP = NULL;
+	MesaGlobals::mContDataP = NULL;
+	MesaGlobals::mDiscDataP = NULL;
+}
+
+
+static bool isSameMatrix (ContTraitMatrix& iMatrixA, ContTraitMatrix& iMatrixB)
+//: do these hold the same rows, under the same names?
+{
+	typedef std::vector< std::vector<conttrait_t> > rows_t;
+	if (static_cast<rows_t&> (iMatrixA) != static_cast<rows_t&> (iMatrixB))
+		return false;
+	for (ContTraitMatrix::size_type i = 0; i < iMatrixA.countRows(); i++)
+	{
+		if (iMatrixA.getRowName (i) != iMatrixB.getRowName (i))
+			return false;
+	}
+	return true;
+}
+
+
+static void testTraitRowRollback ()
+//: trait rows written, added or deleted after a mark must be put back
+// Including by an inner mark, as a restarted epoch within a replicate has.
+{
+	ContTraitMatrix theData;
+	stringvec_t theNames;
+	theNames.push_back ("a");
+	theNames.push_back ("b");
+	theNames.push_back ("c");
+	theData.resize (3, 2, 1.0);
+	theData.setRowNames (theNames);
+	ContTraitMatrix theOrig = theData;
+
+	ContTraitMatrix::UndoMark theOuterMark = theData.markUndo ();
+	theData.cloneRow ("a", "d");
+	theData.referData (0, 0) = 2.0;
+	theData.referData (3, 1) = 3.0;
+
+	ContTraitMatrix theWritten = theData;
+	ContTraitMatrix::UndoMark theInnerMark = theData.markUndo ();
+	theData.referData (0, 0) = 4.0;
+	theData.referData (1, 1) = 5.0;
+	theData.cloneRow ("b", "e");
+	theData.rollbackUndo (theInnerMark);
+	check (isSameMatrix (theData, theWritten), "rollback to inner mark restores rows");
+	theData.referData (0, 0) = 6.0;
+	theData.rollbackUndo (theInnerMark);
+	check (isSameMatrix (theData, theWritten), "row written after rollback is saved again");
+	theData.releaseUndo (theInnerMark);
+
+	std::vector<bool> theDoomed (4, false);
+	theDoomed[1] = true;
+	theData.deleteRows (theDoomed);
+	theData.referData (1, 0) = 7.0;
+	check (theData.findRowNameIndex ("c") == 1, "deleted row is gone");
+	theData.rollbackUndo (theOuterMark);
+	check (isSameMatrix (theData, theOrig), "rollback to outer mark restores rows");
+	check (theData.findRowNameIndex ("c") == 2, "rollback restores row names");
+	theData.releaseUndo (theOuterMark);
+	check (not theData.isUndoable (), "released matrix is no longer logged");
+}
+
+
+struct WalkedTotals
+//: what a walk over a subtree comes to, to check the kept totals by
+{
+	MesaTree::size_type    mNumLeaves;
+	MesaTree::size_type    mNumAliveLeaves;
+	MesaTree::weight_type  mLength;
+	MesaTree::size_type    mReach;
+};
+
+
+static bool walkTotals (MesaTree* iTreeP, nodeiter_t iNode,
+	MesaTree::size_type iDepth, WalkedTotals& oTotals)
+//: walk the subtree of this node, checking the tree's totals at each node
+// Returns whether the totals the tree gives matched the walk all the way.
+{
+	oTotals.mNumLeaves = oTotals.mNumAliveLeaves = oTotals.mReach = 0;
+	oTotals.mLength = 0.0;
+	bool theIsOk = true;
+	if (iTreeP->isLeaf (iNode))
+	{
+		oTotals.mNumLeaves = 1;
+		oTotals.mNumAliveLeaves = iTreeP->isNodeAlive (iNode) ? 1 : 0;
+	}
+	MesaTree::size_type theNumChildren = iTreeP->countChildren (iNode);
+	for (MesaTree::size_type i = 0; i < theNumChildren; i++)
+	{
+		nodeiter_t theChild = iTreeP->getChild (iNode, i);
+		WalkedTotals theChildTotals;
+		theIsOk = walkTotals (iTreeP, theChild, iDepth + 1, theChildTotals) and theIsOk;
+		oTotals.mNumLeaves += theChildTotals.mNumLeaves;
+		oTotals.mNumAliveLeaves += theChildTotals.mNumAliveLeaves;
+		oTotals.mLength += theChildTotals.mLength + iTreeP->getEdgeWeight (theChild);
+		oTotals.mReach = std::max (oTotals.mReach, theChildTotals.mReach + 1);
+	}
+	return theIsOk and
+		(iTreeP->countLeaves (iNode) == oTotals.mNumLeaves) and
+		(iTreeP->countAliveLeaves (iNode) == oTotals.mNumAliveLeaves) and
+		(std::fabs (iTreeP->getSubtreeLength (iNode) - oTotals.mLength) < 1.0e-9) and
+		(iTreeP->getHeight (iNode) == iDepth) and
+		(iTreeP->getNodeReach (iNode) == oTotals.mReach);
+}
+
+
+static bool areTotalsRight (MesaTree* iTreeP)
+//: does every node of the tree give the totals a walk does?
+{
+	WalkedTotals theTotals;
+	return walkTotals (iTreeP, iTreeP->getRoot (), 0, theTotals);
+}
+
+
+static void testSubtreeTotals ()
+//: subtree totals kept through kills & prunings must match a walk, & rollback
+{
+	DbgModel theModel;
+	bool theSavedKeep = MesaGlobals::mPrefs.mKeepSubtreeTotals;
+	MesaGlobals::mPrefs.mKeepSubtreeTotals = true;
+	MesaTree* theTreeP = getActiveTreeP ();
+	for (long i = 0; theTreeP->countAliveLeaves () < 40; i++)
+	{
+		speciate (theTreeP->getLiveLeaf ((i * 7) % theTreeP->countAliveLeaves ()));
+		theTreeP->ageAllLeaves (0.1);
+	}
+	check (areTotalsRight (theTreeP), "subtree totals of a grown tree");
+
+	// kept up to date through kills, then prunings & growth after a mark
+	for (long i = 0; i < 5; i++)
+	{
+		nodeiter_t theLeaf = theTreeP->getLiveLeaf (i * 3);
+		theTreeP->killLeaf (theLeaf);
+	}
+	theTreeP->ageAllLeaves (0.2);
+	check (areTotalsRight (theTreeP), "subtree totals kept through kills");
+	WalkedTotals theMarked;
+	walkTotals (theTreeP, theTreeP->getRoot (), 0, theMarked);
+	MesaTree::UndoMark theMark = theTreeP->markUndo ();
+	for (long i = 0; i < 5; i++)
+	{
+		nodeiter_t theLeaf = theTreeP->getLiveLeaf (i * 2);
+		theTreeP->killLeaf (theLeaf);
+	}
+	for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+	{
+		if (theTreeP->isLeaf (q) and (not theTreeP->isNodeAlive (q)))
+		{
+			nodeiter_t theDead = q;
+			theTreeP->pruneLeaf (theDead);
+			break;
+		}
+	}
+	speciate (theTreeP->getLiveLeaf (0));
+	theTreeP->ageAllLeaves (0.3);
+	check (areTotalsRight (theTreeP), "subtree totals kept through prunings");
+
+	// & worked out afresh after rolling back
+	theTreeP->rollbackUndo (theMark);
+	WalkedTotals theRolledBack;
+	check (areTotalsRight (theTreeP) and
+		walkTotals (theTreeP, theTreeP->getRoot (), 0, theRolledBack) and
+		(theRolledBack.mNumLeaves == theMarked.mNumLeaves) and
+		(theRolledBack.mNumAliveLeaves == theMarked.mNumAliveLeaves) and
+		(std::fabs (theRolledBack.mLength - theMarked.mLength) < 1.0e-9),
+		"subtree totals after rollback");
+	theTreeP->releaseUndo (theMark);
+	MesaGlobals::mPrefs.mKeepSubtreeTotals = theSavedKeep;
+}
+
+
+static void testOldestFirst ()
+//: nodes must be gone over in the order they were made, though ids are reused
+{
+	typedef sbl::SimpleTree<int> tree_t;
+	tree_t theTree;
+	tree_t::iterator theRoot = theTree.insertRoot ();
+	tree_t::iterator theLeafA = theTree.insertChild (theRoot);
+	tree_t::iterator theLeafB = theTree.insertChild (theRoot);
+	int theIdB = theLeafB->first;
+	theTree.pruneLeaf (theLeafA);
+	tree_t::iterator theLeafC = theTree.insertChild (theLeafB);
+	int theIdC = theLeafC->first;
+	check (theIdC < theIdB, "id of deleted node is reused");
+
+	tree_t::UndoMark theMark = theTree.markUndo ();
+	tree_t::iterator theLeafD = theTree.insertChild (theLeafB);
+	int theIdD = theLeafD->first;
+	theTree.pruneLeaf (theLeafC);
+	std::vector<int> theOrder;
+	tree_t::iterator q;
+	for (q = theTree.getOldestNode(); q != theTree.end(); q = theTree.getNextOldestNode (q))
+		theOrder.push_back (q->first);
+	check ((theOrder.size() == 3) and (theOrder[1] == theIdB) and
+		(theOrder[2] == theIdD), "nodes go oldest first");
+
+	theTree.rollbackUndo (theMark);
+	theOrder.clear();
+	for (q = theTree.getOldestNode(); q != theTree.end(); q = theTree.getNextOldestNode (q))
+		theOrder.push_back (q->first);
+	check ((theOrder.size() == 3) and (theOrder[1] == theIdB) and
+		(theOrder[2] == theIdC), "nodes go oldest first after rollback");
+	theTree.releaseUndo (theMark);
+}
+
+
+// *** MAIN BODY *********************************************************/
+
+int main ()
+{
+	testTraitStampRollback ();
+	testTraitRowRollback ();
+	testSubtreeTotals ();
+	testOldestFirst ();
+	return (gNumFailures == 0) ? 0 : 1;
+}
+
+
+#endif
+// *** END ***************************************************************/
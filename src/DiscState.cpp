@@ -0,0 +1,73 @@
+/**************************************************************************
+DiscState.cpp - an interned discrete character state
+
+Credits:
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <mail://mesa@agapow.net> <http://www.agapow.net/software/mesa/>
+
+About:
+- The dictionary is shared by all characters and only ever grows. Code 0
+  is always the empty string, so a default state is blank as before.
+- The strings are kept in a deque, which doesn't move them as it grows,
+  so the references & c_str() pointers handed out stay good for the life
+  of the program.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#include "DiscState.h"
+#include <cassert>
+#include <deque>
+#include <map>
+
+using std::string;
+using std::deque;
+using std::map;
+
+
+// *** CONSTANTS & DEFINES
+
+static deque<string>& getStateStrings ()
+{
+	static deque<string> theStrings (1, string (""));
+	return theStrings;
+}
+
+static map<string, DiscState::code_type>& getStateCodes ()
+{
+	static map<string, DiscState::code_type> theCodes;
+	if (theCodes.empty())
+		theCodes[string ("")] = 0;
+	return theCodes;
+}
+
+
+// *** MAIN BODY *********************************************************/
+
+DiscState::code_type DiscState::intern (const string& iStateStr)
+//: return the code for this string, entering it if it is new
+{
+	map<string, code_type>& theCodes = getStateCodes();
+	map<string, code_type>::iterator q = theCodes.find (iStateStr);
+	if (q != theCodes.end())
+		return q->second;
+	
+	deque<string>& theStrings = getStateStrings();
+	code_type theNewCode = code_type (theStrings.size());
+	theStrings.push_back (iStateStr);
+	theCodes[iStateStr] = theNewCode;
+	return theNewCode;
+}
+
+const string& DiscState::lookup (code_type iCode)
+{
+	deque<string>& theStrings = getStateStrings();
+	assert (iCode < theStrings.size());
+	return theStrings[iCode];
+}
+
+
+// *** END ***************************************************************/
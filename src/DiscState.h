@@ -0,0 +1,109 @@
+/**************************************************************************
+DiscState.h - an interned discrete character state
+
+Credits:
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <mail://mesa@agapow.net> <http://www.agapow.net/software/mesa/>
+
+About:
+- A discrete trait value used to be a std::string, so every cell of a
+  discrete matrix was a heap string and every copy or comparison of a
+  state worked on characters.
+- Here each distinct state string is entered once in a dictionary and a
+  state is just its small integer code. Copying and testing for equality
+  are integer operations, and the string is only looked up when it is
+  needed for reading, writing or reporting.
+- States convert to & from strings implicitly, so code that treated them
+  as strings keeps working. Ordering is by the string, so sorted sets of
+  states come out as before.
+
+**************************************************************************/
+
+#pragma once
+#ifndef DISCSTATE_H
+#define DISCSTATE_H
+
+
+// *** INCLUDES
+
+#include <string>
+#include <iostream>
+
+
+// *** CONSTANTS & DEFINES
+
+// *** CLASS DECLARATION *************************************************/
+
+class DiscState
+{
+public:
+	// PUBLIC TYPE INTERFACE
+	typedef unsigned int    code_type;
+	
+	// LIFECYCLE
+	DiscState ()
+		: mCode (0)
+		{}
+	DiscState (const std::string& iStateStr)
+		: mCode (intern (iStateStr))
+		{}
+	DiscState (const char* iStateCstr)
+		: mCode (intern (std::string (iStateCstr)))
+		{}
+	
+	// ACCESSORS
+	code_type            getCode () const
+		{ return mCode; }
+	const std::string&   str () const
+		{ return lookup (mCode); }
+	const char*          c_str () const
+		{ return str().c_str(); }
+	std::string::size_type  size () const
+		{ return str().size(); }
+	bool                 empty () const
+		{ return (mCode == 0); }
+	
+	operator const std::string& () const
+		{ return str(); }
+	
+	// INTERNALS
+private:
+	code_type   mCode;
+
+	static code_type            intern (const std::string& iStateStr);
+	static const std::string&   lookup (code_type iCode);
+};
+
+
+// *** FUNCTIONS *********************************************************/
+
+inline bool operator== (const DiscState& iLhs, const DiscState& iRhs)
+	{ return (iLhs.getCode() == iRhs.getCode()); }
+inline bool operator!= (const DiscState& iLhs, const DiscState& iRhs)
+	{ return (iLhs.getCode() != iRhs.getCode()); }
+inline bool operator< (const DiscState& iLhs, const DiscState& iRhs)
+	{ return (iLhs.str() < iRhs.str()); }
+inline bool operator<= (const DiscState& iLhs, const DiscState& iRhs)
+	{ return (iLhs.str() <= iRhs.str()); }
+inline bool operator> (const DiscState& iLhs, const DiscState& iRhs)
+	{ return (iLhs.str() > iRhs.str()); }
+inline bool operator>= (const DiscState& iLhs, const DiscState& iRhs)
+	{ return (iLhs.str() >= iRhs.str()); }
+
+// comparing against a literal shouldn't enter it into the dictionary
+inline bool operator== (const DiscState& iLhs, const char* iRhs)
+	{ return (iLhs.str() == iRhs); }
+inline bool operator!= (const DiscState& iLhs, const char* iRhs)
+	{ return (iLhs.str() != iRhs); }
+inline bool operator== (const DiscState& iLhs, const std::string& iRhs)
+	{ return (iLhs.str() == iRhs); }
+inline bool operator!= (const DiscState& iLhs, const std::string& iRhs)
+	{ return (iLhs.str() != iRhs); }
+
+inline std::ostream& operator<< (std::ostream& ioStream, const DiscState& iState)
+	{ return (ioStream << iState.str()); }
+
+
+#endif
+// *** END ***************************************************************/
@@ -25,306 +25,1781 @@ Credits:
 #include <sstream>
 #include <string>
 #include <exception>
+#include <cmath>
+#include <cstdio>
+
+#if defined(unix) || defined(__unix__) || defined(__APPLE__)
+	#define MESA_CANFORK
+	#include <unistd.h>
+	#include <sys/types.h>
+	#include <sys/wait.h>
+	#include <cerrno>
+#endif
 
 using std::vector;
 using std::stringstream;
 using std::string;
-using std::random_shuffle;
 using std::exception;
 using sbl::toString;
 
 
 // *** CONSTANTS & DEFINES
 
+// how many living leaves a timed birth-death epoch leads in to before its
+// clades are grown apart, and how many pieces of work they are shared out as
+static const long kMinCladesToSplit = 256;
+static const long kMaxCladeTasks = 256;
+
+// a leap expected to hold fewer events than this isn't worth it, so this
+// many events are made exactly instead (after Cao et al. 2006)
+static const double kMinLeapEvents = 10.0;
+static const long kNumExactSteps = 100;
+
+// how much longer a leap may be than the last, where earlier ones were
+// shortened by rates moving faster than the number alive
+static const double kTauScaleGrowth = 2.0;
+
+
+#ifdef MESA_CANFORK
+static bool
+writeWhole (int iFile, const void* iBuffer, size_t iSize)
+//: write all of this buffer, carrying on after interrupts & short writes
+{
+	const char* theNextP = (const char*) iBuffer;
+	while (0 < iSize)
+	{
+		ssize_t theNumWritten = write (iFile, theNextP, iSize);
+		if (theNumWritten < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		theNextP += theNumWritten;
+		iSize -= size_t (theNumWritten);
+	}
+	return true;
+}
+#endif
+
+
+static vector<mesatime_t>::size_type
+chooseByRate (vector<mesatime_t>& iRates, mesatime_t iTotalRate,
+	sbl::RandomService& ioRng = MesaGlobals::mRng)
+//: pick an index with probability proportional to its rate
+{
+	// Preconditions:
+	assert (0 < iRates.size());
+	assert (0.0 < iTotalRate);
+	
+	// Main:
+	mesatime_t theTarget = ioRng.UniformFloat (iTotalRate);
+	vector<mesatime_t>::size_type theChosen = 0;
+	while ((theChosen < iRates.size() - 1) and (iRates[theChosen] <= theTarget))
+	{
+		theTarget -= iRates[theChosen];
+		theChosen++;
+	}
+	// guard against rounding pushing us onto a rate that can't fire
+	while (iRates[theChosen] <= 0.0)
+		theChosen--;
+	
+	// Postconditions & return:
+	return theChosen;
+}
+
+
+static double
+measureBirthDeath (bdmeasure_t iMeasure, mesatime_t iAge, long iNumNodes,
+	long iNumTips, long iNumAlive)
+//: how far a plain birth-death epoch has got towards its limit
+{
+	switch (iMeasure)
+	{
+		case kBdMeasure_Time:
+			return iAge;
+			
+		case kBdMeasure_Nodes:
+			return double (iNumNodes);
+			
+		case kBdMeasure_Tips:
+			return double (iNumTips);
+			
+		case kBdMeasure_Alive:
+			return double (iNumAlive);
+			
+		default:
+			assert (false);
+			return 0.0;
+	}
+}
+
+
+static char
+getUnkillableFlags ()
+//: the lineages of a plain birth-death epoch that a kill passes over
+// The root always, as the kill rules spare it, and its children if the
+// prefs preserve them (see MesaTree::killLeaf).
+{
+	char theFlags = kLineage_Root;
+	if (MesaGlobals::mPrefs.mPreserveNodes == kPrefPreserveNodes_RootChildren)
+		theFlags |= kLineage_RootChild;
+	return theFlags;
+}
+
+
+static void
+endLineage (BirthDeathLineage& ioLineage, lineagefate_t iFate, mesatime_t iTime)
+{
+	ioLineage.mEnd = iTime;
+	ioLineage.mFate = char (iFate);
+}
+
+
+static void
+splitLineage (vector<BirthDeathLineage>& ioLineages, long iIndex, mesatime_t iTime)
+//: end a lineage in a speciation, adding its children to the end
+{
+	endLineage (ioLineages[iIndex], kLineageFate_Split, iTime);
+	char theChildFlags = (ioLineages[iIndex].mFlags & kLineage_Root) ?
+		kLineage_RootChild : 0;
+	BirthDeathLineage theChild (iTime, iIndex, theChildFlags);
+	ioLineages.push_back (theChild);
+	ioLineages.push_back (theChild);
+}
+
+
+static bool
+actOnLineage (vector<BirthDeathLineage>& ioLineages, vector<long>& ioAlive,
+	long iIndex, bool iIsBirth, char iUnkillable, mesatime_t iTime)
+//: have the lineage at this place among the living split or die
+// The living are listed as the tree's index lists its living leaves, one
+// that splits or dies replaced by the last and any children going on the
+// end. Returns false if a kill passed over the lineage.
+{
+	long theLineage = ioAlive[iIndex];
+	if ((not iIsBirth) and (ioLineages[theLineage].mFlags & iUnkillable))
+		return false;
+	ioAlive[iIndex] = ioAlive.back();
+	ioAlive.pop_back();
+	if (iIsBirth)
+	{
+		ioAlive.push_back (long (ioLineages.size()));
+		ioAlive.push_back (long (ioLineages.size()) + 1);
+		splitLineage (ioLineages, theLineage, iTime);
+	}
+	else
+		endLineage (ioLineages[theLineage], kLineageFate_Dead, iTime);
+	return true;
+}
+
+
+static void
+setDrawnWeight (MesaTree* iTreeP, nodeiter_t iNode, BirthDeathLineage& iLineage,
+	bool iIsFounder, mesatime_t iLength)
+//: set a branch to its length at the end of a lineage drawn apart from the tree
+// A founder's branch has aged with the tree clock to the end of the draw,
+// so loses what came after the end of its lineage.
+{
+	mesatime_t theEnd = (iLineage.mFate == kLineageFate_Alive) ? iLength : iLineage.mEnd;
+	mesatime_t theWeight = theEnd - iLineage.mStart;
+	if (iIsFounder)
+		theWeight = std::max (0.0, iTreeP->getEdgeWeight (iNode) - (iLength - theEnd));
+	iTreeP->setEdgeWeight (iNode, theWeight);
+}
+
+
+static mesatime_t
+calcTauLeap (vector<mesatime_t>& iRates, vector<int>& iChanges,
+	long iNumAlive, double iTolerance)
+//: how long a leap can be before the number alive changes too much
+// The change in the number of living leaves over a leap has a mean and
+// variance set by the rates of each rule & the change it makes, and
+// both are held below the tolerance times the number alive. As each
+// rate is proportional to the number alive, this bounds their change.
+// See Cao, Gillespie & Petzold (2006) J Chem Phys 124:044109.
+{
+	double theBound = std::max (iTolerance * iNumAlive, 1.0);
+	double theMean = 0.0;
+	double theVariance = 0.0;
+	for (vector<mesatime_t>::size_type i = 0; i < iRates.size(); i++)
+	{
+		theMean += iChanges[i] * iRates[i];
+		theVariance += iChanges[i] * iChanges[i] * iRates[i];
+	}
+	assert (0.0 < theVariance);
+	mesatime_t theLeap = (theBound * theBound) / theVariance;
+	if (theMean != 0.0)
+		theLeap = std::min (theLeap, theBound / std::fabs (theMean));
+	return theLeap;
+}
+
+
 // *** CLASS DEFINITION **************************************************/
 
 void EpochMacro::execute ()
+//: run the epoch, starting over each time the tree dies if so wanted
+// Rather than being copied, the active tree and the trait matrices have
+// their changes logged so a restart can roll them back (see
+// MesaTree::markUndo & LabelledSimpleMatrix::markUndo).
 {
-   TreeWrangler		theSavedTrees;
-   ContTraitMatrix	theSavedContData;
-   DiscTraitMatrix	theSavedDiscData;	
-         
+	// Preconditions:
+	if (begin() == end())
+		throw ExecutionError ("no rules in epoch");
+	
+	// Main:
+	MesaTree* theTreeP = getActiveTreeP ();
+	ContTraitMatrix* theContDataP = MesaGlobals::mContDataP;
+	DiscTraitMatrix* theDiscDataP = MesaGlobals::mDiscDataP;
+	MesaTree::UndoMark			theTreeMark;
+	ContTraitMatrix::UndoMark	theContMark;
+	DiscTraitMatrix::UndoMark	theDiscMark;
+	if (mRestartIfDead)
+	{
+		theTreeMark = theTreeP->markUndo ();
+		theContMark = theContDataP->markUndo ();
+		theDiscMark = theDiscDataP->markUndo ();
+	}
+	
 	try
 	{
-		// Preconditions:
-		if (begin() == end())
-			throw ExecutionError ("no rules in epoch");
-      
-      if (mRestartIfDead)
-      {
-         // save all data
-         theSavedTrees = *(MesaGlobals::mTreeDataP);
-         theSavedContData = *(MesaGlobals::mContDataP);
-         theSavedDiscData = *(MesaGlobals::mDiscDataP);	
-      }
-      
-		MesaTree* theTreeP = getActiveTreeP ();
-		
-		if (isAtEnd () or (theTreeP->countAliveLeaves () == 0))
-			return;
-		
-		// Main:
-		sortRules();
-		if ((theLocalRules.size() + theGlobalRules.size()) <= 0)
-			throw ExecutionError ("no non-conditional rules in epoch");
-		
-		// until end condition is reached execute rules
-		executeEpochLoop ();
+		while (true)
+		{
+			try
+			{
+				executeAttempt ();
+				break;
+			}
+			catch (ExecutionError theError)
+			{
+				if ((not mRestartIfDead) or (0 < theTreeP->countAliveLeaves ()))
+				{
+					syncAllTraits ();
+					theTreeP->syncAllLeafAges ();
+					throw;
+				}
+				MesaGlobals::mReporterP->print ("Phylogeny dead, restoring and restarting");
+				MesaGlobals::mLazySchemes.clear();
+				theTreeP->rollbackUndo (theTreeMark);
+				theContDataP->rollbackUndo (theContMark);
+				theDiscDataP->rollbackUndo (theDiscMark);
+			}
+		}
 	}
-   catch (ExecutionError theError)
-   {
-      if (mRestartIfDead)
-      {
-         MesaGlobals::mReporterP->print ("Phylogeny dead, restoring and restarting");
-         // restore data and run again
-         *(MesaGlobals::mTreeDataP) = theSavedTrees; 
-         *(MesaGlobals::mContDataP) = theSavedContData;
-         *(MesaGlobals::mDiscDataP) = theSavedDiscData;
-         this->execute();
-      }
-      else
-         throw;
-   }
 	catch (...)
 	{
 		// Report ("A problem has caused the epoch to terminate prematurely.")
-
+		if (mRestartIfDead)
+		{
+			theTreeP->releaseUndo (theTreeMark);
+			theContDataP->releaseUndo (theContMark);
+			theDiscDataP->releaseUndo (theDiscMark);
+		}
 		throw;
-	}		
-/*
-	catch (exception &theException)
+	}
+	
+	if (mRestartIfDead)
 	{
-		string theBuffer ("Epoch terminates: ");
-		theBuffer += theException.what();
-		MesaGlobals::mReporterP->print (theBuffer.c_str());
+		theTreeP->releaseUndo (theTreeMark);
+		theContDataP->releaseUndo (theContMark);
+		theDiscDataP->releaseUndo (theDiscMark);
+	}
+}
+
+
+void EpochMacro::executeAttempt ()
+//: run the epoch once through, from the tree as it is
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	
+	if (isAtEnd () or (theTreeP->countAliveLeaves () == 0))
+		return;
+	
+	// Main:
+	sortRules();
+	if ((theLocalRules.size() + theGlobalRules.size()) <= 0)
+		throw ExecutionError ("no non-conditional rules in epoch");
+	vector<ConditionalRule*>::iterator s;
+	for (s = theCondRules.begin(); s != theCondRules.end(); s++)
+		(*s)->startEpoch ();
+	
+	// until end condition is reached execute rules, unless it's a plain
+	// birth-death process that the direct method can draw whole
+	if (isTauLeaping ())
+		executeTauLeap ();
+	else if (isDrawingBirthDeath ())
+		executeBirthDeath ();
+	else
+		executeEpochLoop ();
+	
+	// store the traits and ages of the leaves
+	syncAllTraits ();
+	getActiveTreeP()->syncAllLeafAges ();
+}
+
+
+
+void EpochMacro::executeEpochLoop ()
+{
+	// until end condition is reached execute rules
+	MesaTree* theTreeP = getActiveTreeP ();
+	while ((isAtEnd() == false) and (0 < theTreeP->countAliveLeaves ()))
+	{
+		// there must be taxa
+		// maybe this is ok, as there could be a global or cond that fires
+		theTreeP = getActiveTreeP ();
+		if (theTreeP->countAliveLeaves() <= 0)
+			throw ExecutionError ("no living taxa");
+
+		executeEpochOnce ();
+	}
+}
+
+
+bool EpochMacro::hasSpeciationRules ()
+{
+	for (iterator q = begin (); q != end(); q++)
+	{
+		if (isSpeciationRule ((EvolRule*) *q))
+			return true;
+	}
+	return false;
+}
+
+
+bool EpochMacro::hasKillRules ()
+{
+	for (iterator q = begin (); q != end(); q++)
+	{
+		if (isKillRule ((EvolRule*) *q))
+			return true;
+	}
+	return false;
+}
+
+
+
+void EpochMacro::sortRules ()
+//: gather the rules into the correct group for execution
+{
+	// Main:
+	theLocalRules.clear();
+	theGlobalRules.clear();
+	theCondRules.clear();
+	
+	// for every rule
+	for (iterator q = begin (); q != end(); q++)
+	{
+		// if it's a local rule, cast & store
+		LocalRule* theLocalRuleP = castAsLocalRule (*q);
+		if (theLocalRuleP != NULL)
+		{
+			theLocalRules.push_back (theLocalRuleP);
+			continue;
+		}
+		
+		// if it's a conditional, cast & store
+		ConditionalRule* theCondRuleP = castAsConditionalRule (*q);
+		if (theCondRuleP != NULL)
+		{
+			theCondRules.push_back (theCondRuleP);
+			continue;
+		}
+			
+		// if it's a gloabl rule, cast & store
+		GlobalRule* theGlobalRuleP = castAsGlobalRule (*q);
+		if (theGlobalRuleP != NULL)
+		{
+			theGlobalRules.push_back (theGlobalRuleP);
+			continue;
+		}
+		
+		// so what is it then? this shouldn't happen
+		assert (false);
+	}
+	
+	// subscribe each conditional to the events it responds to, so after
+	// an event only those that could be triggered are looked at
+	for (int e = 0; e < kEvolEvent_Count; e++)
+	{
+		mCondRulesByEvent[e].clear();
+		vector<ConditionalRule*>::iterator s;
+		for (s = theCondRules.begin(); s != theCondRules.end(); s++)
+		{
+			if ((*s)->respondsTo (evolevent_t (e)))
+				mCondRulesByEvent[e].push_back (*s);
+		}
+	}
+	
+	// the direct method can only be used if every leaf shares the same rate
+	// under each local rule and every global wait is exponential or fixed
+	mDirectUsable = true;
+	vector<LocalRule*>::iterator r;
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+	{
+		if (not (*r)->isUniformRate ())
+			mDirectUsable = false;
+	}
+	vector<GlobalRule*>::iterator t;
+	for (t = theGlobalRules.begin(); t != theGlobalRules.end(); t++)
+	{
+		if (not ((*t)->isExponentialRate () or (*t)->isFixedWait ()))
+			mDirectUsable = false;
+	}
+	
+	// if every rule is a speciation or extinction at a constant rate for
+	// every leaf and nothing else can happen, the epoch is a plain
+	// birth-death process and the direct method need only gather the
+	// rates once
+	mBirthDeathUsable = theGlobalRules.empty() and theCondRules.empty();
+	mBirthDeathRate = 0.0;
+	mBirthDeathRates.clear();
+	mBirthDeathBirths.clear();
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+	{
+		evolevent_t theKind = (*r)->getEventKind ();
+		if (not ((*r)->isUniformRate () and (*r)->isLeafDependent () and
+			((theKind == kEvolEvent_Speciation) or (theKind == kEvolEvent_Extinction))))
+		{
+			mBirthDeathUsable = false;
+			break;
+		}
+		mBirthDeathRates.push_back ((*r)->calcUniformRate ());
+		mBirthDeathRate += mBirthDeathRates.back();
+		mBirthDeathBirths.push_back (theKind == kEvolEvent_Speciation);
+	}
+	if (mBirthDeathRate <= 0.0)
+		mBirthDeathUsable = false;
+	
+	// tau-leaping needs the same, except that the rates may change with
+	// the number of leaves, as logistic rules do
+	mTauUsable = theGlobalRules.empty() and theCondRules.empty() and
+		(not theLocalRules.empty());
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+	{
+		evolevent_t theKind = (*r)->getEventKind ();
+		if (not ((*r)->isUniformRate () and
+			((theKind == kEvolEvent_Speciation) or (theKind == kEvolEvent_Extinction))))
+			mTauUsable = false;
+	}
+	
+	// the next-reaction engine keeps a wait for every leaf under rules that
+	// depend only on that leaf, pools rules with the same rate for every
+	// leaf, and can't be used if any rule is neither
+	mScheduleUsable = true;
+	mScheduleValid = false;
+	mScheduledRules.clear();
+	mPooledRules.clear();
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+	{
+		if ((*r)->isUniformRate ())
+			mPooledRules.push_back (*r);
+		else if ((*r)->isLeafDependent ())
+			mScheduledRules.push_back (*r);
+		else
+			mScheduleUsable = false;
+	}
+	
+	// Postcondition:
+	assert ((unsigned) size() == (unsigned) (theLocalRules.size() + theGlobalRules.size() + theCondRules.size()));
+}
+
+
+void EpochMacro::executeEpochOnce ()
+{
+	// Preconditions & preparation:
+	MesaTree* theTreeP = getActiveTreeP ();
+	if (theTreeP->countAliveLeaves() <= 0)
+		throw ExecutionError ("no living taxa");
+	
+	// DBG_MSG ("tree size: " << theTreeP->countNodes());
+	
+	// Main:
+	// find the first rule to go off, the node it targets & time it takes
+	nodeiter_t   theFiringLeaf;
+	mesatime_t       theTimeToEvent;
+	EvolRule*    theFiringRuleP;
+	theFiringRuleP = findFirstRule (theFiringLeaf, theTimeToEvent);
+	assert (theFiringRuleP != NULL);
+	assert (0.0 <= theTimeToEvent);
+	
+	// execute it
+	nodearr_t theSubjectLeaves;
+	theSubjectLeaves.push_back (theFiringLeaf);
+	commitAction (theFiringRuleP, theSubjectLeaves, theTimeToEvent);
+	
+	// do conditionals
+	fireConditionals (theFiringRuleP, theSubjectLeaves, theTimeToEvent);
+}
+
+
+EvolRule* EpochMacro::findFirstRule (nodeiter_t& oFiringLeaf, mesatime_t& oTime)
+//: find the rule, local or global, that goes off next
+{
+	// hand off to the faster engines if selected and the rules allow it
+	if ((mEngine == kEpochEngine_Direct) and mDirectUsable)
+	{
+		EvolRule* theDirectRuleP = findFirstRuleDirect (oFiringLeaf, oTime);
+		if (theDirectRuleP != NULL)
+			return theDirectRuleP;
+	}
+	if (isScheduling ())
+	{
+		EvolRule* theScheduledRuleP = findFirstRuleScheduled (oFiringLeaf, oTime);
+		if (theScheduledRuleP != NULL)
+			return theScheduledRuleP;
+	}
+	
+	// Preconditions & arg preparation
+	MesaTree* theTreeP = getActiveTreeP ();
+	// should be caught before here
+	assert (0 < theTreeP->countAliveLeaves());
+	oTime = 1000000; // TODO
+	oFiringLeaf = theTreeP->end();
+	EvolRule* theFiringRuleP = NULL;
+
+	// Main:	
+	// gather the leaves & shuffle them
+	// this sucks massively as a way to do it, but there's no other
+	// way to assess the taxa in a random order
+	typedef vector<nodeiter_t>	nodearr_t;
+	nodearr_t theLeaves;
+	theTreeP->getLiveLeaves (theLeaves);
+	assert (0 < theLeaves.size());
+	MesaGlobals::mRng.Shuffle (theLeaves.begin(), theLeaves.end());
+	
+	// which local rule combinations fires off?
+	// for each local rule and species/leaf combination
+	MesaGlobals::mRng.Shuffle (theLocalRules.begin(), theLocalRules.end());
+	for (nodearr_t::iterator q = theLeaves.begin(); q != theLeaves.end(); q++)
+	{
+		// test every rule to find the "soonest" one
+		vector<LocalRule*>::iterator r;
+		for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+		{
+			mesatime_t theCurrWait = (*r)->calcNextWait (*q);
+			assert (0.0 <= theCurrWait);
+			if (theCurrWait < oTime)
+			{
+				oTime = theCurrWait;
+				theFiringRuleP = *r;
+				oFiringLeaf = *q;
+			}
+		}
+	}
+	
+	// assess global rules and choose which happens
+	// test every rule to find the "soonest" one
+	MesaGlobals::mRng.Shuffle (theGlobalRules.begin(), theGlobalRules.end());
+	vector<GlobalRule*>::iterator t;
+	for (t = theGlobalRules.begin(); t != theGlobalRules.end(); t++)
+	{
+		mesatime_t theCurrWait = (*t)->calcNextWait ();
+		if (theCurrWait < oTime)
+		{
+			oTime = theCurrWait;
+			theFiringRuleP = *t;
+		}
+	}
+	
+	// Postconditions & return:
+	if (oTime <= 0.0)
+		DBG_MSG ("Arghhhhhhh");
+	assert (0.0 < oTime);
+	return theFiringRuleP;
+}
+
+
+EvolRule* EpochMacro::findFirstRuleDirect (nodeiter_t& oFiringLeaf, mesatime_t& oTime)
+//: find the next rule to go off by Gillespie's direct method
+// Where every leaf has the same rate under a local rule, the waits of all
+// leaves & rules can be pooled into a single exponential with the summed
+// rate. So draw one wait, then pick the rule in proportion to its share
+// of the total and a leaf uniformly. Fixed-wait (metronome) rules go off
+// if nothing else happens first. This gives the same distribution of
+// events as the classic engine with a fixed number of draws per event,
+// rather than one per leaf per rule. Counting & picking the living leaf
+// cost whatever the tree's live-leaf index costs (constant time since the
+// tree keeps one). If nothing has a positive rate, returns nil so the
+// classic engine can handle it.
+{
+	// Preconditions & arg preparation
+	MesaTree* theTreeP = getActiveTreeP ();
+	MesaTree::size_type theNumLeaves = theTreeP->countAliveLeaves();
+	assert (0 < theNumLeaves);
+	oFiringLeaf = theTreeP->end();
+	
+	// Main:
+	// gather the total rate of every local & exponential global rule
+	mDirectRates.clear();
+	mesatime_t theTotalRate = 0.0;
+	vector<LocalRule*>::iterator r;
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+	{
+		mesatime_t theRate = (*r)->calcUniformRate () * theNumLeaves;
+		assert (0.0 <= theRate);
+		mDirectRates.push_back (theRate);
+		theTotalRate += theRate;
+	}
+	
+	GlobalRule* theFixedRuleP = NULL;
+	mesatime_t theFixedWait = 0.0;
+	vector<GlobalRule*>::iterator t;
+	for (t = theGlobalRules.begin(); t != theGlobalRules.end(); t++)
+	{
+		mesatime_t theRate = 0.0;
+		if ((*t)->isExponentialRate ())
+		{
+			theRate = (*t)->calcRate ();
+		}
+		else
+		{
+			assert ((*t)->isFixedWait ());
+			mesatime_t theCurrWait = (*t)->calcNextWait ();
+			if ((theFixedRuleP == NULL) or (theCurrWait < theFixedWait))
+			{
+				theFixedRuleP = *t;
+				theFixedWait = theCurrWait;
+			}
+		}
+		assert (0.0 <= theRate);
+		mDirectRates.push_back (theRate);
+		theTotalRate += theRate;
+	}
+	
+	if (theTotalRate <= 0.0)
+	{
+		if (theFixedRuleP == NULL)
+			return NULL;
+		oTime = theFixedWait;
+		return theFixedRuleP;
+	}
+	
+	// when does the next event happen & does a fixed wait come first?
+	oTime = calcWaitFromRate (theTotalRate);
+	if ((theFixedRuleP != NULL) and (theFixedWait < oTime))
+	{
+		oTime = theFixedWait;
+		return theFixedRuleP;
+	}
+	
+	// which rule was it?
+	vector<mesatime_t>::size_type theChosen = chooseByRate (mDirectRates,
+		theTotalRate);
+	
+	// Postconditions & return:
+	assert (0.0 < oTime);
+	if (theChosen < theLocalRules.size())
+	{
+		// which leaf did it happen to?
+		long theLeafIndex = MesaGlobals::mRng.UniformWhole (long (theNumLeaves));
+		oFiringLeaf = theTreeP->getLiveLeaf (theLeafIndex);
+		return theLocalRules[theChosen];
+	}
+	else
+	{
+		return theGlobalRules[theChosen - theLocalRules.size()];
+	}
+}
+
+
+EvolRule* EpochMacro::findFirstRuleScheduled (nodeiter_t& oFiringLeaf, mesatime_t& oTime)
+//: find the next rule to go off by the next-reaction method
+// After Gibson & Bruck (2000). Rather than drawing a fresh wait for every
+// leaf & rule at every event, the time each leaf-dependent rule will go off
+// on each leaf is kept in a heap, and only redrawn for leaves changed by
+// an event. As the waits are exponential (i.e. memoryless) this gives the
+// same distribution of events as the classic engine. Rules with the same
+// rate for every leaf are pooled and drawn as in the direct method, and
+// global rules are drawn afresh every event as before. If nothing can go
+// off, returns nil so the classic engine can handle it.
+{
+	// Preconditions & arg preparation
+	MesaTree* theTreeP = getActiveTreeP ();
+	MesaTree::size_type theNumLeaves = theTreeP->countAliveLeaves();
+	assert (0 < theNumLeaves);
+	if (not mScheduleValid)
+		buildSchedule ();
+	oTime = 0.0;
+	oFiringLeaf = theTreeP->end();
+	EvolRule* theFiringRuleP = NULL;
+	
+	// Main:
+	// the soonest scheduled event, discarding those on leaves now dead
+	while (not mSchedule.isEmpty())
+	{
+		schedkey_t theKey = mSchedule.topKey ();
+		nodeiter_t theLeafIter = theTreeP->getIter (theKey.first);
+		if ((theLeafIter != theTreeP->end()) and theTreeP->isNodeAlive (theLeafIter))
+		{
+			oTime = std::max (mSchedule.topPriority () - mScheduleClock, 0.0);
+			theFiringRuleP = mScheduledRules[theKey.second];
+			oFiringLeaf = theLeafIter;
+			break;
+		}
+		mSchedule.remove (theKey);
+	}
+	
+	// does a pooled rule go off first?
+	mDirectRates.clear();
+	mesatime_t theTotalRate = 0.0;
+	vector<LocalRule*>::iterator r;
+	for (r = mPooledRules.begin(); r != mPooledRules.end(); r++)
+	{
+		mesatime_t theRate = (*r)->calcUniformRate () * theNumLeaves;
+		assert (0.0 <= theRate);
+		mDirectRates.push_back (theRate);
+		theTotalRate += theRate;
+	}
+	if (0.0 < theTotalRate)
+	{
+		mesatime_t theCurrWait = calcWaitFromRate (theTotalRate);
+		if ((theFiringRuleP == NULL) or (theCurrWait < oTime))
+		{
+			oTime = theCurrWait;
+			theFiringRuleP = mPooledRules[chooseByRate (mDirectRates, theTotalRate)];
+			long theLeafIndex = MesaGlobals::mRng.UniformWhole (long (theNumLeaves));
+			oFiringLeaf = theTreeP->getLiveLeaf (theLeafIndex);
+		}
+	}
+	
+	// assess global rules and choose which happens
+	MesaGlobals::mRng.Shuffle (theGlobalRules.begin(), theGlobalRules.end());
+	vector<GlobalRule*>::iterator t;
+	for (t = theGlobalRules.begin(); t != theGlobalRules.end(); t++)
+	{
+		mesatime_t theCurrWait = (*t)->calcNextWait ();
+		if ((theFiringRuleP == NULL) or (theCurrWait < oTime))
+		{
+			oTime = theCurrWait;
+			theFiringRuleP = *t;
+		}
+	}
+	
+	// Postconditions & return:
+	if (theFiringRuleP == NULL)
+	{
+		oFiringLeaf = theTreeP->end();
+		return NULL;
+	}
+	assert (0.0 <= oTime);
+	return theFiringRuleP;
+}
+
+
+void EpochMacro::buildSchedule ()
+//: draw the time each scheduled rule goes off for every living leaf
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	mSchedule.clear();
+	mScheduleClock = 0.0;
+	
+	nodearr_t theLeaves;
+	theTreeP->getLiveLeaves (theLeaves);
+	for (nodearr_t::iterator q = theLeaves.begin(); q != theLeaves.end(); q++)
+	{
+		for (int i = 0; i < (int) mScheduledRules.size(); i++)
+		{
+			mesatime_t theWait = mScheduledRules[i]->calcScheduledWait (*q);
+			mSchedule.append (schedkey_t ((*q)->first, i), theWait);
+		}
+	}
+	mSchedule.heapify ();
+	mScheduleValid = true;
+}
+
+
+void EpochMacro::rescheduleLeaf (nodeiter_t iLeafIter)
+//: redraw the waits for a leaf, or drop them if it is no longer living
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	bool theIsAlive = theTreeP->isNodeAlive (iLeafIter);
+	for (int i = 0; i < (int) mScheduledRules.size(); i++)
+	{
+		schedkey_t theKey (iLeafIter->first, i);
+		if (theIsAlive)
+		{
+			mesatime_t theWait = mScheduledRules[i]->calcScheduledWait (iLeafIter);
+			mSchedule.set (theKey, mScheduleClock + theWait);
+		}
+		else
+		{
+			mSchedule.remove (theKey);
+		}
+	}
+}
+
+
+void EpochMacro::rescheduleTraitRules (nodearr_t& iLeaves)
+//: redraw the waits of the scheduled rules that depend on traits
+// For after a conditional (e.g. gradual trait evolution) has changed the
+// traits of these leaves. Waits under rules that only depend on the age
+// of a leaf are still good and are left in place, so if there are no
+// trait-dependent rules or no changed leaves this costs nothing.
+{
+	if ((not mScheduleValid) or iLeaves.empty())
+		return;
+	
+	std::vector<int> theRuleIndices;
+	for (int i = 0; i < (int) mScheduledRules.size(); i++)
+	{
+		if (mScheduledRules[i]->dependsOnTraits ())
+			theRuleIndices.push_back (i);
+	}
+	if (theRuleIndices.empty())
+		return;
+	
+	for (nodearr_t::iterator q = iLeaves.begin(); q != iLeaves.end(); q++)
+	{
+		std::vector<int>::iterator r;
+		for (r = theRuleIndices.begin(); r != theRuleIndices.end(); r++)
+		{
+			mesatime_t theWait = mScheduledRules[*r]->calcScheduledWait (*q);
+			mSchedule.set (schedkey_t ((*q)->first, *r), mScheduleClock + theWait);
+		}
+	}
+}
+
+
+void EpochMacro::updateSchedule (nodearr_t& iLeaves)
+//: reschedule the leaves an event has changed
+// The subjects of an event are the leaves it changed, except that a leaf
+// that has speciated is now the parent of the leaves that need scheduling.
+// Leaves that have been killed out of sight are dropped lazily, when they
+// reach the top of the schedule.
+{
+	if (not mScheduleValid)
+		return;
+	
+	MesaTree* theTreeP = getActiveTreeP ();
+	for (nodearr_t::iterator q = iLeaves.begin(); q != iLeaves.end(); q++)
+	{
+		if (*q == theTreeP->end())
+			continue;
+		rescheduleLeaf (*q);
+		if (not theTreeP->isLeaf (*q))
+		{
+			for (MesaTree::size_type i = 0; i < theTreeP->countChildren (*q); i++)
+			{
+				nodeiter_t theChildIter = theTreeP->getChild (*q, i);
+				if (theTreeP->isLeaf (theChildIter))
+					rescheduleLeaf (theChildIter);
+			}
+		}
+	}
+}
+
+ 
+void EpochMacro::commitAction
+(EvolRule* iRuleP, nodearr_t& ioLeaves, mesatime_t iTime)
+//: execute the chosen rule
+// returns a vector of the leaves it operated on
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	// in case there are no rules programmed
+	assert (iRuleP != NULL);
+
+	// age all the leaves to the point where it happens
+	// TO DO: we're not aging twice are we
+	theTreeP->ageAllLeaves (iTime);		
+	mScheduleClock += iTime;
+	iRuleP->commitAction (ioLeaves, iTime);
+	if (isScheduling ())
+		updateSchedule (ioLeaves);
+}
+
+
+void EpochMacro::fireConditionals (EvolRule* iRuleP, nodearr_t& ioLeaves, mesatime_t iTime)
+//: search the conditionals for any that are fired and do them
+{
+	/*
+	if (dynamic_cast<NullRule*> (iRuleP) != NULL)
+	{
+		DBG_MSG ("metronome")
+	}
+	else
+	{
+		DBG_MSG ("system event");
+	}
+	*/
+		
+	// only the conditionals subscribed to this kind of event are triggered
+	vector<ConditionalRule*>& theSubscribers = mCondRulesByEvent[iRuleP->getEventKind ()];
+	if (theSubscribers.empty())
+		return;
+	if (1 < theSubscribers.size())
+		MesaGlobals::mRng.Shuffle (theSubscribers.begin(), theSubscribers.end());
+	vector<ConditionalRule*>::iterator s;
+	
+	for (s = theSubscribers.begin(); s != theSubscribers.end(); s++)
+	{
+		// shuffle leaf array only if necessary (i.e. more than 1 leaf)
+		if (1 < ioLeaves.size())
+			MesaGlobals::mRng.Shuffle (ioLeaves.begin(), ioLeaves.end());
+		// DBG_MSG ("number of leaves: " << ioLeaves.size());
+		// DBG_MSG ("firing rule address: " << iRuleP);
+		(*s)->commitAction (ioLeaves, iTime);
+		
+		// traits may have changed, so waits that depend on them must be redrawn
+		if (isScheduling ())
+		{
+			if ((*s)->changesOtherLeaves ())
+			{
+				nodearr_t theChangedLeaves;
+				(*s)->takeChangedLeaves (theChangedLeaves);
+				rescheduleTraitRules (theChangedLeaves);
+			}
+			else
+				updateSchedule (ioLeaves);
+		}
+	}
+}
+
+mesatime_t EpochMacro::calcBirthDeathWait (long iNumAlive)
+//: how long until the next event of a plain birth-death epoch?
+// Every living leaf has the same rates, so the wait is drawn from their
+// sum.
+{
+	assert (0 < iNumAlive);
+	return calcWaitFromRate (mBirthDeathRate * iNumAlive);
+}
+
+
+int EpochMacro::chooseBirthDeath (long iNumAlive, long& oLeafIndex)
+//: which rule of a plain birth-death epoch acts next, and on which leaf?
+// The rule in proportion to its rate and the leaf uniformly, by its place
+// in the tree's index of living leaves.
+{
+	int theChosen = int (chooseByRate (mBirthDeathRates, mBirthDeathRate));
+	oLeafIndex = MesaGlobals::mRng.UniformWhole (iNumAlive);
+	return theChosen;
+}
+
+
+evolevent_t EpochMacro::commitBirthDeath
+(int iRule, nodeiter_t iLeaf, mesatime_t iWait, nodearr_t& ioLeaves)
+//: after this wait, have this rule of a plain birth-death epoch act on a leaf
+{
+	// Preconditions:
+	assert ((0 <= iRule) and (iRule < int (theLocalRules.size())));
+	
+	// Main:
+	getActiveTreeP()->ageAllLeaves (iWait);
+	ioLeaves.clear();
+	ioLeaves.push_back (iLeaf);
+	LocalRule* theRuleP = theLocalRules[iRule];
+	theRuleP->commitAction (ioLeaves, iWait);
+	
+	// Postconditions & return:
+	return theRuleP->getEventKind ();
+}
+
+
+void EpochMacro::executeBirthDeath ()
+//: draw the whole of a plain birth-death epoch, then write it into the tree
+// Every living leaf has the same rates, so what becomes of a lineage
+// doesn't depend on the others or on the tree. To a time limit, the clade
+// of each living leaf is grown on its own (see growClades). A tree with
+// too few leaves to share out is first led in to enough (see
+// leadBirthDeath), whether or not they will be shared out, so the tree
+// doesn't depend on the number of processes. The event that takes the
+// tree over the limit is then drawn from the limit, as the waits are
+// memoryless. A count of tips, nodes or living leaves depends on
+// all lineages at once, so they are drawn together (see drawBirthDeath),
+// unless drawn already along with other replicates (see
+// simulateBirthDeath), which is used up by the first attempt. Either way,
+// the tree and the trait data are only touched once the draw is done (see
+// spliceBirthDeath). The tree isn't drawn from coalescence points, as that
+// gives only the tree of the survivors, where the epoch keeps its dead
+// leaves.
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	vector<nodeiter_t> theFounders;
+	theTreeP->getLiveLeaves (theFounders);
+	vector<char> theFlags;
+	flagBirthDeathFounders (theFounders, theFlags);
+	double theLimit;
+	bdmeasure_t theMeasure = getBirthDeathLimit (theLimit);
+	
+	if (theMeasure == kBdMeasure_Time)
+	{
+		assert (mDrawnP == NULL);
+		mesatime_t theLength = mesatime_t (theLimit) - theTreeP->getTreeAge ();
+		if (theFounders.empty() or (theLength <= 0.0))
+			return;
+		
+		if (long (theFounders.size()) < kMinCladesToSplit)
+		{
+			vector<BirthDeathLineage> theLineages;
+			mesatime_t theLeadIn = leadBirthDeath (theFlags, theLength, theLineages);
+			theTreeP->ageAllLeaves (theLeadIn);
+			spliceBirthDeath (theFounders, theLineages, theLeadIn);
+			theLength -= theLeadIn;
+			theFounders.clear();
+			theTreeP->getLiveLeaves (theFounders);
+			flagBirthDeathFounders (theFounders, theFlags);
+		}
+		
+		if ((not theFounders.empty()) and (0.0 < theLength))
+		{
+			vector< vector<BirthDeathLineage> > theClades;
+			growClades (theFlags, theLength, theClades);
+			theTreeP->ageAllLeaves (theLength);
+			for (vector<nodeiter_t>::size_type i = 0; i < theFounders.size(); i++)
+			{
+				vector<nodeiter_t> theNodes (1, theFounders[i]);
+				spliceBirthDeath (theNodes, theClades[i], theLength);
+			}
+		}
+		
+		long theNumAlive = long (theTreeP->countAliveLeaves ());
+		if (0 < theNumAlive)
+		{
+			mesatime_t theWait = calcBirthDeathWait (theNumAlive);
+			long theLeafIndex;
+			int theRule = chooseBirthDeath (theNumAlive, theLeafIndex);
+			nodearr_t theLeaves;
+			commitBirthDeath (theRule, theTreeP->getLiveLeaf (theLeafIndex),
+				theWait, theLeaves);
+		}
+	}
+	else
+	{
+		vector<BirthDeathLineage> theLineages;
+		mesatime_t theLength;
+		if (mDrawnP != NULL)
+		{
+			assert (theFounders.size() <= mDrawnP->mLineages.size());
+			theLength = mDrawnP->mLength;
+			theLineages.swap (mDrawnP->mLineages);
+			mDrawnP = NULL;
+		}
+		else
+			theLength = drawBirthDeath (theFlags, theLineages);
+		theTreeP->ageAllLeaves (theLength);
+		spliceBirthDeath (theFounders, theLineages, theLength);
+		if (advancesBirthDeath () and (theTreeP->countAliveLeaves() <= 0))
+			throw ExecutionError ("no living taxa");
+	}
+}
+
+
+void EpochMacro::flagBirthDeathFounders
+(vector<nodeiter_t>& iFounders, vector<char>& oFlags)
+//: mark which of these living leaves are the root or its children
+// As a kill may pass these over (see getUnkillableFlags).
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	nodeiter_t theRoot = theTreeP->getRoot ();
+	oFlags.clear();
+	vector<nodeiter_t>::iterator q;
+	for (q = iFounders.begin(); q != iFounders.end(); q++)
+	{
+		if (*q == theRoot)
+			oFlags.push_back (kLineage_Root);
+		else if (theTreeP->getParent (*q) == theRoot)
+			oFlags.push_back (kLineage_RootChild);
+		else
+			oFlags.push_back (0);
+	}
+}
+
+
+mesatime_t EpochMacro::drawBirthDeath
+(vector<char>& iFlags, vector<BirthDeathLineage>& oLineages)
+//: draw all the lineages of a plain birth-death epoch together
+// The founders, flagged as by flagBirthDeathFounders, are the living leaves
+// in the order of the tree's index. As the limit may depend on every
+// lineage at once, this goes event by event, but without the tree or the
+// rules, picking among the living lineages as the tree would among its
+// living leaves (see actOnLineage). Returns how long the epoch runs,
+// including any advance to the next event.
+{
+	// Preconditions:
+	assert (mBirthDeathUsable);
+	
+	// Main:
+	MesaTree* theTreeP = getActiveTreeP ();
+	double theLimit;
+	bdmeasure_t theMeasure = getBirthDeathLimit (theLimit);
+	mesatime_t theStartAge = 0.0;
+	if (theMeasure == kBdMeasure_Time)
+		theStartAge = theTreeP->getTreeAge ();
+	long theNumTips = 0;
+	if (theMeasure == kBdMeasure_Tips)
+		theNumTips = long (theTreeP->countLeaves ());
+	long theNumNodes = long (theTreeP->countNodes ());
+	char theUnkillable = getUnkillableFlags ();
+	
+	oLineages.clear();
+	vector<long> theAlive;
+	for (long i = 0; i < long (iFlags.size()); i++)
+	{
+		oLineages.push_back (BirthDeathLineage (0.0, -1, iFlags[i]));
+		theAlive.push_back (i);
+	}
+	
+	mesatime_t theTime = 0.0;
+	while (not theAlive.empty())
+	{
+		long theNumAlive = long (theAlive.size());
+		if (theLimit <= measureBirthDeath (theMeasure, theStartAge + theTime,
+				theNumNodes, theNumTips, theNumAlive))
+			break;
+		
+		theTime += calcBirthDeathWait (theNumAlive);
+		long theIndex;
+		int theRule = chooseBirthDeath (theNumAlive, theIndex);
+		bool theIsBirth = mBirthDeathBirths[theRule];
+		if (actOnLineage (oLineages, theAlive, theIndex, theIsBirth, theUnkillable,
+				theTime) and theIsBirth)
+		{
+			theNumTips += 1;
+			theNumNodes += 2;
+		}
+	}
+	
+	// the next event is always a speciation or extinction, so advancing to
+	// just before it is just its wait
+	if (advancesBirthDeath () and (not theAlive.empty()))
+		theTime += calcBirthDeathWait (long (theAlive.size()));
+	return theTime;
+}
+
+
+mesatime_t EpochMacro::leadBirthDeath
+(vector<char>& iFlags, mesatime_t iLength, vector<BirthDeathLineage>& oLineages)
+//: draw a timed plain birth-death epoch until there are clades to share out
+// As drawBirthDeath does, from the living leaves flagged as it expects,
+// until there are enough living lineages to grow apart or this long has
+// passed. Returns how long that took, the event that would have crossed
+// the end being dropped, as its wait is memoryless and drawn again.
+{
+	// Preconditions:
+	assert (mBirthDeathUsable);
+	
+	// Main:
+	char theUnkillable = getUnkillableFlags ();
+	oLineages.clear();
+	vector<long> theAlive;
+	for (long i = 0; i < long (iFlags.size()); i++)
+	{
+		oLineages.push_back (BirthDeathLineage (0.0, -1, iFlags[i]));
+		theAlive.push_back (i);
+	}
+	
+	mesatime_t theTime = 0.0;
+	while ((not theAlive.empty()) and (long (theAlive.size()) < kMinCladesToSplit))
+	{
+		long theNumAlive = long (theAlive.size());
+		mesatime_t theWait = calcBirthDeathWait (theNumAlive);
+		if (iLength <= theTime + theWait)
+			return iLength;
+		theTime += theWait;
+		long theIndex;
+		int theRule = chooseBirthDeath (theNumAlive, theIndex);
+		actOnLineage (oLineages, theAlive, theIndex, mBirthDeathBirths[theRule],
+			theUnkillable, theTime);
+	}
+	return theTime;
+}
+
+
+bool EpochMacro::canSplitClades ()
+//: can the clades of this epoch be grown in separate processes?
+// Not when already within a process farmed out by a run & restore, as
+// the processors are in use.
+{
+#ifdef MESA_CANFORK
+	return (1 < MesaGlobals::mPrefs.mNumWorkers) and
+		(not RunAndRestoreMacro::isInWorker ());
+#else
+	return false;
+#endif
+}
+
+
+void EpochMacro::growClades (vector<char>& iFlags, mesatime_t iLength,
+	vector< vector<BirthDeathLineage> >& oClades)
+//: grow the clade of every founder for this long, in parallel if worth it
+// The clades are shared out as pieces of work, each drawing on its own
+// stream split from one picked by the main generator, so the results
+// don't depend on whether or how the work was shared out. Where there are
+// enough clades, the pieces are held in a pipe that each process takes the
+// next from as soon as it is free, so a process that gets small clades
+// just takes more of them. Each process writes the lineages of its clades
+// to a temporary file, which is read back here once they have all finished.
+{
+	// Preconditions:
+	assert (0 < iFlags.size());
+	
+	// Main:
+	long theNumClades = long (iFlags.size());
+	unsigned long theFamilyId = (unsigned long) MesaGlobals::mRng.UniformWhole (2147483647L);
+	sbl::RandomService theCladeRng = MesaGlobals::mRng.Split (theFamilyId);
+	oClades.clear();
+	oClades.resize (theNumClades);
+	
+	long theNumTasks = std::min (theNumClades, kMaxCladeTasks);
+	
+#ifdef MESA_CANFORK
+	if ((kMinCladesToSplit <= theNumClades) and canSplitClades ())
+	{
+		int theNumWorkers = int (std::min (long (MesaGlobals::mPrefs.mNumWorkers),
+			theNumTasks));
+		
+		// queue up the work before anyone starts, so the pipe can be closed
+		// here & a process knows it is done when the pipe runs dry
+		int thePipe[2];
+		if (pipe (thePipe) != 0)
+			throw ExecutionError ("can't make queue for clades");
+		for (long t = 0; t < theNumTasks; t++)
+		{
+			if (not writeWhole (thePipe[1], &t, sizeof (t)))
+			{
+				close (thePipe[0]);
+				close (thePipe[1]);
+				throw ExecutionError ("can't make queue for clades");
+			}
+		}
+		close (thePipe[1]);
+		
+		// nothing buffered may be copied into the children
+		Reporter* theReporterP = MesaGlobals::mReporterP;
+		if (theReporterP != NULL)
+			theReporterP->flush();
+		std::cout.flush();
+		std::fflush (NULL);
+		
+		vector<std::FILE*>	theOuts;
+		vector<pid_t>			theWorkers;
+		bool						theIsFailed = false;
+		for (int w = 0; w < theNumWorkers; w++)
+		{
+			std::FILE* theOutP = std::tmpfile();
+			if (theOutP == NULL)
+			{
+				theIsFailed = true;
+				break;
+			}
+			theOuts.push_back (theOutP);
+			
+			pid_t thePid = fork();
+			if (thePid < 0)
+			{
+				theIsFailed = true;
+				break;
+			}
+			if (thePid == 0)
+			{
+				// the child: grow clades until there are no more
+				int theExitCode = 0;
+				try
+				{
+					vector<BirthDeathLineage> theLineages;
+					long t;
+					while (true)
+					{
+						ssize_t theNumRead = read (thePipe[0], &t, sizeof (t));
+						if ((theNumRead < 0) and (errno == EINTR))
+							continue;
+						if (theNumRead == 0)
+							break;
+						if (theNumRead != ssize_t (sizeof (t)))
+						{
+							theExitCode = 1;
+							break;
+						}
+						
+						sbl::RandomService theRng = theCladeRng.Split (t);
+						long theFirst = (t * theNumClades) / theNumTasks;
+						long theLast = ((t + 1) * theNumClades) / theNumTasks;
+						for (long i = theFirst; i < theLast; i++)
+						{
+							growClade (iFlags[i], iLength, theRng, theLineages);
+							long theNumLineages = long (theLineages.size());
+							if ((std::fwrite (&i, sizeof (i), 1, theOutP) != 1) or
+								(std::fwrite (&theNumLineages, sizeof (theNumLineages), 1,
+									theOutP) != 1) or
+								(std::fwrite (&theLineages[0], sizeof (BirthDeathLineage),
+									theNumLineages, theOutP) != size_t (theNumLineages)))
+								theExitCode = 1;
+						}
+					}
+					if (std::fflush (theOutP) != 0)
+						theExitCode = 1;
+				}
+				catch (...)
+				{
+					theExitCode = 1;
+				}
+				_exit (theExitCode);
+			}
+			theWorkers.push_back (thePid);
+		}
+		close (thePipe[0]);
+		
+		// wait for everyone, even after a failure
+		vector<pid_t>::iterator p;
+		for (p = theWorkers.begin(); p != theWorkers.end(); p++)
+		{
+			int theStatus = 0;
+			if ((waitpid (*p, &theStatus, 0) < 0) or (not WIFEXITED (theStatus)) or
+				(WEXITSTATUS (theStatus) != 0))
+				theIsFailed = true;
+		}
+		
+		// collect the clades
+		vector<bool> theIsGrown (theNumClades, false);
+		vector<std::FILE*>::iterator f;
+		for (f = theOuts.begin(); f != theOuts.end(); f++)
+		{
+			std::rewind (*f);
+			long i, theNumLineages;
+			while ((not theIsFailed) and (std::fread (&i, sizeof (i), 1, *f) == 1))
+			{
+				if ((std::fread (&theNumLineages, sizeof (theNumLineages), 1, *f) != 1) or
+					(i < 0) or (theNumClades <= i) or (theNumLineages < 1))
+				{
+					theIsFailed = true;
+					break;
+				}
+				oClades[i].resize (theNumLineages);
+				if (std::fread (&oClades[i][0], sizeof (BirthDeathLineage),
+						theNumLineages, *f) != size_t (theNumLineages))
+					theIsFailed = true;
+				theIsGrown[i] = true;
+			}
+			std::fclose (*f);
+		}
+		if (std::find (theIsGrown.begin(), theIsGrown.end(), false) != theIsGrown.end())
+			theIsFailed = true;
+		if (theIsFailed)
+			throw ExecutionError ("couldn't grow clades in parallel");
+		return;
+	}
+#endif
+	for (long t = 0; t < theNumTasks; t++)
+	{
+		sbl::RandomService theRng = theCladeRng.Split (t);
+		long theFirst = (t * theNumClades) / theNumTasks;
+		long theLast = ((t + 1) * theNumClades) / theNumTasks;
+		for (long i = theFirst; i < theLast; i++)
+			growClade (iFlags[i], iLength, theRng, oClades[i]);
 	}
-*/
 }
 
 
-void EpochMacro::executeEpochLoop ()
+void EpochMacro::growClade (char iFlags, mesatime_t iLength,
+	sbl::RandomService& ioRng, vector<BirthDeathLineage>& oLineages)
+//: grow the clade of a single founder for this long
+// Lineage by lineage rather than event by event: each draws its own
+// waits until it splits, dies or outlives the epoch, and any children are
+// added to the end to be drawn in turn, as a lineage's fate is independent
+// of all others. A kill that would pass over the founder, as with the
+// tree, is an event that changes nothing.
 {
-	// until end condition is reached execute rules
-	MesaTree* theTreeP = getActiveTreeP ();
-	while ((isAtEnd() == false) and (0 < theTreeP->countAliveLeaves ()))
+	// Preconditions:
+	assert (mBirthDeathUsable);
+	
+	// Main:
+	char theUnkillable = getUnkillableFlags ();
+	oLineages.clear();
+	oLineages.push_back (BirthDeathLineage (0.0, -1, iFlags));
+	for (vector<BirthDeathLineage>::size_type i = 0; i < oLineages.size(); i++)
 	{
-		// there must be taxa
-		// maybe this is ok, as there could be a global or cond that fires
-		theTreeP = getActiveTreeP ();
-		if (theTreeP->countLeaves() <= 0)
-			throw ExecutionError ("no living taxa");
-
-		executeEpochOnce ();
+		mesatime_t theTime = oLineages[i].mStart;
+		while (true)
+		{
+			theTime += calcWaitFromRate (mBirthDeathRate, ioRng);
+			if (iLength <= theTime)
+				break;
+			int theRule = int (chooseByRate (mBirthDeathRates, mBirthDeathRate, ioRng));
+			if (mBirthDeathBirths[theRule])
+			{
+				splitLineage (oLineages, long (i), theTime);
+				break;
+			}
+			if (not (oLineages[i].mFlags & theUnkillable))
+			{
+				endLineage (oLineages[i], kLineageFate_Dead, theTime);
+				break;
+			}
+		}
 	}
 }
 
 
-bool EpochMacro::hasSpeciationRules ()
+void EpochMacro::spliceBirthDeath (vector<nodeiter_t>& ioNodes,
+	vector<BirthDeathLineage>& iLineages, mesatime_t iLength)
+//: write the lineages drawn for a plain birth-death epoch into the tree
+// The nodes of the founders come first, in the order of their lineages,
+// and the nodes made for the rest are added. The tree clock must already
+// have been moved on to the end of the epoch, iLength after its start.
+// Each branch is set to its drawn length before its node speciates or
+// dies, so the clock then adds nothing to it, and a leaf that lives on is
+// set to its length at the end and left to age from there. The splits
+// are made in the order they were drawn in, so are the new taxa named.
 {
-	for (iterator q = begin (); q != end(); q++)
+	// Preconditions:
+	assert (0 < ioNodes.size());
+	assert (ioNodes.size() <= iLineages.size());
+	
+	// Main:
+	MesaTree* theTreeP = getActiveTreeP ();
+	long theNumFounders = long (ioNodes.size());
+	long theNumLineages = long (iLineages.size());
+	ioNodes.resize (theNumLineages);
+	
+	for (long j = theNumFounders; j < theNumLineages; j += 2)
 	{
-		if (isSpeciationRule ((EvolRule*) *q))
-			return true;
+		long theParent = iLineages[j].mParent;
+		nodeiter_t theNode = ioNodes[theParent];
+		setDrawnWeight (theTreeP, theNode, iLineages[theParent],
+			theParent < theNumFounders, iLength);
+		speciate (theNode);
+		ioNodes[j] = theTreeP->getChild (theNode, 0);
+		ioNodes[j + 1] = theTreeP->getChild (theNode, 1);
+	}
+	
+	for (long i = 0; i < theNumLineages; i++)
+	{
+		BirthDeathLineage& theLineage = iLineages[i];
+		if (theLineage.mFate == kLineageFate_Dead)
+		{
+			setDrawnWeight (theTreeP, ioNodes[i], theLineage, i < theNumFounders,
+				iLength);
+			theTreeP->killLeaf (ioNodes[i]);
+		}
+		else if ((theLineage.mFate == kLineageFate_Alive) and (theNumFounders <= i))
+		{
+			setDrawnWeight (theTreeP, ioNodes[i], theLineage, false, iLength);
+		}
 	}
-	return false;
 }
 
 
-bool EpochMacro::hasKillRules ()
+bool EpochMacro::canBatchBirthDeath ()
+//: can replicates of this epoch be drawn together before it is run?
+// Only if it is a plain birth-death process to a count, that won't return
+// at once from the current tree, as then execute() makes no draws at all.
+// To a time limit, the clades are already drawn lineage by lineage, with
+// nothing kept per event, and from a stream of their own (see growClades).
 {
-	for (iterator q = begin (); q != end(); q++)
-	{
-		if (isKillRule ((EvolRule*) *q))
-			return true;
-	}
-	return false;
+	if (begin() == end())
+		return false;
+	sortRules ();
+	if (not isDrawingBirthDeath ())
+		return false;
+	double theLimit;
+	if (getBirthDeathLimit (theLimit) == kBdMeasure_Time)
+		return false;
+	MesaTree* theTreeP = getActiveTreeP ();
+	return not (isAtEnd () or (theTreeP->countAliveLeaves () == 0));
 }
 
 
-
-void EpochMacro::sortRules ()
-//: gather the rules into the correct group for execution
+void EpochMacro::simulateBirthDeath
+(vector<sbl::RandomService>& ioRngs, vector<BirthDeathDraw>& oDraws)
+//: draw the whole of this epoch for many replicates at once
+// Each replicate starts from the current tree and draws on its own
+// generator in just the order drawBirthDeath would, so splicing its draw
+// in gives the same tree as running it. The replicates are advanced in
+// lock-step, with their clocks and counts in parallel arrays, so each pass
+// is a tight loop over those still running, free of rules and the tree.
+// A replicate that dies before it can advance is drawn all the same, as
+// executeBirthDeath then fails after splicing it in, as it would have.
 {
+	// Preconditions:
+	assert (mBirthDeathUsable);
+	assert (mDrawnP == NULL);
+	
 	// Main:
-	theLocalRules.clear();
-	theGlobalRules.clear();
-	theCondRules.clear();
+	// where every replicate starts
+	MesaTree* theTreeP = getActiveTreeP ();
+	double theLimit;
+	bdmeasure_t theMeasure = getBirthDeathLimit (theLimit);
+	assert (theMeasure != kBdMeasure_Time);
+	long theStartTips = 0;
+	if (theMeasure == kBdMeasure_Tips)
+		theStartTips = long (theTreeP->countLeaves ());
+	long theStartNodes = long (theTreeP->countNodes ());
 	
-	// for every rule
-	for (iterator q = begin (); q != end(); q++)
+	char theUnkillable = getUnkillableFlags ();
+	vector<nodeiter_t> theFounders;
+	theTreeP->getLiveLeaves (theFounders);
+	vector<char> theFlags;
+	flagBirthDeathFounders (theFounders, theFlags);
+	vector<long> theStartAlive;
+	for (long i = 0; i < long (theFlags.size()); i++)
+		theStartAlive.push_back (i);
+	
+	// the state of the replicates
+	vector<sbl::RandomService>::size_type theNumReps = ioRngs.size();
+	vector<mesatime_t>		theTimes (theNumReps, 0.0);
+	vector<long>				theNumTips (theNumReps, theStartTips);
+	vector<long>				theNumNodes (theNumReps, theStartNodes);
+	vector< vector<long> >	theAlive (theNumReps, theStartAlive);
+	vector<long>				theRunning;
+	oDraws.resize (theNumReps);
+	for (long i = 0; i < long (theNumReps); i++)
 	{
-		// if it's a local rule, cast & store
-		LocalRule* theLocalRuleP = castAsLocalRule (*q);
-		if (theLocalRuleP != NULL)
+		vector<BirthDeathLineage>& theLineages = oDraws[i].mLineages;
+		theLineages.clear();
+		for (long j = 0; j < long (theFlags.size()); j++)
+			theLineages.push_back (BirthDeathLineage (0.0, -1, theFlags[j]));
+		theRunning.push_back (i);
+	}
+	
+	while (not theRunning.empty())
+	{
+		// retire those that have reached the end, advancing them if need be
+		for (long k = long (theRunning.size()) - 1; 0 <= k; k--)
 		{
-			theLocalRules.push_back (theLocalRuleP);
-			continue;
+			long i = theRunning[k];
+			long theNumAlive = long (theAlive[i].size());
+			if ((0 < theNumAlive) and (measureBirthDeath (theMeasure, theTimes[i],
+					theNumNodes[i], theNumTips[i], theNumAlive) < theLimit))
+				continue;
+			if (advancesBirthDeath () and (0 < theNumAlive))
+				theTimes[i] += calcWaitFromRate (mBirthDeathRate * theNumAlive,
+					ioRngs[i]);
+			oDraws[i].mLength = theTimes[i];
+			theRunning[k] = theRunning.back();
+			theRunning.pop_back();
 		}
 		
-		// if it's a conditional, cast & store
-		ConditionalRule* theCondRuleP = castAsConditionalRule (*q);
-		if (theCondRuleP != NULL)
+		// draw the next wait of each ...
+		long theNumRunning = long (theRunning.size());
+		for (long k = 0; k < theNumRunning; k++)
 		{
-			theCondRules.push_back (theCondRuleP);
-			continue;
+			long i = theRunning[k];
+			theTimes[i] += calcWaitFromRate (mBirthDeathRate *
+				long (theAlive[i].size()), ioRngs[i]);
 		}
-			
-		// if it's a gloabl rule, cast & store
-		GlobalRule* theGlobalRuleP = castAsGlobalRule (*q);
-		if (theGlobalRuleP != NULL)
+		
+		// ... then what happens and to which lineage
+		for (long k = 0; k < theNumRunning; k++)
 		{
-			theGlobalRules.push_back (theGlobalRuleP);
-			continue;
+			long i = theRunning[k];
+			int theChosen = int (chooseByRate (mBirthDeathRates, mBirthDeathRate,
+				ioRngs[i]));
+			long theIndex = ioRngs[i].UniformWhole (long (theAlive[i].size()));
+			bool theIsBirth = mBirthDeathBirths[theChosen];
+			if (actOnLineage (oDraws[i].mLineages, theAlive[i], theIndex, theIsBirth,
+					theUnkillable, theTimes[i]) and theIsBirth)
+			{
+				theNumTips[i] += 1;
+				theNumNodes[i] += 2;
+			}
 		}
-		
-		// so what is it then? this shouldn't happen
-		assert (false);
 	}
-	
-	// Postcondition:
-	assert ((unsigned) size() == (unsigned) (theLocalRules.size() + theGlobalRules.size() + theCondRules.size()));
 }
 
 
-void EpochMacro::executeEpochOnce ()
+mesatime_t EpochMacro::calcTauRates (vector<mesatime_t>& oRates)
+//: the rate at which each local rule goes off over all leaves, & the sum
 {
-	// Preconditions & preparation:
-	MesaTree* theTreeP = getActiveTreeP ();
-	if (theTreeP->countAliveLeaves() <= 0)
-		throw ExecutionError ("no living taxa");
-	
-	// DBG_MSG ("tree size: " << theTreeP->countNodes());
-	
-	// Main:
-	// find the first rule to go off, the node it targets & time it takes
-	nodeiter_t   theFiringLeaf;
-	mesatime_t       theTimeToEvent;
-	EvolRule*    theFiringRuleP;
-	theFiringRuleP = findFirstRule (theFiringLeaf, theTimeToEvent);
-	assert (theFiringRuleP != NULL);
-	assert (0.0 <= theTimeToEvent);
-	
-	// execute it
-	nodearr_t theSubjectLeaves;
-	theSubjectLeaves.push_back (theFiringLeaf);
-	commitAction (theFiringRuleP, theSubjectLeaves, theTimeToEvent);
-	
-	// do conditionals
-	fireConditionals (theFiringRuleP, theSubjectLeaves, theTimeToEvent);
+	MesaTree::size_type theNumLeaves = getActiveTreeP()->countAliveLeaves();
+	oRates.clear();
+	mesatime_t theTotalRate = 0.0;
+	vector<LocalRule*>::iterator r;
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+	{
+		mesatime_t theRate = (*r)->calcUniformRate () * theNumLeaves;
+		assert (0.0 <= theRate);
+		oRates.push_back (theRate);
+		theTotalRate += theRate;
+	}
+	return theTotalRate;
 }
 
 
-EvolRule* EpochMacro::findFirstRule (nodeiter_t& oFiringLeaf, mesatime_t& oTime)
-//: find the rule, local or global, that goes off next
+void EpochMacro::executeTauLeap ()
+//: grow the tree approximately, by leaps of many events at a time
+// Over a leap the rates are taken as fixed, so the number of events under
+// each rule is Poisson. These are shuffled, spread over the leap at the
+// times of a uniform sample, and made one after another on leaves picked
+// from those alive at the time, so branch lengths stay sensible and a
+// count limit is stopped at exactly. A leap is kept short enough that
+// the number alive, and so the rates, change by no more than the
+// tolerance (see calcTauLeap). Should the rates change by more than that
+// number (as logistic rules can), the next leap is shortened to match,
+// and as they settle, leaps are let grow back by steps. Where a leap would
+// hold only a few events, events are made exactly. To a time limit, a leap
+// stops at the limit, so the event that crosses it, which the exact steps
+// and other engines make, is drawn afresh from there. The largest change
+// over any leap, the error bound in effect, is reported at the end.
 {
-	// Preconditions & arg preparation
+	// Preconditions:
+	assert (isTauLeaping ());
+	
+	// Main:
 	MesaTree* theTreeP = getActiveTreeP ();
-	// should be caught before here
-	assert (0 < theTreeP->countAliveLeaves());
-	oTime = 1000000; // TODO
-	oFiringLeaf = theTreeP->end();
-	EvolRule* theFiringRuleP = NULL;
-
-	// Main:	
-	// gather the leaves & shuffle them
-	// this sucks massively as a way to do it, but there's no other
-	// way to assess the taxa in a random order
-	typedef vector<nodeiter_t>	nodearr_t;
-	nodearr_t theLeaves;
-	theTreeP->getLiveLeaves (theLeaves);
-	assert (0 < theLeaves.size());
-	random_shuffle (theLeaves.begin(), theLeaves.end());
+	double theLimit;
+	bdmeasure_t theMeasure = getBirthDeathLimit (theLimit);
+	mesatime_t theAge = 0.0;
+	if (theMeasure == kBdMeasure_Time)
+		theAge = theTreeP->getTreeAge ();
+	long theNumTips = 0;
+	if (theMeasure == kBdMeasure_Tips)
+		theNumTips = long (theTreeP->countLeaves ());
+	long theNumNodes = long (theTreeP->countNodes ());
 	
-	// which local rule combinations fires off?
-	// for each local rule and species/leaf combination
-	random_shuffle (theLocalRules.begin(), theLocalRules.end());
-	for (nodearr_t::iterator q = theLeaves.begin(); q != theLeaves.end(); q++)
+	vector<int> theChanges;
+	vector<LocalRule*>::iterator r;
+	for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+		theChanges.push_back (((*r)->getEventKind () == kEvolEvent_Speciation) ? 1 : -1);
+	
+	vector<mesatime_t>	theRates;
+	vector<mesatime_t>	theNewRates;
+	vector<int>			theLeapRules;
+	vector<mesatime_t>	theLeapTimes;
+	nodearr_t			theLeaves;
+	double				theScale = 1.0;
+	double				theMaxChange = 0.0;
+	long					theNumExact = 0;
+	
+	while (0 < theTreeP->countAliveLeaves ())
 	{
-		// test every rule to find the "soonest" one
-		vector<LocalRule*>::iterator r;
-		for (r = theLocalRules.begin(); r != theLocalRules.end(); r++)
+		long theNumAlive = long (theTreeP->countAliveLeaves ());
+		if (theLimit <= measureBirthDeath (theMeasure, theAge, theNumNodes,
+				theNumTips, theNumAlive))
+			break;
+		
+		mesatime_t theTotalRate = calcTauRates (theRates);
+		if (theTotalRate <= 0.0)
 		{
-			mesatime_t theCurrWait = (*r)->calcNextWait (*q);
-			assert (0.0 <= theCurrWait);
-			if (theCurrWait < oTime)
+			// nothing more can happen
+			if (theMeasure != kBdMeasure_Time)
+				throw ExecutionError ("epoch can't reach its limit as no events can happen");
+			theTreeP->ageAllLeaves (mesatime_t (theLimit) - theAge);
+			break;
+		}
+		
+		// how long a leap can be, if it is worth one
+		mesatime_t theLeap = 0.0;
+		if (theNumExact <= 0)
+		{
+			theLeap = calcTauLeap (theRates, theChanges, theNumAlive,
+				theScale * mTauTolerance);
+			if (theMeasure == kBdMeasure_Time)
+				theLeap = std::min (theLeap, mesatime_t (theLimit) - theAge);
+			if (theLeap * theTotalRate < kMinLeapEvents)
+				theNumExact = kNumExactSteps;
+		}
+		
+		if (0 < theNumExact)
+		{
+			theNumExact--;
+			mesatime_t theWait = calcWaitFromRate (theTotalRate);
+			int theChosen = int (chooseByRate (theRates, theTotalRate));
+			nodeiter_t theLeaf = theTreeP->getLiveLeaf (
+				MesaGlobals::mRng.UniformWhole (theNumAlive));
+			if (commitBirthDeath (theChosen, theLeaf, theWait, theLeaves) ==
+					kEvolEvent_Speciation)
 			{
-				oTime = theCurrWait;
-				theFiringRuleP = *r;
-				oFiringLeaf = *q;
+				theNumTips += 1;
+				theNumNodes += 2;
 			}
+			theAge += theWait;
+			continue;
 		}
-	}
-	
-	// assess global rules and choose which happens
-	// test every rule to find the "soonest" one
-	random_shuffle (theGlobalRules.begin(), theGlobalRules.end());
-	vector<GlobalRule*>::iterator t;
-	for (t = theGlobalRules.begin(); t != theGlobalRules.end(); t++)
-	{
-		mesatime_t theCurrWait = (*t)->calcNextWait ();
-		if (theCurrWait < oTime)
+		
+		// what happens over the leap & in what order ...
+		theLeapRules.clear();
+		for (vector<mesatime_t>::size_type i = 0; i < theRates.size(); i++)
+			theLeapRules.insert (theLeapRules.end(),
+				MesaGlobals::mRng.PoissonWhole (theRates[i] * theLeap), int (i));
+		MesaGlobals::mRng.Shuffle (theLeapRules.begin(), theLeapRules.end());
+		
+		// ... and when, as sorted uniforms from the sums of exponentials
+		vector<int>::size_type theNumEvents = theLeapRules.size();
+		theLeapTimes.resize (theNumEvents + 1);
+		mesatime_t theSum = 0.0;
+		for (vector<mesatime_t>::size_type i = 0; i <= theNumEvents; i++)
 		{
-			oTime = theCurrWait;
-			theFiringRuleP = *t;
+			theSum += MesaGlobals::mRng.StdExponential ();
+			theLeapTimes[i] = theSum;
+		}
+		
+		mesatime_t theLeapAge = 0.0;
+		bool theIsAtLimit = false;
+		for (vector<int>::size_type i = 0; i < theNumEvents; i++)
+		{
+			long theNumLeft = long (theTreeP->countAliveLeaves ());
+			if (theNumLeft <= 0)
+				break;
+			mesatime_t theTime = theLeap * (theLeapTimes[i] / theSum);
+			nodeiter_t theLeaf = theTreeP->getLiveLeaf (
+				MesaGlobals::mRng.UniformWhole (theNumLeft));
+			if (commitBirthDeath (theLeapRules[i], theLeaf, theTime - theLeapAge,
+					theLeaves) == kEvolEvent_Speciation)
+			{
+				theNumTips += 1;
+				theNumNodes += 2;
+			}
+			theLeapAge = theTime;
+			if ((theMeasure != kBdMeasure_Time) and (theLimit <= measureBirthDeath
+					(theMeasure, theAge, theNumNodes, theNumTips,
+					long (theTreeP->countAliveLeaves ()))))
+			{
+				theIsAtLimit = true;
+				break;
+			}
+		}
+		if ((not theIsAtLimit) and (0 < theTreeP->countAliveLeaves ()))
+		{
+			theTreeP->ageAllLeaves (theLeap - theLeapAge);
+			theLeapAge = theLeap;
+		}
+		theAge += theLeapAge;
+		
+		// how far the rates moved, & if by more than the number alive did,
+		// shorten the next leap to match, else let it grow back
+		long theNewNumAlive = long (theTreeP->countAliveLeaves ());
+		if (0 < theNewNumAlive)
+		{
+			mesatime_t theNewTotalRate = calcTauRates (theNewRates);
+			double theChange = 0.0;
+			for (vector<mesatime_t>::size_type i = 0; i < theRates.size(); i++)
+				theChange += std::fabs (theNewRates[i] - theRates[i]);
+			theChange /= theTotalRate;
+			theMaxChange = std::max (theMaxChange, theChange);
+			double theAliveChange =
+				std::fabs (double (theNewNumAlive - theNumAlive)) / theNumAlive;
+			double theTarget = 1.0;
+			if (theAliveChange < theChange)
+				theTarget = theAliveChange / theChange;
+			theScale = std::min (theTarget, theScale * kTauScaleGrowth);
+			
+			// a leap that reached the time limit
+			if ((theMeasure == kBdMeasure_Time) and (theLimit <= theAge) and
+					(0.0 < theNewTotalRate))
+			{
+				mesatime_t theWait = calcWaitFromRate (theNewTotalRate);
+				int theChosen = int (chooseByRate (theNewRates, theNewTotalRate));
+				nodeiter_t theLeaf = theTreeP->getLiveLeaf (
+					MesaGlobals::mRng.UniformWhole (theNewNumAlive));
+				commitBirthDeath (theChosen, theLeaf, theWait, theLeaves);
+				theAge += theWait;
+			}
 		}
 	}
 	
-	// Postconditions & return:
-	if (oTime <= 0.0)
-		DBG_MSG ("Arghhhhhhh");
-	assert (0.0 < oTime);
-	return theFiringRuleP;
-}
-
- 
-void EpochMacro::commitAction
-(EvolRule* iRuleP, nodearr_t& ioLeaves, mesatime_t iTime)
-//: execute the chosen rule
-// returns a vector of the leaves it operated on
-{
-	MesaTree* theTreeP = getActiveTreeP ();
-	// in case there are no rules programmed
-	assert (iRuleP != NULL);
-
-	// age all the leaves to the point where it happens
-	// TO DO: we're not aging twice are we
-	theTreeP->ageAllLeaves (iTime);		
-	iRuleP->commitAction (ioLeaves, iTime);
-}
-
-
-void EpochMacro::fireConditionals (EvolRule* iRuleP, nodearr_t& ioLeaves, mesatime_t iTime)
-//: search the conditionals for any that are fired and do them
-{
-	/*
-	if (dynamic_cast<NullRule*> (iRuleP) != NULL)
-	{
-		DBG_MSG ("metronome")
-	}
-	else
+	// the next event is always a speciation or extinction, so advancing to
+	// just before it is just its wait
+	if (advancesBirthDeath ())
 	{
-		DBG_MSG ("system event");
+		if (theTreeP->countAliveLeaves() <= 0)
+			throw ExecutionError ("no living taxa");
+		theTreeP->ageAllLeaves (calcWaitFromRate (calcTauRates (theRates)));
 	}
-	*/
-		
-	random_shuffle (theCondRules.begin(), theCondRules.end());
-	vector<ConditionalRule*>::iterator s;
 	
-	for (s = theCondRules.begin(); s != theCondRules.end(); s++)
-	{
-		// shuffle leaf array only if necessary (i.e. more than 1 leaf)
-		if (1 < ioLeaves.size())
-			random_shuffle (ioLeaves.begin(), ioLeaves.end());
-		// DBG_MSG ("number of leaves: " << ioLeaves.size());
-		// DBG_MSG ("firing rule address: " << iRuleP);
-		if ((*s)->isTriggered (iRuleP, ioLeaves)) // TO DO: complete hack
-		{
-			// DBG_MSG ("is triggered");
-			(*s)->commitAction (ioLeaves, iTime);
-		}
-	}
+	MesaGlobals::mReporterP->print (theMaxChange, "tau-leaping error bound");
 }
 
+
 const char* EpochMacro::describe (size_type iIndex)
 {
 	// Preconditions:
@@ -337,6 +1812,17 @@ const char* EpochMacro::describe (size_type iIndex)
 	{
 		theBuffer = "epoch: ";
 		theBuffer += describeEpoch ();
+		if (mEngine != kEpochEngine_Classic)
+		{
+			theBuffer += " [";
+			theBuffer += kEpochEngine_Cstrs[mEngine];
+			if (mEngine == kEpochEngine_TauLeap)
+			{
+				theBuffer += ", tolerance ";
+				theBuffer += toString (mTauTolerance);
+			}
+			theBuffer += "]";
+		}
 		return theBuffer.c_str();
 	}
 	else
@@ -473,6 +1959,28 @@ void EpochPopLimit::executeEpochLoop ()
 }
 
 
+bdmeasure_t EpochPopLimit::getBirthDeathLimit (double& oLimit)
+//: what a plain birth-death process counts up to in this epoch
+{
+	oLimit = double (mPopLimit);
+	switch (mNodeType)
+	{
+		case kNodetype_All:
+			return kBdMeasure_Nodes;
+			
+		case kNodetype_Tips:
+			return kBdMeasure_Tips;
+			
+		case kNodetype_Living:
+			return kBdMeasure_Alive;
+			
+		default:
+			assert (false);
+			return kBdMeasure_Alive;
+	}
+}
+
+
 /*
 void EpochPopLimit::execute ()
 {
@@ -581,6 +2089,14 @@ bool EpochTimeLimit::isAtEnd ()
 }
 
 
+bdmeasure_t EpochTimeLimit::getBirthDeathLimit (double& oLimit)
+//: what a plain birth-death process counts up to in this epoch
+{
+	oLimit = mTimeLimit;
+	return kBdMeasure_Time;
+}
+
+
 const char* EpochTimeLimit::describeEpoch ()
 {
 	static std::string theDescStr;
@@ -18,18 +18,109 @@ Credits:
 
 #include "Macro.h"
 #include "EvolRule.h"
+#include "XIndexedHeap.h"
+#include <utility>
 
 
 // *** CONSTANTS & DEFINES
 
+// HOW THE NEXT EVENT IS CHOSEN
+enum epochengine_t
+{
+	kEpochEngine_Classic = 0,     // a wait for every leaf & rule
+	kEpochEngine_Direct,          // one wait from the summed rates
+	kEpochEngine_NextReaction,    // keep waits, redraw for changed leaves
+	kEpochEngine_TauLeap          // approximate, many events per leap
+};
+
+static const char* kEpochEngine_Cstrs [] =
+{
+	"classic engine",
+	"direct-method engine",
+	"next-reaction engine",
+	"tau-leaping engine"
+};
+
+// the largest relative change in rates a leap may make, unless set
+static const double kDefaultTauTolerance = 0.03;
+
+// a leaf id and the index of a rule acting on it
+typedef std::pair<MesaTree::id_type, int>   schedkey_t;
+
+// WHAT A PLAIN BIRTH-DEATH EPOCH COUNTS UP TO
+enum bdmeasure_t
+{
+	kBdMeasure_Time = 0,
+	kBdMeasure_Nodes,
+	kBdMeasure_Tips,
+	kBdMeasure_Alive
+};
+
+// WHAT BECAME OF A LINEAGE DRAWN APART FROM THE TREE
+enum lineagefate_t
+{
+	kLineageFate_Alive = 0,
+	kLineageFate_Split,
+	kLineageFate_Dead
+};
+
+// the lineages that a kill may pass over
+static const char kLineage_Root = 1;
+static const char kLineage_RootChild = 2;
+
+
 // *** CLASS DECLARATION *************************************************/
 
+struct BirthDeathLineage
+//: a lineage of a plain birth-death epoch, drawn apart from the tree
+// Lineages are numbered as they arise, the founders (the living leaves the
+// epoch starts from) first and the two children of a speciation one after
+// the other, so a lineage always comes after its parent. Times are from
+// the start of the epoch.
+{
+	BirthDeathLineage (mesatime_t iStart = 0.0, long iParent = -1, char iFlags = 0)
+		: mStart (iStart)
+		, mEnd (0.0)
+		, mParent (iParent)
+		, mFate (kLineageFate_Alive)
+		, mFlags (iFlags)
+		{}
+	
+	mesatime_t	mStart;
+	mesatime_t	mEnd;       // when it split or died, if it did
+	long			mParent;    // -1 for a founder
+	char			mFate;      // a lineagefate_t
+	char			mFlags;     // whether it is the root or a child of it
+};
+
+
+struct BirthDeathDraw
+//: the whole of one replicate of a plain birth-death epoch, drawn ahead
+// So many replicates can be drawn together, then each spliced into the
+// tree in turn (see EpochMacro::simulateBirthDeath).
+{
+	mesatime_t								mLength;   // including any advance
+	std::vector<BirthDeathLineage>	mLineages;
+};
+
+
 class EpochMacro: public BasicMacro
 //: a macro that runs the contained events as a simulation
 {
 public:
 	// LIFECYCLE
 	EpochMacro ()
+		: mRestartIfDead (false)
+		, mEngine (kEpochEngine_Classic)
+		, mTauTolerance (kDefaultTauTolerance)
+		, mDirectUsable (false)
+		, mBirthDeathUsable (false)
+		, mBirthDeathRate (0.0)
+		, mDrawnP (NULL)
+		, mTauUsable (false)
+		, mScheduleUsable (false)
+		, mScheduleValid (false)
+		, mScheduleClock (0.0)
 		{}
 	virtual ~EpochMacro ()
 		{}
@@ -37,19 +128,41 @@ public:
 	// ACESSORS
 	bool hasSpeciationRules ();
 	bool hasKillRules ();
+	epochengine_t getEngine ()
+		{ return mEngine; }
+	void setEngine (epochengine_t iEngine)
+		{ mEngine = iEngine; }
+	double getTauTolerance ()
+		{ return mTauTolerance; }
+	void setTauTolerance (double iTolerance)
+		{ mTauTolerance = iTolerance; }
 
 	
 	// SERVICES
 	virtual void	execute ();
 	virtual void   executeEpochLoop ();
 	virtual void	executeEpochOnce ();
+	void			executeBirthDeath ();
+	void			executeTauLeap ();
 
 	void			sortRules ();
 	EvolRule*	findFirstRule (nodeiter_t& oFiringLeaf, mesatime_t& oTime);
+	EvolRule*	findFirstRuleDirect (nodeiter_t& oFiringLeaf, mesatime_t& oTime);
+	EvolRule*	findFirstRuleScheduled (nodeiter_t& oFiringLeaf, mesatime_t& oTime);
 	void			commitAction (EvolRule* iRuleP, nodearr_t& ioLeafI, mesatime_t iTime);
 	void			fireConditionals (EvolRule* iRuleP, nodearr_t& ioLeafI, mesatime_t iTime);
 
 	virtual bool isAtEnd () { assert (false); return true; }
+	virtual bdmeasure_t getBirthDeathLimit (double& oLimit)
+		{ assert (false); oLimit = 0.0; return kBdMeasure_Time; }
+	virtual bool advancesBirthDeath ()
+		{ return false; }
+	
+	bool			canBatchBirthDeath ();
+	void			simulateBirthDeath (std::vector<sbl::RandomService>& ioRngs,
+						std::vector<BirthDeathDraw>& oDraws);
+	void			setBirthDeathDraw (BirthDeathDraw* iDrawP)
+		{ mDrawnP = iDrawP; }
 	
 	// I/O
 	const char* describe (size_type iIndex);
@@ -61,11 +174,64 @@ public:
 
 	// INTERNALS
    bool mRestartIfDead;
+	epochengine_t mEngine;
+	double mTauTolerance;
 
 private:
 	std::vector<LocalRule*>			theLocalRules;
 	std::vector<GlobalRule*>		theGlobalRules;
 	std::vector<ConditionalRule*>	theCondRules;
+	// the conditionals that respond to each kind of event
+	std::vector<ConditionalRule*>	mCondRulesByEvent [kEvolEvent_Count];
+	
+	bool							mDirectUsable;
+	std::vector<mesatime_t>	mDirectRates;
+	
+	bool							mBirthDeathUsable;
+	mesatime_t					mBirthDeathRate;
+	std::vector<mesatime_t>	mBirthDeathRates;
+	std::vector<bool>			mBirthDeathBirths;
+	BirthDeathDraw*			mDrawnP;
+	
+	bool							mTauUsable;
+	
+	bool							mScheduleUsable;
+	bool							mScheduleValid;
+	mesatime_t					mScheduleClock;
+	std::vector<LocalRule*>	mScheduledRules;
+	std::vector<LocalRule*>	mPooledRules;
+	sbl::XIndexedHeap<schedkey_t>	mSchedule;
+	
+	bool	isScheduling ()
+		{ return (mEngine == kEpochEngine_NextReaction) and mScheduleUsable; }
+	void	executeAttempt ();
+	bool	isTauLeaping ()
+		{ return (mEngine == kEpochEngine_TauLeap) and mTauUsable; }
+	bool	isDrawingBirthDeath ()
+		{ return (mEngine == kEpochEngine_Direct) and mBirthDeathUsable; }
+	mesatime_t	calcTauRates (std::vector<mesatime_t>& oRates);
+	void	buildSchedule ();
+	void	rescheduleLeaf (nodeiter_t iLeafIter);
+	void	rescheduleTraitRules (nodearr_t& iLeaves);
+	void	updateSchedule (nodearr_t& iLeaves);
+	mesatime_t	calcBirthDeathWait (long iNumAlive);
+	int			chooseBirthDeath (long iNumAlive, long& oLeafIndex);
+	evolevent_t	commitBirthDeath (int iRule, nodeiter_t iLeaf, mesatime_t iWait,
+						nodearr_t& ioLeaves);
+	void			flagBirthDeathFounders (std::vector<nodeiter_t>& iFounders,
+						std::vector<char>& oFlags);
+	mesatime_t	drawBirthDeath (std::vector<char>& iFlags,
+						std::vector<BirthDeathLineage>& oLineages);
+	mesatime_t	leadBirthDeath (std::vector<char>& iFlags, mesatime_t iLength,
+						std::vector<BirthDeathLineage>& oLineages);
+	void			spliceBirthDeath (std::vector<nodeiter_t>& ioNodes,
+						std::vector<BirthDeathLineage>& iLineages, mesatime_t iLength);
+	
+	bool	canSplitClades ();
+	void	growClades (std::vector<char>& iFlags, mesatime_t iLength,
+				std::vector< std::vector<BirthDeathLineage> >& oClades);
+	void	growClade (char iFlags, mesatime_t iLength, sbl::RandomService& ioRng,
+				std::vector<BirthDeathLineage>& oLineages);
 };
 
 
@@ -77,11 +243,14 @@ public:
 		: mPopLimit (iPopLimit)
 		, mAdvance (iAdvance)
 		, mNodeType (iNodeType)
-		{ assert (0 < mPopLimit); }
+		{ assert (0 < mPopLimit); mRestartIfDead = iRestart; }
 
 	// SERVICES
 	bool	isAtEnd ();
 	void	executeEpochLoop ();
+	bdmeasure_t getBirthDeathLimit (double& oLimit);
+	bool	advancesBirthDeath ()
+		{ return mAdvance; }
 
 	// I/O
 	const char* describeEpoch ();
@@ -105,6 +274,7 @@ public:
 
 	// SERVICES
 	bool	isAtEnd ();
+	bdmeasure_t getBirthDeathLimit (double& oLimit);
 
 	// I/O
 	const char* describeEpoch ();
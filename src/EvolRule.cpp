@@ -93,6 +93,13 @@ mesatime_t GlobalRule::calcNextWait ()
 	return -13.0;
 }
 
+mesatime_t GlobalRule::calcRate ()
+//: the instantaneous rate, for rules with exponentially distributed waits
+{
+	assert (false);
+	return -13.0;
+}
+
 
 const char* GlobalRule::describeRule ()
 {
@@ -104,6 +111,13 @@ const char* GlobalRule::describeRule ()
 // *** CLASS DEFINITION **************************************************/
 
 
+mesatime_t LocalRule::calcUniformRate ()
+//: the per-leaf rate, for rules where every leaf shares the same rate
+{
+	assert (false);
+	return 0.0;
+}
+
 mesatime_t LocalRule::calcNextWait (nodeiter_t iLeafIter)
 { 
 	iLeafIter = iLeafIter;
@@ -195,9 +209,8 @@ const char* MarkovSpRule::describeRule ()
 
 // *** CLASS DEFINITION **************************************************/
 
-mesatime_t LogisticSpRule::calcNextWait (nodeiter_t iLeafIter)
+mesatime_t LogisticSpRule::calcUniformRate ()
 {
-	iLeafIter = iLeafIter; // to shut compiler up
    MesaTree* theTreeP = getActiveTreeP ();
    int extant_taxa_cnt = theTreeP->countAliveLeaves();
    double actual_rate = mRate * (1.0 - (double (extant_taxa_cnt) / double (mCapacity)));
@@ -205,7 +218,13 @@ mesatime_t LogisticSpRule::calcNextWait (nodeiter_t iLeafIter)
    {
       actual_rate = 0.0;
    }
-	mesatime_t theWait = calcWaitFromRate (actual_rate);
+	return actual_rate;
+}
+
+mesatime_t LogisticSpRule::calcNextWait (nodeiter_t iLeafIter)
+{
+	iLeafIter = iLeafIter; // to shut compiler up
+	mesatime_t theWait = calcWaitFromRate (calcUniformRate ());
 	assert (0.0 <= theWait);
 	return theWait;
 }
@@ -238,6 +257,15 @@ mesatime_t AgeBiasedSpRule::calcNextWait (nodeiter_t iLeafIter)
 	return theWait;
 }
 
+mesatime_t AgeBiasedSpRule::calcScheduledWait (nodeiter_t iLeafIter)
+//: the wait until speciation, allowing for the rate changing as the leaf ages
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	double theAge = theTreeP->getEdgeWeight (iLeafIter);
+	return calcWaitFromAgeRate (mRateA, mRateB, mRateC, theAge,
+		MesaGlobals::mPrefs.mTimeGrain);
+}
+
 void AgeBiasedSpRule::commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime)
 {
 	iTime = iTime;
@@ -318,6 +346,13 @@ mesatime_t CharBiasedSpRule_New::calcNextWait (nodeiter_t iLeafIter)
 	return theWait;
 }
 
+bool CharBiasedSpRule_New::isLeafDependent ()
+//: is the rate fixed for a leaf until that leaf changes?
+// Not if it depends on age, which changes continuously.
+{
+	return not mRateP->isAgeDependent ();
+}
+
 void CharBiasedSpRule_New::commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime)
 {
 	iTime = iTime;
@@ -391,6 +426,14 @@ mesatime_t BiasedKillRule::calcNextWait (nodeiter_t iLeafIter)
 	return theWait;
 }
 
+mesatime_t BiasedKillRule::calcScheduledWait (nodeiter_t iLeafIter)
+//: the wait until extinction, allowing for the rate changing as the leaf ages
+{
+	MesaTree* theTreeP = getActiveTreeP ();
+	double theAge = theTreeP->getEdgeWeight (iLeafIter);
+	return calcWaitFromAgeRate (mRateA, mRateB, mRateC, theAge, 0.0);
+}
+
 void BiasedKillRule::commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime)
 {
 	iTime = iTime;
@@ -426,7 +469,7 @@ mesatime_t LatentSpRule::calcNextWait (nodeiter_t iLeafIter)
 	iLeafIter = iLeafIter;
 	mesatime_t theWait = calcWaitFromRate (mRate);
 	assert (0.0 <= theWait);
-	mesatime_t theLatency = mLatencyPeriod - iLeafIter->second.getWeight();
+	mesatime_t theLatency = mLatencyPeriod - getActiveTreeP()->getEdgeWeight (iLeafIter);
 	if (theLatency < 0)
 		theLatency = 0;
 	// TO DO: nasty - fix this.
@@ -494,9 +537,8 @@ const char* MarkovKillRule::describeRule ()
 // *** CLASS DEFINITION **************************************************/
 
 
-mesatime_t LogisticKillRule::calcNextWait (nodeiter_t iLeafIter)
+mesatime_t LogisticKillRule::calcUniformRate ()
 {
-	iLeafIter = iLeafIter; // to shut compiler up
    MesaTree* theTreeP = getActiveTreeP ();
    int extant_taxa_cnt = theTreeP->countAliveLeaves();
    
@@ -509,7 +551,13 @@ mesatime_t LogisticKillRule::calcNextWait (nodeiter_t iLeafIter)
    {
       actual_rate = mRate;
    }
-	mesatime_t theWait = calcWaitFromRate (actual_rate);
+	return actual_rate;
+}
+
+mesatime_t LogisticKillRule::calcNextWait (nodeiter_t iLeafIter)
+{
+	iLeafIter = iLeafIter; // to shut compiler up
+	mesatime_t theWait = calcWaitFromRate (calcUniformRate ());
 	assert (0.0 <= theWait);
 	return theWait;
 }
@@ -568,13 +616,10 @@ const char* MassKillRule::describeRule ()
 
 nodearr_t MassKillFixedNumRule::selectTargets ()
 {
-	// get the live nodes, shuffle them and take the first N
+	// take a random N of the live nodes
 	MesaTree* theTreeP = getActiveTreeP ();
 	nodearr_t theTargets;
-	theTreeP->getLiveLeaves (theTargets);
-	random_shuffle (theTargets.begin(), theTargets.end());
-	if ((unsigned) mAbsNum < theTargets.size())
-		theTargets.resize (mAbsNum);
+	theTreeP->sampleLiveLeaves (MesaTree::size_type (mAbsNum), theTargets);
 		
 	return theTargets; 
 }
@@ -588,13 +633,11 @@ const char* MassKillFixedNumRule::describeRule ()
 
 nodearr_t MassKillPercentRule::selectTargets ()
 {
-	// get the live nodes, shuffle them and take the first N percent
+	// take a random N percent of the live nodes
 	MesaTree* theTreeP = getActiveTreeP ();
 	nodearr_t theTargets;
-	theTreeP->getLiveLeaves (theTargets);
-	nodearr_t::size_type theKillNum = (nodearr_t::size_type) (theTargets.size() * mPercent);
-	random_shuffle (theTargets.begin(), theTargets.end());
-	theTargets.resize (theKillNum);
+	nodearr_t::size_type theKillNum = (nodearr_t::size_type) (theTreeP->countAliveLeaves() * mPercent);
+	theTreeP->sampleLiveLeaves (theKillNum, theTargets);
 		
 	return theTargets; 
 }
@@ -715,6 +758,13 @@ time_t calcWaitFromRate (time_t iRate)
 
 mesatime_t calcWaitFromRate (mesatime_t iRate)
 //: take an instantaneous rate and convert it to a time-until-event
+{
+	return calcWaitFromRate (iRate, MesaGlobals::mRng);
+}
+
+
+mesatime_t calcWaitFromRate (mesatime_t iRate, sbl::RandomService& ioRng)
+//: as above, but drawing on this generator
 {
 	// Preconditions:
 	assert (0.0 <= iRate);
@@ -722,9 +772,7 @@ mesatime_t calcWaitFromRate (mesatime_t iRate)
 		return 10000; // TO DO: complete hack to cope with stationary rules
 	
 	// Main:
-	double theProb = MesaGlobals::mRng.UniformFloat ();
-	mesatime_t theTime = -log (theProb) / iRate;
-	// DBG_MSG ("\t" << theProb << "\t" << theTime << "\t" << iRate);
+	mesatime_t theTime = ioRng.StdExponential () / iRate;
 	assert (0.0 <= theTime);
 	theTime = std::max (theTime, MesaGlobals::mPrefs.mTimeGrain);
 		
@@ -732,6 +780,52 @@ mesatime_t calcWaitFromRate (mesatime_t iRate)
 }
 
 
+mesatime_t calcWaitFromAgeRate
+(double iA, double iB, double iC, mesatime_t iAge, mesatime_t iMinAge)
+//: the time until an event whose rate is a tri-parameter function of age
+// The rate is integrated forward from the current age, in steps short
+// enough that it changes little over each, until the accumulated hazard
+// passes an exponential deviate. This is the continuous version of what
+// the classic engine does by reassessing the rate at every event.
+{
+	// Preconditions & preparation:
+	assert (0.0 <= iAge);
+	const mesatime_t kMaxWait = 10000; // as per calcWaitFromRate
+	const double kStepHazard = 0.05;
+	mesatime_t theGrain = MesaGlobals::mPrefs.mTimeGrain;
+	double theTarget = MesaGlobals::mRng.StdExponential ();
+	double theHazard = 0.0;
+	mesatime_t theWait = 0.0;
+	mesatime_t theStep = theGrain;
+	
+	// Main:
+	while (theWait < kMaxWait)
+	{
+		// size the step so little hazard accrues over it
+		double theStartRate = calcRateFromTriParameter (iA, iB, iC,
+			std::max (iAge + theWait, iMinAge));
+		if (0.0 < theStartRate)
+			theStep = std::max (kStepHazard / theStartRate, theGrain);
+		else
+			theStep = std::max (2.0 * theStep, theGrain);
+		
+		// use the rate at the middle of the step
+		double theRate = calcRateFromTriParameter (iA, iB, iC,
+			std::max (iAge + theWait + (theStep / 2.0), iMinAge));
+		if (theTarget <= theHazard + (theRate * theStep))
+		{
+			theWait += (theTarget - theHazard) / theRate;
+			return std::max (theWait, theGrain);
+		}
+		theHazard += theRate * theStep;
+		theWait += theStep;
+	}
+	
+	// Postconditions & return:
+	return kMaxWait;
+}
+
+
 mesatime_t calcRateFromTriParameter
 (double iA, double iB, double iC, conttrait_t iCharVal)
 //: take a and three parameters and assess as ax^b + c
@@ -825,24 +919,12 @@ ConditionalRule* castAsConditionalRule (BasicAction* iActionP)
 
 bool isSpeciationRule (EvolRule* iRuleP)
 {
-	if (dynamic_cast<MarkovSpRule*> (iRuleP) or
-		dynamic_cast<LogisticSpRule*> (iRuleP) or
-		dynamic_cast<AgeBiasedSpRule*> (iRuleP) or
-		dynamic_cast<CharBiasedSpRule*> (iRuleP) or
-		dynamic_cast<CharBiasedSpRule_New*> (iRuleP) or
-		dynamic_cast<LatentSpRule*> (iRuleP))
-		return true;
-	else
-		return false;
+	return (iRuleP->getEventKind () == kEvolEvent_Speciation);
 }
 
 bool isKillRule (EvolRule* iRuleP)
 {
-	if (dynamic_cast<MarkovKillRule*> (iRuleP) or
-		dynamic_cast<BiasedKillRule*> (iRuleP))
-		return true;
-	else
-		return false;
+	return (iRuleP->getEventKind () == kEvolEvent_Extinction);
 }
 
 bool isSpeciationOrKillRule (EvolRule* iRuleP)
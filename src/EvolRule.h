@@ -19,12 +19,25 @@ Credits:
 #include "MesaTree.h"
 #include "XRate.h"
 #include "CharComparator.h"
+#include "RandomService.h"
 
 
 // *** CONSTANTS & DEFINES
 
 class XBasicRate;
 
+// WHAT KIND OF EVENT A RULE FIRES
+// So conditional rules can subscribe to just the events they respond to.
+enum evolevent_t
+{
+	kEvolEvent_Speciation = 0,
+	kEvolEvent_Extinction,
+	kEvolEvent_Metronome,
+	kEvolEvent_EndOfEpoch,
+	kEvolEvent_Other,          // e.g. mass extinctions
+	kEvolEvent_Count
+};
+
 
 // *** CLASS DECLARATION *************************************************/
 
@@ -39,6 +52,10 @@ public:
 	virtual ~EvolRule ()
 		{}
 		
+	// ACCESSORS
+	virtual evolevent_t getEventKind ()
+		{ return kEvolEvent_Other; }
+		
 	// SERVICES
 	//time_t calcWaitFromRate (time_t iRate);
 	
@@ -73,6 +90,16 @@ public:
 	// ACCESSORS
 	// virtual bool isTriggered (EvolRule* iFiringRuleP, nodeiter_t& ioFiringLeaf);
 	virtual bool isTriggered (EvolRule* iFiringRuleP, nodearr_t& ioFiringLeaves);
+	virtual bool changesOtherLeaves ()
+		{ return false; }
+	virtual void takeChangedLeaves (nodearr_t& oLeaves)
+		{ oLeaves.clear(); }
+	virtual bool respondsTo (evolevent_t iEvent)
+		{ iEvent = iEvent; return true; }
+		
+	// SERVICES
+	virtual void startEpoch ()
+		{}
 		
 	// I/O
 	const char* describeRule ();
@@ -99,6 +126,11 @@ public:
 		
 	// ACCESSORS
 	virtual mesatime_t calcNextWait ();
+	virtual bool       isExponentialRate ()
+		{ return false; }
+	virtual bool       isFixedWait ()
+		{ return false; }
+	virtual mesatime_t calcRate ();
 	
 	// MUTATORS
 		
@@ -127,6 +159,17 @@ public:
 	virtual ~LocalRule ()
 		{}
 		
+	// ACCESSORS
+	virtual bool       isUniformRate ()
+		{ return false; }
+	virtual mesatime_t calcUniformRate ();
+	virtual bool       isLeafDependent ()
+		{ return false; }
+	virtual mesatime_t calcScheduledWait (nodeiter_t iLeafIter)
+		{ return calcNextWait (iLeafIter); }
+	virtual bool       dependsOnTraits ()
+		{ return true; }
+
 	// SERVICES
 	virtual mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	virtual void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
@@ -156,6 +199,10 @@ public:
 		
 	// SERVICES
 	 mesatime_t calcNextWait ();
+	 bool       isFixedWait ()
+		{ return true; }
+	 evolevent_t getEventKind ()
+		{ return kEvolEvent_Metronome; }
 	
 	// SERVICES
 	virtual void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
@@ -181,6 +228,10 @@ public:
 		
 	// SERVICES
 	mesatime_t calcNextWait ();
+	bool       isExponentialRate ()
+		{ return true; }
+	mesatime_t calcRate ()
+		{ return mRate; }
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	virtual nodearr_t selectTargets ();
 	
@@ -339,6 +390,10 @@ public:
 	EndOfEpochRule ()
 		{}
 				
+	// ACCESSORS
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_EndOfEpoch; }
+		
 	// SERVICES
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 
@@ -358,10 +413,21 @@ public:
 		: mRate (iRate)
 		{}
 
+	// ACCESSORS
+	bool       isUniformRate ()
+		{ return true; }
+	mesatime_t calcUniformRate ()
+		{ return mRate; }
+	bool       isLeafDependent ()
+		{ return true; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Speciation; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -381,6 +447,11 @@ public:
       mCapacity = capacity;
    }
 
+	// ACCESSORS
+	mesatime_t calcUniformRate ();
+	bool       isLeafDependent ()
+		{ return false; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	
@@ -402,10 +473,20 @@ public:
 		: mRateA (iRateA), mRateB (iRateB), mRateC (iRateC)
 		{}
 
+	// ACCESSORS
+	bool       isLeafDependent ()
+		{ return true; }
+	mesatime_t calcScheduledWait (nodeiter_t iLeafIter);
+	bool       dependsOnTraits ()
+		{ return false; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Speciation; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -427,10 +508,17 @@ public:
 		, mCharCol (iCharCol)
 		{}
 
+	// ACCESSORS
+	bool       isLeafDependent ()
+		{ return true; }
+
 	// SERVICES
 	mesatime_t	calcNextWait (nodeiter_t iLeafIter);
 	void		commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Speciation; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -453,10 +541,16 @@ public:
 		// dtor
 		{ if (mRateP != NULL) delete mRateP; }
 		
+	// ACCESSORS
+	bool       isLeafDependent ();
+
 	// SERVICES
 	mesatime_t	calcNextWait (nodeiter_t iLeafIter);
 	void		commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Speciation; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -478,10 +572,17 @@ public:
 		, mCharCol (iCharCol)
 		{}
 
+	// ACCESSORS
+	bool       isLeafDependent ()
+		{ return true; }
+
 	// SERVICES
 	mesatime_t	calcNextWait (nodeiter_t iLeafIter);
 	void		commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Extinction; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -500,10 +601,20 @@ public:
 		: mRateA (iRateA), mRateB (iRateB), mRateC (iRateC)
 		{}
 
+	// ACCESSORS
+	bool       isLeafDependent ()
+		{ return true; }
+	mesatime_t calcScheduledWait (nodeiter_t iLeafIter);
+	bool       dependsOnTraits ()
+		{ return false; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Extinction; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -522,10 +633,19 @@ public:
 		: mRate (iRate), mLatencyPeriod (iLatentPeriod)
 		{}
 
+	// ACCESSORS
+	bool       isLeafDependent ()
+		{ return true; }
+	bool       dependsOnTraits ()
+		{ return false; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 		
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Speciation; }
+	
 	// I/O
 	const char* describeRule ();
 	
@@ -545,10 +665,21 @@ public:
 		: mRate (iRate)
 		{}
 
+	// ACCESSORS
+	bool       isUniformRate ()
+		{ return true; }
+	mesatime_t calcUniformRate ()
+		{ return mRate; }
+	bool       isLeafDependent ()
+		{ return true; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	void commitAction (nodearr_t& ioSubjectLeaves, mesatime_t iTime);
 	
+	evolevent_t getEventKind ()
+		{ return kEvolEvent_Extinction; }
+	
 	// I/O
 	const char* describeRule ();
 
@@ -568,6 +699,11 @@ public:
       mCapacity = capacity;
    }
 
+	// ACCESSORS
+	mesatime_t calcUniformRate ();
+	bool       isLeafDependent ()
+		{ return false; }
+
 	// SERVICES
 	mesatime_t calcNextWait (nodeiter_t iLeafIter);
 	
@@ -595,8 +731,11 @@ bool     isSpeciationOrKillRule (EvolRule* iRuleP);
 void     setRandomSeed (long iSeed);
 
 mesatime_t   calcWaitFromRate (mesatime_t iRate);
+mesatime_t   calcWaitFromRate (mesatime_t iRate, sbl::RandomService& ioRng);
 mesatime_t   calcRateFromTriParameter (double iA, double iB, double iC, conttrait_t iCharVal);
 mesatime_t   calcProbFromTriParameter (double iA, double iB, double iC, conttrait_t iCharVal);
+mesatime_t   calcWaitFromAgeRate (double iA, double iB, double iC, mesatime_t iAge,
+					mesatime_t iMinAge);
 
 
 
@@ -14,6 +14,7 @@ Credits:
 
 #include "ActionUtils.h"
 #include "Macro.h"
+#include "Epoch.h"
 #include "MesaUtils.h"
 #include "TaxaTraitMatrix.h"
 #include "TreeWrangler.h"
@@ -22,7 +23,21 @@ Credits:
 #include "Reporter.h"
 #include "ReporterPrefix.h"
 #include "StringUtils.h"
+#include "ExecutionError.h"
 #include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <iostream>
+
+#if defined(unix) || defined(__unix__) || defined(__APPLE__)
+	#define MESA_CANFORK
+	#include <unistd.h>
+	#include <sys/types.h>
+	#include <sys/wait.h>
+	#include <signal.h>
+	#include <cerrno>
+#endif
 
 using std::string;
 using sbl::toString;
@@ -36,6 +51,9 @@ typedef BasicMacro::reference        reference;
 typedef BasicMacro::container_type   container_type;
 typedef BasicMacro::iterator         iterator;
 
+// how many replicates of run & restore are simulated together
+static const int kReplicateBatchSize = 64;
+
 
 // *** BASIC MACRO *******************************************************/
 
@@ -333,9 +351,25 @@ void BasicMacro::assertValidIndex (int iIndex)
 void BasicMacro::executeMacro ()
 //: execute the enclosed block 
 // NOTE: necessary for evolution events
+// Consecutive analyses that can share a sweep of the tree are run as one
+// pass. As they can't change the tree, they all see the same one.
 {
-	for (uint i = 0; i < mContents.size(); i++)
-		(mContents.at(i))->execute();
+	uint i = 0;
+	while (i < mContents.size())
+	{
+		TreePass thePass;
+		while ((i < mContents.size()) and thePass.adoptAnalysis (mContents[i]))
+			i++;
+		if (thePass.isEmpty())
+		{
+			(mContents.at(i))->execute();
+			i++;
+		}
+		else
+		{
+			thePass.run();
+		}
+	}
 		
 	// MesaGlobals::mTreeDataP->validate();
 }
@@ -429,29 +463,287 @@ const char* RunOnceMacro::describeMacro ()
 // *** RUN & RESTORE MACRO ***************************************************/
 
 
+bool RunAndRestoreMacro::mInWorker = false;
+
+
 void RunAndRestoreMacro::execute ()
+//: run the enclosed actions, in parallel processes if the prefs say so
+// Replicates of run & restore are independent of each other, so they can
+// be farmed out. Nested run & restores within a replicate run serially.
+{
+	int theNumWorkers = MesaGlobals::mPrefs.mNumWorkers;
+#ifdef MESA_CANFORK
+	if ((1 < theNumWorkers) and (1 < mLoops) and (not mInWorker))
+	{
+		executeParallel (theNumWorkers);
+		return;
+	}
+#endif
+	executeSerial ();
+}
+
+
+void RunAndRestoreMacro::executeSerial ()
+//: run the replicates one after another
+// If the first action is a plain birth-death epoch to a count, it is drawn
+// for a batch of replicates at once (see EpochMacro::simulateBirthDeath)
+// and each replicate then splices in its own. As each replicate draws on
+// its own generator either way, the results are just as if run singly.
+// The trees and trait matrices aren't copied, but have their changes
+// logged & rolled back after each replicate, which costs only as much as
+// the replicate did.
 {	
-	TreeWrangler		theSavedTrees = *(MesaGlobals::mTreeDataP);
-	ContTraitMatrix	theSavedContData = *(MesaGlobals::mContDataP);
-	DiscTraitMatrix	theSavedDiscData = *(MesaGlobals::mDiscDataP);	
+	ContTraitMatrix*	theContDataP = MesaGlobals::mContDataP;
+	DiscTraitMatrix*	theDiscDataP = MesaGlobals::mDiscDataP;
+	TreeWrangler::UndoMark		theTreeMark = MesaGlobals::mTreeDataP->markUndo ();
+	ContTraitMatrix::UndoMark	theContMark = theContDataP->markUndo ();
+	DiscTraitMatrix::UndoMark	theDiscMark = theDiscDataP->markUndo ();
+	sbl::RandomService	theReplicateRng = splitReplicateRng ();
+	sbl::RandomService	theSavedRng = MesaGlobals::mRng;
+	
+	EpochMacro* theEpochP = NULL;
+	if (0 < size())
+		theEpochP = castAsEpoch (at (0));
+	bool theIsBatched = (1 < mLoops) and (theEpochP != NULL) and
+		theEpochP->canBatchBirthDeath ();
+	std::vector<sbl::RandomService>	theBatchRngs;
+	std::vector<BirthDeathDraw>		theBatchDraws;
 		
 	for (int i = 1; i <= mLoops; i++)
 	{
-		std::string thePrefixStr ("run & restore ");
-		thePrefixStr += sbl::toString (i);
-		thePrefixStr += " of ";
-		thePrefixStr += sbl::toString (mLoops);		
-		ReporterPrefix	thePrefix (thePrefixStr.c_str());
+		ReporterPrefix	thePrefix (describeLoop (i).c_str());
 		
-		executeMacro();
+		// the first of a batch makes the draws for the rest
+		int theBatchIndex = (i - 1) % kReplicateBatchSize;
+		if (theIsBatched and (theBatchIndex == 0))
+		{
+			theBatchRngs.clear();
+			for (int j = i; (j <= mLoops) and (j < i + kReplicateBatchSize); j++)
+				theBatchRngs.push_back (theReplicateRng.Split (j));
+			theEpochP->simulateBirthDeath (theBatchRngs, theBatchDraws);
+		}
+		
+		if (theIsBatched)
+		{
+			MesaGlobals::mRng = theBatchRngs[theBatchIndex];
+			theEpochP->setBirthDeathDraw (&theBatchDraws[theBatchIndex]);
+		}
+		else
+		{
+			MesaGlobals::mRng = theReplicateRng.Split (i);
+		}
+		try
+		{
+			executeMacro();
+		}
+		catch (...)
+		{
+			if (theEpochP != NULL)
+				theEpochP->setBirthDeathDraw (NULL);
+			MesaGlobals::mTreeDataP->rollbackUndo (theTreeMark);
+			MesaGlobals::mTreeDataP->releaseUndo (theTreeMark);
+			theContDataP->rollbackUndo (theContMark);
+			theContDataP->releaseUndo (theContMark);
+			theDiscDataP->rollbackUndo (theDiscMark);
+			theDiscDataP->releaseUndo (theDiscMark);
+			MesaGlobals::mRng = theSavedRng;
+			throw;
+		}
+		if (theEpochP != NULL)
+			theEpochP->setBirthDeathDraw (NULL);
 		
-		*(MesaGlobals::mTreeDataP) = theSavedTrees; 
-		*(MesaGlobals::mContDataP) = theSavedContData;
-		*(MesaGlobals::mDiscDataP) = theSavedDiscData;
+		MesaGlobals::mTreeDataP->rollbackUndo (theTreeMark);
+		theContDataP->rollbackUndo (theContMark);
+		theDiscDataP->rollbackUndo (theDiscMark);
 		// MesaGlobals::mActiveTreeP = MesaGlobals::mTreeDataP->getActiveTreeP();
 	}
+	MesaGlobals::mTreeDataP->releaseUndo (theTreeMark);
+	theContDataP->releaseUndo (theContMark);
+	theDiscDataP->releaseUndo (theDiscMark);
+	MesaGlobals::mRng = theSavedRng;
 }
 
+
+#ifdef MESA_CANFORK
+static void abandonReplicates (std::map<pid_t, int>& ioRunning,
+	std::vector<std::FILE*>& ioFileOuts, std::vector<std::FILE*>& ioScreenOuts)
+//: kill & reap any replicates still running, and close their files
+{
+	std::map<pid_t, int>::iterator q;
+	for (q = ioRunning.begin(); q != ioRunning.end(); q++)
+		kill (q->first, SIGKILL);
+	for (q = ioRunning.begin(); q != ioRunning.end(); q++)
+	{
+		while ((waitpid (q->first, NULL, 0) < 0) and (errno == EINTR))
+			;
+	}
+	ioRunning.clear();
+	
+	for (std::vector<std::FILE*>::size_type i = 0; i < ioFileOuts.size(); i++)
+	{
+		if (ioFileOuts[i] != NULL)
+			std::fclose (ioFileOuts[i]);
+		if (ioScreenOuts[i] != NULL)
+			std::fclose (ioScreenOuts[i]);
+		ioFileOuts[i] = ioScreenOuts[i] = NULL;
+	}
+}
+#endif
+
+
+void RunAndRestoreMacro::executeParallel (int iNumWorkers)
+//: run the replicates in up to this many forked processes at once
+// Each replicate is forked from the untouched data, so it gets its own
+// copy of the trees, traits and reporter for free, and the data here
+// never needs restoring. Each uses the same random stream as it would
+// if run serially, so results don't depend on the number of processes
+// or the order they finish in. Its output is captured in temporary files
+// and replayed here strictly in replicate order, so the results file
+// reads just as if the replicates had been run one after another.
+{
+#ifdef MESA_CANFORK
+	Reporter* theReporterP = MesaGlobals::mReporterP;
+	assert (theReporterP != NULL);
+	
+	sbl::RandomService theReplicateRng = splitReplicateRng ();
+	
+	std::vector<std::FILE*>   theFileOuts (mLoops + 1, (std::FILE*) NULL);
+	std::vector<std::FILE*>   theScreenOuts (mLoops + 1, (std::FILE*) NULL);
+	std::vector<bool>         theIsDone (mLoops + 1, false);
+	std::map<pid_t, int>      theRunning;
+	int                       theNextToStart = 1;
+	int                       theNextToReplay = 1;
+	int                       theFailedLoop = 0;
+
+	try
+	{
+		while (theNextToReplay <= mLoops)
+		{
+			// start as many replicates as there is room for
+			while ((int (theRunning.size()) < iNumWorkers) and
+				(theNextToStart <= mLoops) and (theFailedLoop == 0))
+			{
+				int i = theNextToStart++;
+				theFileOuts[i] = std::tmpfile();
+				theScreenOuts[i] = std::tmpfile();
+				if ((theFileOuts[i] == NULL) or (theScreenOuts[i] == NULL))
+					throw ExecutionError ("can't make temporary files for replicates");
+			
+				// nothing buffered may be copied into the child
+				theReporterP->flush();
+				std::cout.flush();
+				std::fflush (NULL);
+			
+				pid_t thePid = fork();
+				if (thePid < 0)
+					throw ExecutionError ("can't start process for replicate");
+				if (thePid == 0)
+				{
+					// the child: run the replicate & report through the files
+					int theExitCode = 0;
+					mInWorker = true;
+					MesaGlobals::mRng = theReplicateRng.Split (i);
+					theReporterP->captureTo (theFileOuts[i], theScreenOuts[i]);
+					try
+					{
+						ReporterPrefix	thePrefix (describeLoop (i).c_str());
+						executeMacro();
+					}
+					catch (std::exception& theException)
+					{
+						std::fprintf (theScreenOuts[i], "Error: %s\n", theException.what());
+						theExitCode = 1;
+					}
+					catch (...)
+					{
+						std::fprintf (theScreenOuts[i], "Error: unidentified error\n");
+						theExitCode = 1;
+					}
+					std::fflush (NULL);
+					std::cout.flush();
+					_exit (theExitCode);
+				}
+				theRunning[thePid] = i;
+			}
+		
+			// wait for one to finish
+			int theStatus = 0;
+			pid_t theDonePid = waitpid (-1, &theStatus, 0);
+			if (theDonePid < 0)
+				throw ExecutionError ("lost track of replicate processes");
+			std::map<pid_t, int>::iterator q = theRunning.find (theDonePid);
+			if (q == theRunning.end())
+				continue;
+			int theDoneLoop = q->second;
+			theRunning.erase (q);
+			theIsDone[theDoneLoop] = true;
+			if ((not WIFEXITED (theStatus)) or (WEXITSTATUS (theStatus) != 0))
+			{
+				if ((theFailedLoop == 0) or (theDoneLoop < theFailedLoop))
+					theFailedLoop = theDoneLoop;
+			}
+		
+			// pass on the output of any replicates now complete in order
+			while ((theNextToReplay <= mLoops) and theIsDone[theNextToReplay] and
+				((theFailedLoop == 0) or (theNextToReplay <= theFailedLoop)))
+			{
+				int i = theNextToReplay++;
+				theReporterP->replayCapture (theFileOuts[i], theScreenOuts[i]);
+				std::fclose (theFileOuts[i]);
+				std::fclose (theScreenOuts[i]);
+				theFileOuts[i] = theScreenOuts[i] = NULL;
+			}
+		
+			// after a failure, stop once everything started has finished
+			if ((theFailedLoop != 0) and theRunning.empty())
+				break;
+		}
+	}
+	catch (...)
+	{
+		// don't leave the replicates already started running or unreaped
+		abandonReplicates (theRunning, theFileOuts, theScreenOuts);
+		throw;
+	}
+	
+	// tidy up anything not replayed after a failure
+	abandonReplicates (theRunning, theFileOuts, theScreenOuts);
+	
+	if (theFailedLoop != 0)
+	{
+		string theMsg ("replicate ");
+		theMsg += toString (theFailedLoop);
+		theMsg += " of run & restore failed";
+		throw ExecutionError (theMsg.c_str());
+	}
+#else
+	iNumWorkers = iNumWorkers; // just to shut compiler up
+	executeSerial ();
+#endif
+}
+
+
+sbl::RandomService RunAndRestoreMacro::splitReplicateRng ()
+//: return the generator whose streams the replicates will use
+// One draw from the main generator picks it, so the main stream moves on
+// and a later run & restore gets fresh replicates.
+{
+	unsigned long theFamilyId = (unsigned long) MesaGlobals::mRng.UniformWhole (2147483647L);
+	return MesaGlobals::mRng.Split (theFamilyId);
+}
+
+
+std::string RunAndRestoreMacro::describeLoop (int iLoop)
+//: the prefix that marks output from this replicate
+{
+	std::string thePrefixStr ("run & restore ");
+	thePrefixStr += sbl::toString (iLoop);
+	thePrefixStr += " of ";
+	thePrefixStr += sbl::toString (mLoops);
+	return thePrefixStr;
+}
+
+
 const char* RunAndRestoreMacro::describeMacro ()
 {
 	static std::string theDesc;
@@ -17,7 +17,9 @@ Credits:
 // *** INCLUDES
 
 #include "Action.h"
+#include "RandomService.h"
 #include <vector>
+#include <string>
 
 
 // *** CONSTANTS & DEFINES
@@ -182,6 +184,8 @@ public:
 				
 	// SERVICES
 	void execute ();
+	static bool isInWorker ()
+		{ return mInWorker; }
 	
 	// I/O
 	const char* describeMacro ();
@@ -192,6 +196,13 @@ public:
 	// INTERNALS
 private:
 	int				mLoops;
+	
+	static bool		mInWorker;   // true within a forked replicate
+	
+	void				executeSerial ();
+	void				executeParallel (int iNumWorkers);
+	sbl::RandomService	splitReplicateRng ();
+	std::string		describeLoop (int iLoop);
 };
 
 
@@ -88,7 +88,7 @@ public:
 
 				// ... for every taxa, raze it to one
 				for (colIndex_t i = 0; i < theNumTaxa; i++)
-					MesaGlobals::mContDataP->at (i, *p) = 0.0;
+					MesaGlobals::mContDataP->referData (i, *p) = 0.0;
 			}
 		}
 
@@ -292,7 +292,7 @@ public:
 		// get the live nodes, shuffle them and take the first N
 		MesaTree* theTreeP = getActiveTreeP ();
 		theTreeP->getLiveLeaves (oTargetNodes);
-		random_shuffle (oTargetNodes.begin(), oTargetNodes.end());
+		MesaGlobals::mRng.Shuffle (oTargetNodes.begin(), oTargetNodes.end());
 		if ((unsigned int) mKillNum < oTargetNodes.size())
 			oTargetNodes.resize (mKillNum);
 	}
@@ -324,7 +324,7 @@ public:
 		MesaTree* theTreeP = getActiveTreeP ();
 		theTreeP->getLiveLeaves (oTargetNodes);
 		nodearr_t::size_type theKillNum = nodearr_t::size_type (oTargetNodes.size() * mKillFrac);
-		random_shuffle (oTargetNodes.begin(), oTargetNodes.end());
+		MesaGlobals::mRng.Shuffle (oTargetNodes.begin(), oTargetNodes.end());
 		oTargetNodes.resize (theKillNum);
 	}
 
@@ -476,12 +476,19 @@ public:
 	// SERVICES
 	void selectTargets (nodearr_t& oTargetNodes)
 	{
+		// index the nodes by name in one pass, rather than searching the
+		// tree for each name, keeping the first node that has each name
 		MesaTree* theTreeP = getActiveTreeP ();
+		std::map<std::string, nodeiter_t> theNodesByName;
+		for (nodeiter_t q = theTreeP->begin(); q != theTreeP->end(); q++)
+			theNodesByName.insert (std::make_pair (theTreeP->getNodeName (q), q));
+
 		for (std::vector<std::string>::size_type i = 0; i < mNames.size(); i++)
 		{
-			nodeiter_t theNode = theTreeP->getIter (mNames[i].c_str());
-			if ((theNode != theTreeP->end()) and theTreeP->isLeaf (theNode))
-				oTargetNodes.push_back (theNode);
+			std::map<std::string, nodeiter_t>::iterator p =
+				theNodesByName.find (mNames[i]);
+			if ((p != theNodesByName.end()) and theTreeP->isLeaf (p->second))
+				oTargetNodes.push_back (p->second);
 		}
 	}
 
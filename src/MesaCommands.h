@@ -72,6 +72,8 @@ enum mesaCmdId_t
 	kCmd_PrefDeadNodes,
 	kCmd_PrefWriteTaxa,
 	kCmd_PrefTimeGrain,
+	kCmd_PrefNumWorkers,
+	kCmd_PrefKeepTotals,
 	
 	// analysis action commands
 	kCmd_AnalExTaxa,	
@@ -110,6 +112,7 @@ enum mesaCmdId_t
 	kCmd_AnalMacroCaic,
 	kCmd_AnalResolution,
 	kCmd_AnalUltrametric,
+	kCmd_AnalPatristic,
 	
 	// macro action commands
 	kCmd_MacroRunOnce,
@@ -168,6 +171,7 @@ enum mesaCmdId_t
 	kCmd_SchemeDiscRankedMarkov,
 	kCmd_SchemeContBrownian,
 	kCmd_SchemeContLogNormal,
+	kCmd_SchemeContMultiBrownian,
 	
 	// queue manipulation commands
 	kCmd_QueueDelete,
@@ -470,6 +470,7 @@ bool MesaConsoleApp::UpdateCmd (cmdId_t iCmdId)
 		case kCmd_AnalMacroCaic:
 		case kCmd_AnalResolution:
 		case kCmd_AnalUltrametric:
+		case kCmd_AnalPatristic:
 		case kCmd_QueueProgram:
 			if (theModelHasTrees)
 				return true;
@@ -1064,6 +1065,8 @@ void MesaConsoleApp::doPrefsMenu ()
 	thePrefsCmds.AddCommand (kCmd_PrefWriteTranslation, "Set writing of translation cmd");		
 	thePrefsCmds.AddCommand (kCmd_PrefTimeGrain, "Set granularity of simulation time");		
 	thePrefsCmds.AddCommand (kCmd_PrefSetRandSeed, "Set random number seed");		
+	thePrefsCmds.AddCommand (kCmd_PrefNumWorkers, "Set number of parallel replicates");		
+	thePrefsCmds.AddCommand (kCmd_PrefKeepTotals, "Set keeping of subtree totals");		
 	thePrefsCmds.AddCommand (kCmd_Return, 'r', "Return to main menu");
 
 	thePrefsCmds.SetCommandActive (true);
@@ -1157,6 +1160,35 @@ void MesaConsoleApp::doPrefsMenu ()
 				break;
 			}
 	
+			case kCmd_PrefNumWorkers:
+			{
+				cout << "Currently set to: " << MesaGlobals::mPrefs.mNumWorkers << endl;
+				cout << "(Replicates of 'run & restore' are run this many at a time, "
+					"each in its own process. Large timed birth-death epochs are also "
+					"grown a clade at a time in this many processes.)" << endl;
+				if (askYesNo ("Change"))
+				{
+					MesaGlobals::mPrefs.mNumWorkers = askIntegerWithMin ("Set it to", 1);
+					cout << "Parallel replicates now set to: " << MesaGlobals::mPrefs.mNumWorkers << endl;
+				}
+				break;
+			}
+			
+			case kCmd_PrefKeepTotals:
+			{
+				theOptionIsOn = MesaGlobals::mPrefs.mKeepSubtreeTotals;
+				cout << "Keeping subtree totals up to date was set to " <<
+					(theOptionIsOn? "true" : "false") << ", is now " <<
+					(theOptionIsOn? "false" : "true") << "." << endl;
+				cout << "(Imbalance & other analyses that count the leaves below "
+					"every node work out totals for the whole tree. If kept, "
+					"these are updated as the tree evolves, which costs a little "
+					"at each event but is quicker where such analyses are run "
+					"often.)" << endl;
+				MesaGlobals::mPrefs.mKeepSubtreeTotals = (not theOptionIsOn);
+				break;
+			}
+	
 
 			default:
 			{
@@ -1807,12 +1839,12 @@ void MesaConsoleApp::doRunQueue (cmdId_t iUserCmd)
 	catch (...)
 	{
 		Report ("A problem has caused the queue to terminate.");
-		throw;
 		if (theResultsFile.is_open())
 		{
 			theResultsFile.close ();	
 			mModel->mReporter.setFileStream (NULL);
 		}
+		throw;
 	}
 	
 	if (theResultsFile.is_open())
@@ -2008,6 +2040,7 @@ void MesaConsoleApp::loadAnalysisCmds (CommandMgr& ioCommands)
 	ioCommands.AddCommand (kCmd_AnalStemminess, "Calculate stemminess");
 	ioCommands.AddCommand (kCmd_AnalResolution, "Calculate resolution");
 	ioCommands.AddCommand (kCmd_AnalUltrametric, "Calculate ultrametricity");
+	ioCommands.AddCommand (kCmd_AnalPatristic, "Write patristic distances between tips");
 
 	// ioCommands.AddCommand (kCmd_AnalCaic, "Calculate CAIC analysis");
 	// ioCommands.AddCommand (kCmd_AnalMacroCaic, "Calculate MacroCAIC analysis");
@@ -2356,6 +2389,15 @@ BasicAction* MesaConsoleApp::newAction (cmdId_t iUserCmd)
 			break;
 		}
 
+		case kCmd_AnalPatristic:
+		{
+			theBaseName = askString ("Name the distance files");
+			bool theWriteBinary = not askEitherOr ("Write as nexus or binary", 'n', 'b');
+			theActionP = (BasicAnalysis*) new PatristicDistanceAnalysis (
+				theBaseName.c_str(), theWriteBinary);
+			break;
+		}
+
 		case kCmd_MacroRunOnce:
 		{
 			theActionP = new RunOnceMacro;
@@ -2389,7 +2431,9 @@ BasicAction* MesaConsoleApp::newAction (cmdId_t iUserCmd)
 			theLoops	= askIntegerWithMin ("Evolve until this number reaches", 2);
 			theAdvanceEpoch = askYesNo ("Advance until next event");
  			theRestartIfDead = askYesNo ("Restart the epoch if all taxa die");
-			theActionP = new EpochPopLimit (theLoops, theAdvanceEpoch, theNodeType, theRestartIfDead);
+			EpochMacro* theEpochP = new EpochPopLimit (theLoops, theAdvanceEpoch, theNodeType, theRestartIfDead);
+			askEpochEngine (theEpochP);
+			theActionP = theEpochP;
 			break;
 		}
 
@@ -2397,7 +2441,9 @@ BasicAction* MesaConsoleApp::newAction (cmdId_t iUserCmd)
 		{
 			mesatime_t theTimeLimit	= askDouble ("Evolve until time reaches", 0, kAnswerBounds_None);
  			theRestartIfDead = askYesNo ("Restart the epoch if all taxa die");
-			theActionP = new EpochTimeLimit (theTimeLimit, theRestartIfDead);
+			EpochMacro* theEpochP = new EpochTimeLimit (theTimeLimit, theRestartIfDead);
+			askEpochEngine (theEpochP);
+			theActionP = theEpochP;
 			break;
 		}
 
@@ -145,6 +145,7 @@ private:
 	CharStateSet askForStates (const char* iPrompt);
 
 	int	askSppRichnessCol ();
+	void askEpochEngine (EpochMacro* ioEpochP);
 	void 	askRate (double& iFreq);
 	void 	askRate (double& iFreqA, double& iFreqB, double& iFreqC, const char* iPromptCstr = NULL);
 
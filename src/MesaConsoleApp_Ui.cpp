@@ -37,6 +37,7 @@ To Do:
 #include "MesaCommands.h"
 #include "ManipAction.h"
 #include "XBounds.h"
+#include "Numerics.h"
 #include <fstream>
 #include <exception>
 #include <sstream>
@@ -103,6 +104,7 @@ void MesaConsoleApp::askForSchemes
 	theSchemeCmds.AddCommand (kCmd_SchemeDiscRankedMarkov, "Add discrete ranked markovian scheme");
 	theSchemeCmds.AddCommand (kCmd_SchemeContBrownian, "Add continuous brownian scheme");
 	theSchemeCmds.AddCommand (kCmd_SchemeContLogNormal, "Add continuous log-normal scheme");
+	theSchemeCmds.AddCommand (kCmd_SchemeContMultiBrownian, "Add correlated brownian scheme for several traits");
 	theSchemeCmds.AddCommand (kCmd_Return, "r", "Finish defining schemes");
 
 	theSchemeCmds.SetCommandActive (true);
@@ -125,6 +127,8 @@ void MesaConsoleApp::askForSchemes
 		bool theHasContChars = (mModel->countContTraits() != 0);
 		theSchemeCmds.SetCommandActive (kCmd_SchemeContBrownian, theHasContChars);
 		theSchemeCmds.SetCommandActive (kCmd_SchemeContLogNormal, theHasContChars);
+		theSchemeCmds.SetCommandActive (kCmd_SchemeContMultiBrownian,
+			1 < mModel->countContTraits());
 
 		bool theSchemeIsNonEmpty = (iSchemeArr.size() != 0);
 		theSchemeCmds.SetCommandActive (kCmd_SchemeList, theSchemeIsNonEmpty);
@@ -175,10 +179,10 @@ void MesaConsoleApp::askForSchemes
 			{
 				theColIndex = askDiscTraitCol ("Choose a discrete trait");
 				theStates = askForStates ("Edit states for ranked markovian evolution");
-				double theUpFreq = askDouble ("What is the upwards rate", 0.0, 1.0);
-				double theDownFreq = askDouble ("What is the downwards rate", 0.0, (1.0 - theUpFreq));
+				double theUpFreq = askDouble ("What is the upwards rate", 0.0, kAnswerBounds_None);
+				double theDownFreq = askDouble ("What is the downwards rate", 0.0, kAnswerBounds_None);
 				iSchemeArr.adopt (new RankedMarkovianCeScheme (theColIndex, theStates,
-					theUpFreq, theDownFreq));
+					theDownFreq, theUpFreq));
 				break;
 			}
 				
@@ -260,6 +264,64 @@ void MesaConsoleApp::askForSchemes
 				break;
 			}
 
+			case kCmd_SchemeContMultiBrownian:
+			{
+				// gather the traits, each only once
+				vector<int> theCols;
+				int theNextCol;
+				while ((theNextCol = askContCol (kAnswer_NotRequired)) != kColIndex_None)
+				{
+					if (isMemberOf (theNextCol, theCols.begin(), theCols.end()))
+						Report ("That trait is already in the scheme");
+					else
+						theCols.push_back (theNextCol);
+				}
+				long theNumCols = (long) theCols.size();
+				if (theNumCols < 2)
+				{
+					Report ("A correlated scheme needs at least two traits");
+					break;
+				}
+				
+				// get the means and the covariance matrix, per unit time
+				vector<double> theMeans (theNumCols);
+				for (long i = 0; i < theNumCols; i++)
+				{
+					string thePrompt = "Enter the mean change of trait " +
+						sbl::toString (theCols[i] + 1);
+					theMeans[i] = askDouble (thePrompt.c_str());
+				}
+				vector<double> theCovars (theNumCols * theNumCols);
+				for (long i = 0; i < theNumCols; i++)
+				{
+					for (long j = 0; j <= i; j++)
+					{
+						string thePrompt;
+						double theCovar;
+						if (i == j)
+						{
+							thePrompt = "Enter the variance of trait " + sbl::toString (theCols[i] + 1);
+							theCovar = askDouble (thePrompt.c_str(), 0.0, kAnswerBounds_None);
+						}
+						else
+						{
+							thePrompt = "Enter the covariance of traits " +
+								sbl::toString (theCols[j] + 1) + " and " + sbl::toString (theCols[i] + 1);
+							theCovar = askDouble (thePrompt.c_str());
+						}
+						theCovars[(i * theNumCols) + j] = theCovars[(j * theNumCols) + i] = theCovar;
+					}
+				}
+				vector<double> theFactor;
+				if (not choleskyFactor (theCovars, theNumCols, theFactor))
+				{
+					Report ("The covariances must form a positive definite matrix");
+					break;
+				}
+				iSchemeArr.adopt (new ContMultiBrownianScheme (theCols, theMeans, theCovars));
+				break;
+			}
+
 								
 			default:
 				assert (false); // shouldn't reach here
@@ -526,6 +588,22 @@ int MesaConsoleApp::askSppRichnessCol ()
 		return kColIndex_None;
 }
 
+void MesaConsoleApp::askEpochEngine (EpochMacro* ioEpochP)
+//: ask the user how an epoch should choose its events
+// The direct method is only faster where rules have the same rate for
+// every leaf, the next-reaction method where rates depend only on the
+// leaf. Tau-leaping needs every rule to be a speciation or extinction
+// with the same rate for every leaf, as does the direct method's fastest
+// case. Otherwise the epoch falls back to the classic engine.
+{
+	int theChoice = askChoice ("Use the classic, direct-method, next-reaction or tau-leaping engine",
+		"cdnt", int (kEpochEngine_Classic));
+	ioEpochP->setEngine ((epochengine_t) theChoice);
+	if (ioEpochP->getEngine () == kEpochEngine_TauLeap)
+		ioEpochP->setTauTolerance (askDouble
+			("Largest relative change in rates within a leap", 0.0001, 1.0));
+}
+
 int MesaConsoleApp::askContCol (bool iAnswer)
 //: ask the user to select a column or none
 // GOTCHA: this function automagically translates from the 1-based user
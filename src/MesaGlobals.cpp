@@ -40,5 +40,7 @@ TreeWrangler*			MesaGlobals::mTreeDataP;
 MesaTree*				MesaGlobals::mActiveTreeP;
 Reporter*				MesaGlobals::mReporterP;
 
+std::vector<TraitEvolScheme*>	MesaGlobals::mLazySchemes;
+
 
 // *** END ***************************************************************/
@@ -19,12 +19,14 @@ Credits:
 #include "Sbl.h"
 #include "MesaPrefs.h"
 #include "RandomService.h"
+#include <vector>
 
 class DiscTraitMatrix;
 class ContTraitMatrix;
 class TreeWrangler;
 class MesaTree;
 class Reporter;
+class TraitEvolScheme;
 
 
 // *** VARIABLES
@@ -43,6 +45,8 @@ public:
 	static TreeWrangler* 		mTreeDataP;
 	static MesaTree*				mActiveTreeP;
 	static Reporter*				mReporterP;
+	// trait evolution deferred until read, for the running epoch
+	static std::vector<TraitEvolScheme*>	mLazySchemes;
 };
 
 
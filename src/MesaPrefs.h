@@ -121,6 +121,8 @@ public:
 		, mWriteTaxaBlock (false)
 		, mWriteTransCmd (true)
 		, mTimeGrain (0.0001)
+		, mNumWorkers (1)
+		, mKeepSubtreeTotals (false)
 		{}
 	// ~MesaPrefs		();
 
@@ -135,6 +137,8 @@ public:
 	bool                   mWriteTaxaBlock;
 	bool                   mWriteTransCmd;
 	double                 mTimeGrain;
+	int                    mNumWorkers;   // processes for run & restore & clades
+	bool                   mKeepSubtreeTotals;   // see MesaTree
 
 	// Depreciated & Debug
 	void	validate	()
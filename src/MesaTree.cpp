@@ -65,6 +65,60 @@ bool MesaTree::isNodeAlive (MesaTree::iterator& iNode)
 }
 
 
+weight_type MesaTree::getEdgeWeight (iterator iNodeIter)
+//: return the length of the branch between this node and its parent
+// Living leaves are aged lazily (see ageAllLeaves), so their stored weight
+// may lag behind the tree clock and the difference must be added.
+{
+	weight_type theStamp = iNodeIter->second.mData.mClockStamp;
+	return getEdgeWeight (iNodeIter,
+		(theStamp < mClock) and isNodeAlive (iNodeIter));
+}
+
+
+weight_type MesaTree::getEdgeWeight (iterator iNodeIter, bool iIsAlive)
+//: as above, for a node already known to be alive or dead
+// Saves looking the node up in the dead list, when going over many nodes.
+{
+	weight_type theWt = base_type::getEdgeWeight (iNodeIter);
+	weight_type theStamp = iNodeIter->second.mData.mClockStamp;
+	if (iIsAlive and (theStamp < mClock))
+		theWt += mClock - theStamp;
+	return theWt;
+}
+
+
+weight_type MesaTree::getLineageClock (iterator iNodeIter)
+//: the tree clock up to which this node's lineage has run
+// For a living leaf that is now, otherwise it is when the node speciated
+// or died, which is when its weight was last brought up to date.
+{
+	if (isNodeAlive (iNodeIter))
+		return mClock;
+	else
+		return iNodeIter->second.mData.mClockStamp;
+}
+
+
+void MesaTree::setEdgeWeight (iterator iNodeIter, weight_type iNewWt)
+//: set the length of the branch, as of the current tree clock
+{
+	logStamps (iNodeIter);
+	base_type::setEdgeWeight (iNodeIter, iNewWt);
+	iNodeIter->second.mData.mClockStamp = mClock;
+}
+
+
+void MesaTree::setTraitStamp (iterator iNodeIter, weight_type iStamp)
+//: note the tree clock up to which this node's lazy traits are current
+// Goes through here so the old stamp is logged, else a rollback would
+// leave the node looking current & its traits wouldn't evolve again.
+{
+	logStamps (iNodeIter);
+	iNodeIter->second.mData.mTraitStamp = iStamp;
+}
+
+
 bool MesaTree::isNodeBifurcating (iterator& iNode)
 {
 	// Preconditions:
@@ -350,7 +404,8 @@ weight_type MesaTree::getRootAge ()
 			break;
 	}
 	
-	if (isNodeAlive (q))
+	// a dead tree runs off the end, which can't be dereferenced
+	if ((q != end()) and isNodeAlive (q))
 	{
 		// if tree alive, measure from living tip to root
 		theAge = getTimeFromNodeToRoot (q);
@@ -390,13 +445,7 @@ weight_type MesaTree::getTreeAge ()
 bool MesaTree::isTreeAlive ()
 //: is the tree still growing (i.e. does it have have living taxa)?
 {
-	for (iterator q = begin(); q != end(); q++)
-	{
-		if (isLeaf (q) and isNodeAlive (q))
-			return true;
-	}
-	
-	return false;
+	return (0 < countAliveLeaves());
 }
 
 
@@ -456,14 +505,8 @@ bool MesaTree::isTreeNeo ()
 
 size_type MesaTree::countAliveLeaves ()
 {
-	size_type theTotal = 0;
-	for (iterator q = begin(); q != end(); q++)
-	{
-		if (isNodeAlive (q))
-			theTotal++;
-	}
-
-	return theTotal;	
+	checkLiveIndex ();
+	return mLiveIds.size();	
 }
 
 
@@ -556,6 +599,63 @@ double MesaTree::calcGeneticDiversity ()
 }
 
 
+// *** SUBTREE TOTALS ****************************************************/
+
+// Imbalance statistics & the like ask these of every node, which walking
+// the subtree each time would make quadratic in the size of the tree.
+
+size_type MesaTree::countLeaves ()
+//: how many leaves in the whole tree?
+// Doesn't work out the totals just for this, as a walk is as quick.
+{
+	if (areAggregatesCurrent() and (not isEmpty()))
+		return getAggregate (getRoot()).mNumLeaves;
+	return base_type::countLeaves ();
+}
+
+size_type MesaTree::countLeaves (iterator iSubtreeIter)
+//: how many leaves, living or dead, in the subtree of this node?
+{
+	checkAggregates ();
+	return getAggregate (iSubtreeIter).mNumLeaves;
+}
+
+size_type MesaTree::countAliveLeaves (iterator iSubtreeIter)
+{
+	checkAggregates ();
+	return getAggregate (iSubtreeIter).mNumAliveLeaves;
+}
+
+weight_type MesaTree::getSubtreeLength (iterator iSubtreeIter)
+//: the summed length of the branches below this node
+// As for calcPhyloDiversity(), this doesn't include the node's own branch.
+{
+	if (isLeaf (iSubtreeIter))
+		return 0.0;
+	checkAggregates ();
+	// the living leaves below have aged by the clock since their stamps
+	weight_type theLength = getAggregate (iSubtreeIter).mNumAliveLeaves * mClock;
+	size_type theNumChildren = countChildren (iSubtreeIter);
+	for (size_type i = 0; i < theNumChildren; i++)
+		theLength += getAggregate (getChild (iSubtreeIter, i)).mWeight;
+	return theLength;
+}
+
+size_type MesaTree::getHeight (iterator iNodeIter)
+//: how many branches between this node & the root?
+{
+	checkAggregates ();
+	return getAggregate (iNodeIter).mDepth;
+}
+
+size_type MesaTree::getNodeReach (iterator iNodeIter)
+//: how many branches between this node & the furthest leaf below it?
+{
+	checkAggregates ();
+	return getAggregate (iNodeIter).mReach;
+}
+
+
 // *** NODE COLLECTION ******************************************************/
 
 
@@ -591,14 +691,38 @@ void MesaTree::getNodeVec (nodeidvec_t& iResultVec)
 
 void MesaTree::getLiveLeaves (vector<iterator>& ioIters)
 {
-	std::back_insert_iterator< vector<iterator> > theOutputIter (ioIters);
-	for (iterator q = begin(); q != end(); q++)
+	checkLiveIndex ();
+	ioIters.reserve (ioIters.size() + mLiveIds.size());
+	for (vector<id_type>::iterator q = mLiveIds.begin(); q != mLiveIds.end(); q++)
+		ioIters.push_back (getIter (*q));
+}
+
+MesaTree::iterator MesaTree::getLiveLeaf (size_type iIndex)
+//: return the nth living leaf, in the same order as getLiveLeaves
+{
+	checkLiveIndex ();
+	assert (iIndex < mLiveIds.size());
+	return getIter (mLiveIds[iIndex]);
+}
+
+void MesaTree::sampleLiveLeaves (size_type iNum, vector<iterator>& ioIters)
+//: pick this many living leaves at random (or all of them, if fewer)
+// This is a partial Fisher-Yates shuffle done on the index itself, which
+// has no order to preserve, so it costs only as many steps as are picked.
+{
+	checkLiveIndex ();
+	size_type theNumLeaves = mLiveIds.size();
+	if (theNumLeaves < iNum)
+		iNum = theNumLeaves;
+	for (size_type i = 0; i < iNum; i++)
 	{
-		if (isNodeAlive (q))
-		{
-			*theOutputIter = q;
-			theOutputIter++;
-		}
+		size_type j = i + size_type (MesaGlobals::mRng.UniformWhole (long (theNumLeaves - i)));
+		if (isUndoable())
+			logUndo (kUndo_LiveSwap, kTree_IdNone, i, j);
+		std::swap (mLiveIds[i], mLiveIds[j]);
+		mLivePositions[mLiveIds[i]] = long (i);
+		mLivePositions[mLiveIds[j]] = long (j);
+		ioIters.push_back (getIter (mLiveIds[i]));
 	}
 }
 
@@ -654,7 +778,13 @@ void MesaTree::getTaxaNames (stringvec_t& ioLabelVec)
 
 void MesaTree::setNodeName (iterator iTargetIter, std::string iName)
 {
-	iTargetIter->second.mData.mName = iName;
+	MesaTreeNode& theNode = iTargetIter->second.mData;
+	if (needsUndo (iTargetIter->first))
+	{
+		logUndo (kUndo_Name, iTargetIter->first, mUndoNames.size());
+		mUndoNames.push_back (theNode.mName);
+	}
+	theNode.setName (iName);
 }
 
 std::string MesaTree::getLeafName (iterator& iTargetIter)
@@ -793,24 +923,85 @@ void MesaTree::ageLeaf (iterator iLeafIter, double iAgeIncr)
 void MesaTree::ageAllLeaves (double iAgeIncr)
 // assume you mean living leaves
 // CHANGE (01.10.16): eliminated ageLeaf() and moved all functionality to here
+// CHANGE: this used to walk the tree and lengthen every living leaf, at
+// every event of an epoch. Now it just advances the tree clock, and each
+// leaf's weight is brought up to date when it speciates or dies, or when
+// synced at the end of the epoch. getEdgeWeight() allows for the lag.
+{
+	assert (0.0 <= iAgeIncr);
+	mClock += iAgeIncr;
+}
+
+void MesaTree::syncLeafAge (iterator iLeafIter)
+//: bring the stored weight of a single leaf up to the tree clock
+{
+	weight_type theStamp = iLeafIter->second.mData.mClockStamp;
+	if (theStamp < mClock)
+	{
+		logStamps (iLeafIter);
+		if (isNodeAlive (iLeafIter))
+			iLeafIter->second.setWeight (iLeafIter->second.getWeight() + mClock - theStamp);
+		iLeafIter->second.mData.mClockStamp = mClock;
+	}
+}
+
+void MesaTree::syncAllLeafAges ()
+//: bring all stored weights up to date and reset the clock
+// Called when an epoch finishes, so outside of epochs the stored weights
+// are exact and code that reads them directly sees the right values.
 {
+	if (mClock == 0.0)
+		return;
+		
+	bool theIsTotalled = areAggregatesCurrent ();
 	for (iterator q = begin (); q != end(); q++)
 	{
-		if (isNodeAlive (q))
+		// every living leaf below has aged by the clock since its stamp
+		if (theIsTotalled)
+		{
+			Aggregate& theTotals = getAggregate (q);
+			theTotals.mWeight += theTotals.mNumAliveLeaves * mClock;
+		}
+		
+		// only touch the nodes that change, so that where changes are being
+		// logged, the untouched bulk of a large tree isn't
+		MesaTreeNode& theNode = q->second.mData;
+		bool theIsAging = (theNode.mClockStamp < mClock) and isNodeAlive (q);
+		if (theIsAging or (theNode.mClockStamp != 0.0) or (theNode.mTraitStamp != 0.0))
 		{
-			// ageLeaf (q, iAgeIncr);
-				
-			assert (isLeaf (q));
-			double theOldAge = getEdgeWeight (q);
-			setEdgeWeight (q, theOldAge + iAgeIncr);
+			logStamps (q);
+			if (theIsAging)
+				q->second.setWeight (q->second.getWeight() + mClock - theNode.mClockStamp);
+			theNode.mClockStamp = 0.0;
+			theNode.mTraitStamp = 0.0;
 		}
 	}
+	mClock = 0.0;
 }
 
 void MesaTree::makeDead (iterator iDeadNode)
 //: add node to dead list
 {
+	// only the death of a leaf makes a difference to the totals, & as it
+	// doesn't edit the tree they must be kept or thrown out here
+	bool theIsTotalled = false;
+	Aggregate theOldTotals;
+	if (areAggregatesCurrent() and isLeaf (iDeadNode))
+	{
+		theIsTotalled = keepsAggregates ();
+		mAggregatesValid = theIsTotalled;
+		if (theIsTotalled)
+			theOldTotals = getAggregate (iDeadNode);
+	}
+	// fix the branch length while the node is still alive
+	syncLeafAge (iDeadNode);
+	if (isUndoable() and (not mDeadList.isMember (iDeadNode->first)))
+		logUndo (kUndo_Dead, iDeadNode->first);
 	mDeadList.insert (iDeadNode->first);
+	if (mLiveIndexValid)
+		eraseLiveLeaf (iDeadNode->first);
+	if (theIsTotalled and tallyAggregate (iDeadNode))
+		spreadAggregates (iDeadNode, theOldTotals);
 }
 
 void MesaTree::makeInternalsDead ()
@@ -893,11 +1084,38 @@ void  MesaTree::speciate
 {
 	id_type /*theChildId1, theChildId2,*/ theParId;
 	theParId = iSplitIter->first;
-	oChildIter1 = insertChild (iSplitIter);
-	oChildIter2 = insertChild (iSplitIter);
+	bool theIsTotalled = keepsAggregates ();
+	Aggregate theOldTotals;
+	if (theIsTotalled)
+		theOldTotals = getAggregate (iSplitIter);
+	// fix the branch length while the node is still a living leaf
+	syncLeafAge (iSplitIter);
+	// use the base insert, as the live index is updated by hand
+	oChildIter1 = base_type::insertChild (iSplitIter);
+	oChildIter2 = base_type::insertChild (iSplitIter);
+	forgetDeath (oChildIter1->first);
+	forgetDeath (oChildIter2->first);
 	setEdgeWeight (oChildIter1, 0.0);
 	setEdgeWeight (oChildIter2, 0.0);
+	setTraitStamp (oChildIter1, mClock);
+	setTraitStamp (oChildIter2, mClock);
 	makeDead (iSplitIter);
+	if (mLiveIndexValid)
+	{
+		insertLiveLeaf (oChildIter1->first);
+		insertLiveLeaf (oChildIter2->first);
+	}
+	if (theIsTotalled)
+	{
+		size_type theDepth = getAggregate (iSplitIter).mDepth + 1;
+		getAggregate (oChildIter1).mDepth = theDepth;
+		getAggregate (oChildIter2).mDepth = theDepth;
+		tallyAggregate (oChildIter1);
+		tallyAggregate (oChildIter2);
+		tallyAggregate (iSplitIter);
+		spreadAggregates (iSplitIter, theOldTotals);
+		mAggregateStamp = getEditStamp();
+	}
 }
 
 
@@ -986,11 +1204,19 @@ are additive.
 	
 	// Main:
 	// this works regardless of whether the parent is root or not
+	bool theIsTotalled = keepsAggregates ();
 	iterator theParentIt = getParent (ioNodeIt);
 	weight_type theParentWt = getEdgeWeight (theParentIt);
 	weight_type theChildWt = getEdgeWeight (ioNodeIt);
 	replace (theParentIt, ioNodeIt); 
 	setEdgeWeight (ioNodeIt, theParentWt + theChildWt);
+	if (theIsTotalled)
+	{
+		vector<iterator> theMovedNodes;
+		setDepths (ioNodeIt, theMovedNodes);
+		tallyAggregate (ioNodeIt);
+		resumeAggregates (getParent (ioNodeIt));
+	}
 	
 	// Postconditions:
 	if (not isRoot (ioNodeIt))
@@ -1023,6 +1249,75 @@ or is the root.
 }
 
 
+// These hide the tree-building calls of the base class, so that any
+// change in the shape of the tree can throw out the live-leaf index. It is
+// rebuilt on the next query. Only speciate() & makeDead() keep it current.
+// The prunings keep the subtree totals current, by recounting the nodes
+// above the cut. As new nodes may reuse the ids of deleted ones, the
+// inserts also take their ids off the dead list.
+
+iterator MesaTree::insertRoot (const MesaTreeNode& iNewData,
+	weight_type iNewWeight)
+{
+	invalidateLiveIndex ();
+	iterator theNewIter = base_type::insertRoot (iNewData, iNewWeight);
+	forgetDeath (theNewIter->first);
+	return theNewIter;
+}
+
+iterator MesaTree::insertChild (iterator iParentIter,
+	const MesaTreeNode& iNewData, weight_type iNewWeight)
+{
+	invalidateLiveIndex ();
+	iterator theNewIter = base_type::insertChild (iParentIter, iNewData,
+		iNewWeight);
+	forgetDeath (theNewIter->first);
+	return theNewIter;
+}
+
+iterator MesaTree::pruneSubtree (iterator& iSubtreeIter)
+{
+	bool theIsTotalled = keepsAggregates ();
+	invalidateLiveIndex ();
+	iterator theParentIter = base_type::pruneSubtree (iSubtreeIter);
+	if (theIsTotalled)
+		resumeAggregates (theParentIter);
+	return theParentIter;
+}
+
+iterator MesaTree::pruneBranch (iterator& iSubtreeIter)
+{
+	bool theIsTotalled = keepsAggregates ();
+	invalidateLiveIndex ();
+	iterator theParentIter = base_type::pruneBranch (iSubtreeIter);
+	if (theIsTotalled)
+		resumeAggregates (theParentIter);
+	return theParentIter;
+}
+
+iterator MesaTree::pruneLeaf (iterator& iLeafIter)
+{
+	bool theIsTotalled = keepsAggregates ();
+	invalidateLiveIndex ();
+	iterator theParentIter = base_type::pruneLeaf (iLeafIter);
+	if (theIsTotalled)
+		resumeAggregates (theParentIter);
+	return theParentIter;
+}
+
+void MesaTree::clear ()
+{
+	invalidateLiveIndex ();
+	base_type::clear ();
+}
+
+void MesaTree::replace (iterator& iOldIter, iterator& iNewIter)
+{
+	invalidateLiveIndex ();
+	base_type::replace (iOldIter, iNewIter);
+}
+
+
 void MesaTree::moveSubtree (iterator& ioSubtree, iterator& ioNewParent)
 //: detach child from old parent and shift it to new parent
 // Both nodes must, obviously, be valid. The moving subtree cannot be the
@@ -1035,14 +1330,182 @@ void MesaTree::moveSubtree (iterator& ioSubtree, iterator& ioNewParent)
 	assert (not isAncestorOf (ioSubtree, ioNewParent));
 	
 	// Main:
+	bool theIsTotalled = keepsAggregates ();
+	iterator theOldParent = getParent (ioSubtree);
+	invalidateLiveIndex ();
 	deleteParentEdge (ioSubtree); // remove subtree from old parent
 	newEdge (ioNewParent, ioSubtree); // add as child of new parent
+	if (theIsTotalled)
+	{
+		vector<iterator> theMovedNodes;
+		setDepths (ioSubtree, theMovedNodes);
+		updateAggregates (theOldParent);
+		resumeAggregates (ioNewParent);
+	}
 
 	// Postconditions:
 	assert (isParentOf (ioNewParent, ioSubtree));
 }
 
 
+// *** UNDOING ***********************************************************/
+
+// Changes to the base tree & to the state kept here are logged separately,
+// but each step here notes how long the base log was when it was made, so
+// rolling back can unwind the two in the order the changes were made.
+
+MesaTree::UndoMark MesaTree::markUndo ()
+//: start logging changes, so the tree can be rolled back to this point
+// The live-leaf index is built first, so that it doesn't have to be built
+// again after every rollback.
+{
+	checkLiveIndex ();
+	UndoMark theMark;
+	theMark.mTreeMark = base_type::markUndo ();
+	theMark.mNumSteps = mUndoSteps.size();
+	theMark.mClock = mClock;
+	theMark.mName = mName;
+	return theMark;
+}
+
+void MesaTree::rollbackUndo (const UndoMark& iMark)
+//: undo every change made to the tree since this mark
+{
+	assert (iMark.mNumSteps <= mUndoSteps.size());
+	while (iMark.mNumSteps < mUndoSteps.size())
+	{
+		UndoStep theStep = mUndoSteps.back();
+		mUndoSteps.pop_back();
+		while (theStep.mNumTreeSteps < countUndoSteps())
+			undoLastStep ();
+		undoStep (theStep);
+	}
+	base_type::rollbackUndo (iMark.mTreeMark);
+	mClock = iMark.mClock;
+	mName = iMark.mName;
+}
+
+void MesaTree::releaseUndo (const UndoMark& iMark)
+//: keep the changes made since this mark & stop logging for it
+{
+	base_type::releaseUndo (iMark.mTreeMark);
+	if (not isUndoable())
+	{
+		mUndoSteps.clear();
+		mUndoNames.clear();
+		mUndoLiveIds.clear();
+		mUndoLivePositions.clear();
+	}
+}
+
+void MesaTree::undoStep (const UndoStep& iStep)
+{
+	switch (iStep.mKind)
+	{
+		case kUndo_Stamps:
+		{
+			iterator theNodeIter = getIter (iStep.mId);
+			theNodeIter->second.setWeight (iStep.mWeight);
+			theNodeIter->second.mData.mClockStamp = iStep.mClockStamp;
+			theNodeIter->second.mData.mTraitStamp = iStep.mTraitStamp;
+			break;
+		}
+		
+		case kUndo_Name:
+		{
+			assert (iStep.mIndex == mUndoNames.size() - 1);
+			MesaTreeNode& theNode = getIter (iStep.mId)->second.mData;
+			theNode.setName (mUndoNames.back());
+			mUndoNames.pop_back();
+			break;
+		}
+			
+		case kUndo_Dead:
+			mDeadList.remove (iStep.mId);
+			break;
+			
+		case kUndo_Revived:
+			mDeadList.insert (iStep.mId);
+			break;
+			
+		case kUndo_LiveInsert:
+			assert (mLiveIds.back() == iStep.mId);
+			mLiveIds.pop_back();
+			mLivePositions[iStep.mId] = -1;
+			break;
+			
+		case kUndo_LiveErase:
+			// the leaf that was moved into the gap goes back to the end
+			if (iStep.mIndex < mLiveIds.size())
+			{
+				id_type theMovedId = mLiveIds[iStep.mIndex];
+				mLivePositions[theMovedId] = long (mLiveIds.size());
+				mLiveIds.push_back (theMovedId);
+				mLiveIds[iStep.mIndex] = iStep.mId;
+			}
+			else
+			{
+				mLiveIds.push_back (iStep.mId);
+			}
+			setLivePosition (iStep.mId, long (iStep.mIndex));
+			break;
+			
+		case kUndo_LiveSwap:
+			std::swap (mLiveIds[iStep.mIndex], mLiveIds[iStep.mOtherIndex]);
+			mLivePositions[mLiveIds[iStep.mIndex]] = long (iStep.mIndex);
+			mLivePositions[mLiveIds[iStep.mOtherIndex]] = long (iStep.mOtherIndex);
+			break;
+			
+		case kUndo_LiveLost:
+			assert (iStep.mIndex == mUndoLiveIds.size() - 1);
+			mLiveIds.swap (mUndoLiveIds.back());
+			mLivePositions.swap (mUndoLivePositions.back());
+			mUndoLiveIds.pop_back();
+			mUndoLivePositions.pop_back();
+			mLiveIndexValid = true;
+			break;
+			
+		case kUndo_LiveBuilt:
+			mLiveIds.clear();
+			mLivePositions.clear();
+			mLiveIndexValid = false;
+			break;
+			
+		default:
+			// should never get here
+			assert (false);
+	}
+}
+
+void MesaTree::logStamps (iterator iNodeIter)
+//: keep the weight & stamps of this node, if they will have to be restored
+{
+	if (needsUndo (iNodeIter->first))
+	{
+		logUndo (kUndo_Stamps, iNodeIter->first);
+		UndoStep& theStep = mUndoSteps.back();
+		theStep.mWeight = iNodeIter->second.getWeight();
+		theStep.mClockStamp = iNodeIter->second.mData.mClockStamp;
+		theStep.mTraitStamp = iNodeIter->second.mData.mTraitStamp;
+	}
+}
+
+void MesaTree::logUndo (UndoKind iKind, id_type iId, size_type iIndex,
+	size_type iOtherIndex)
+{
+	UndoStep theStep;
+	theStep.mKind = iKind;
+	theStep.mNumTreeSteps = countUndoSteps();
+	theStep.mId = iId;
+	theStep.mIndex = iIndex;
+	theStep.mOtherIndex = iOtherIndex;
+	theStep.mWeight = 0.0;
+	theStep.mClockStamp = 0.0;
+	theStep.mTraitStamp = 0.0;
+	mUndoSteps.push_back (theStep);
+}
+
+
 // *** I/O ***************************************************************/
 
 
@@ -1146,7 +1609,7 @@ void MesaTree::setNodeName (id_type theNewId, std::string iName)
 {
 	iterator q = findNode (theNewId);
 	assert (q != end());
-	q->second.mData.mName = iName;
+	setNodeName (q, iName);
 }
 
 std::string MesaTree::getNodeLabel (MesaTree::id_type iTargetId)
@@ -1233,5 +1696,219 @@ const char* MesaTree::getFirstTipName (MesaTree::id_type iTargetId)
 }
 
 
+// *** INTERNALS *********************************************************/
+
+void MesaTree::checkLiveIndex ()
+//: if the live-leaf index has been thrown out, rebuild it from the tree
+{
+	if (mLiveIndexValid)
+		return;
+		
+	if (isUndoable())
+		logUndo (kUndo_LiveBuilt, kTree_IdNone);
+	mLiveIds.clear();
+	mLivePositions.clear();
+	for (iterator q = begin(); q != end(); q++)
+	{
+		if (isNodeAlive (q))
+			insertLiveLeaf (q->first);
+	}
+	mLiveIndexValid = true;
+}
+
+void MesaTree::invalidateLiveIndex ()
+//: throw out the live-leaf index, as the shape of the tree has changed
+{
+	if (mLiveIndexValid and isUndoable())
+	{
+		// keep the old index by swapping it out, which costs nothing
+		logUndo (kUndo_LiveLost, kTree_IdNone, mUndoLiveIds.size());
+		mUndoLiveIds.push_back (vector<id_type>());
+		mUndoLiveIds.back().swap (mLiveIds);
+		mUndoLivePositions.push_back (vector<long>());
+		mUndoLivePositions.back().swap (mLivePositions);
+	}
+	mLiveIndexValid = false;
+}
+
+void MesaTree::insertLiveLeaf (id_type iLeafId)
+{
+	assert (getLivePosition (iLeafId) == -1);
+	if (isUndoable())
+		logUndo (kUndo_LiveInsert, iLeafId);
+	setLivePosition (iLeafId, long (mLiveIds.size()));
+	mLiveIds.push_back (iLeafId);
+}
+
+void MesaTree::forgetDeath (id_type iNodeId)
+//: a new node may reuse the id of a dead one that was deleted
+{
+	if (not mDeadList.isMember (iNodeId))
+		return;
+	if (isUndoable())
+		logUndo (kUndo_Revived, iNodeId);
+	mDeadList.remove (iNodeId);
+}
+
+void MesaTree::eraseLiveLeaf (id_type iLeafId)
+//: take a leaf out of the index, by moving the last one into its place
+{
+	long thePosition = getLivePosition (iLeafId);
+	if (thePosition == -1)
+		return;
+		
+	size_type theIndex = size_type (thePosition);
+	if (isUndoable())
+		logUndo (kUndo_LiveErase, iLeafId, theIndex);
+	id_type theLastId = mLiveIds.back();
+	mLiveIds[theIndex] = theLastId;
+	mLivePositions[theLastId] = thePosition;
+	mLiveIds.pop_back();
+	mLivePositions[iLeafId] = -1;
+}
+
+void MesaTree::setLivePosition (id_type iLeafId, long iIndex)
+//: note where this leaf is in the index, making room for new ids
+{
+	if (mLivePositions.size() <= size_type (iLeafId))
+		mLivePositions.resize (iLeafId + 1, -1);
+	mLivePositions[iLeafId] = iIndex;
+}
+
+MesaTree::Aggregate& MesaTree::getAggregate (iterator iNodeIter)
+{
+	id_type theId = iNodeIter->first;
+	if (mAggregates.size() <= size_type (theId))
+		mAggregates.resize (theId + 1);
+	return mAggregates[theId];
+}
+
+void MesaTree::checkAggregates ()
+//: if the subtree totals are out of date, work them all out afresh
+// Rather than recursing, which a deep tree could overflow, the nodes are
+// listed parents first & then totalled in reverse.
+{
+	if (areAggregatesCurrent())
+		return;
+		
+	if (not isEmpty())
+	{
+		vector<iterator> theNodes;
+		theNodes.reserve (countNodes());
+		setDepths (getRoot(), theNodes);
+		for (size_type i = theNodes.size(); 0 < i; i--)
+			tallyAggregate (theNodes[i - 1]);
+	}
+	mAggregatesValid = true;
+	mAggregateStamp = getEditStamp();
+}
+
+bool MesaTree::keepsAggregates () const
+//: should an edit to the tree keep the subtree totals up to date?
+{
+	return MesaGlobals::mPrefs.mKeepSubtreeTotals and areAggregatesCurrent();
+}
+
+bool MesaTree::tallyAggregate (iterator iNodeIter)
+//: total a node from its own branch & its children, saying if it changed
+// The children must already be right, but the depth is left alone.
+{
+	Aggregate theNew;
+	theNew.mNumLeaves = 0;
+	theNew.mNumAliveLeaves = 0;
+	theNew.mWeight = iNodeIter->second.getWeight();
+	theNew.mReach = 0;
+	
+	size_type theNumChildren = countChildren (iNodeIter);
+	if (theNumChildren == 0)
+	{
+		theNew.mNumLeaves = 1;
+		if (isNodeAlive (iNodeIter))
+		{
+			// allow for the lag in the weight, as in getEdgeWeight()
+			theNew.mNumAliveLeaves = 1;
+			theNew.mWeight -= iNodeIter->second.mData.mClockStamp;
+		}
+	}
+	for (size_type i = 0; i < theNumChildren; i++)
+	{
+		const Aggregate& theChild = getAggregate (getChild (iNodeIter, i));
+		theNew.mNumLeaves += theChild.mNumLeaves;
+		theNew.mNumAliveLeaves += theChild.mNumAliveLeaves;
+		theNew.mWeight += theChild.mWeight;
+		theNew.mReach = std::max (theNew.mReach, theChild.mReach + 1);
+	}
+	
+	Aggregate& theOld = getAggregate (iNodeIter);
+	bool theIsChanged = (theNew.mNumLeaves != theOld.mNumLeaves) or
+		(theNew.mNumAliveLeaves != theOld.mNumAliveLeaves) or
+		(theNew.mWeight != theOld.mWeight) or (theNew.mReach != theOld.mReach);
+	theNew.mDepth = theOld.mDepth;
+	theOld = theNew;
+	return theIsChanged;
+}
+
+void MesaTree::updateAggregates (iterator iNodeIter)
+//: after a change at this node, total it & those above it again
+// Stopping when a node's totals come out the same, as those above it
+// then can't have changed either.
+{
+	while (tallyAggregate (iNodeIter) and (not isRoot (iNodeIter)))
+		iNodeIter = getParent (iNodeIter);
+}
+
+void MesaTree::spreadAggregates (iterator iNodeIter, const Aggregate& iOldTotals)
+//: pass the change in the totals of this node on to those above it
+// Quicker than totalling each again, but only right where the reach of
+// the node can't have shrunk. The counts are unsigned, but wrap around to
+// give the right sums.
+{
+	const Aggregate& theNewTotals = getAggregate (iNodeIter);
+	size_type theNumLeaves = theNewTotals.mNumLeaves - iOldTotals.mNumLeaves;
+	size_type theNumAlive = theNewTotals.mNumAliveLeaves - iOldTotals.mNumAliveLeaves;
+	weight_type theWeight = theNewTotals.mWeight - iOldTotals.mWeight;
+	size_type theReach = theNewTotals.mReach;
+	while (not isRoot (iNodeIter))
+	{
+		iNodeIter = getParent (iNodeIter);
+		Aggregate& theTotals = getAggregate (iNodeIter);
+		theTotals.mNumLeaves += theNumLeaves;
+		theTotals.mNumAliveLeaves += theNumAlive;
+		theTotals.mWeight += theWeight;
+		theReach++;
+		theTotals.mReach = std::max (theTotals.mReach, theReach);
+	}
+}
+
+void MesaTree::resumeAggregates (iterator iNodeIter)
+//: after an edit below this node, total again above it & mark them current
+// The node may be end(), where the edit removed the whole tree.
+{
+	if (iNodeIter != end())
+		updateAggregates (iNodeIter);
+	mAggregateStamp = getEditStamp();
+}
+
+void MesaTree::setDepths (iterator iSubtreeIter, vector<iterator>& oNodes)
+//: set the depths in a subtree from its parent, listing it parents first
+{
+	iterator theParentIter = getParent (iSubtreeIter);
+	getAggregate (iSubtreeIter).mDepth = (theParentIter == end()) ?
+		0 : getAggregate (theParentIter).mDepth + 1;
+	oNodes.push_back (iSubtreeIter);
+	for (size_type i = oNodes.size() - 1; i < oNodes.size(); i++)
+	{
+		size_type theDepth = getAggregate (oNodes[i]).mDepth;
+		size_type theNumChildren = countChildren (oNodes[i]);
+		for (size_type j = 0; j < theNumChildren; j++)
+		{
+			iterator theChildIter = getChild (oNodes[i], j);
+			getAggregate (theChildIter).mDepth = theDepth + 1;
+			oNodes.push_back (theChildIter);
+		}
+	}
+}
+
+
 // *** END ***************************************************************/
 
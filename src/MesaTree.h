@@ -25,6 +25,7 @@ Credits:
 #include <cmath>
 #include <iterator>
 #include <utility>
+#include <map>
 
 
 // *** CONSTANTS & DEFINES
@@ -38,8 +39,31 @@ class MesaTreeNode
 // done this way so it can act as an agent or be expanded later.
 {                                                     
 public:
-	std::string		mName;
+	MesaTreeNode ()
+		: mClockStamp (0.0)
+		, mTraitStamp (0.0)
+		, mContRow (0), mContRowStamp (0)
+		, mDiscRow (0), mDiscRowStamp (0)
+		{}
+
+	void setName (const std::string& iName)
+	//: rename the taxon, forgetting its trait rows as they were found by name
+	{
+		mName = iName;
+		mContRowStamp = 0;
+		mDiscRowStamp = 0;
+	}
 
+	std::string		mName;	// change only through setName
+	double			mClockStamp; // tree clock when the weight was last updated
+	double			mTraitStamp; // tree clock up to which lazy traits are current
+	
+	// where this taxon's row was last found in the trait matrices, good
+	// while the matrix's row stamp matches (see ActionUtils)
+	unsigned long	mContRow;
+	unsigned long	mContRowStamp;
+	unsigned long	mDiscRow;
+	unsigned long	mDiscRowStamp;
 };
 
 
@@ -66,13 +90,19 @@ public:
 	typedef base_type::id_type					   id_type;
 	
 	// LIFECYCLE
-	/* nothing thus far */	
+	MesaTree ()
+		: mClock (0.0)
+		, mLiveIndexValid (false)
+		, mAggregatesValid (false)
+		, mAggregateStamp (0)
+		{}
 				
 	// ACCESSORS
 	std::string		getTreeName () const;
 	void				setTreeName (const char* iNameStr);
 	
 	size_type      countAliveLeaves ();
+	size_type      countLeaves ();
 
 	bool				isTreeRooted () { return true; }
 	bool           isTreeBifurcating ();
@@ -108,6 +138,14 @@ public:
 	size_type 		getDistance (iterator iChildIter, iterator iParIter);
 	
 	bool				isNodeAlive (iterator& iNode);
+	weight_type		getClock () const
+		{ return mClock; }
+	weight_type		getLineageClock (iterator iNodeIter);
+	weight_type		getEdgeWeight (iterator iNodeIter);
+	weight_type		getEdgeWeight (iterator iNodeIter, bool iIsAlive);
+	using base_type::setEdgeWeight;
+	void				setEdgeWeight (iterator iNodeIter, weight_type iNewWt);
+	void				setTraitStamp (iterator iNodeIter, weight_type iStamp);
 	bool           isNodeBifurcating (iterator& iNode);
 	bool           isNodeSingleton (iterator& iNode);
 	
@@ -118,6 +156,8 @@ public:
 
 	// MUTATORS	
 	void		ageAllLeaves (double iAgeIncr);
+	void		syncLeafAge (iterator iLeafIter);
+	void		syncAllLeafAges ();
 	
 	void		speciate (iterator iSplitIter, iterator& oChildIter1, iterator& oChildIter2);
 	void		killLeaf (iterator& iLeafIter);
@@ -125,6 +165,17 @@ public:
 	void     makeDead (iterator iDeadNode);
 	void     makeInternalsDead ();
 	
+	iterator	insertRoot (const MesaTreeNode& iNewData = MesaTreeNode(),
+		weight_type iNewWeight = sbl::kTree_DefaultWt);
+	iterator	insertChild (iterator iParentIter,
+		const MesaTreeNode& iNewData = MesaTreeNode(),
+		weight_type iNewWeight = sbl::kTree_DefaultWt);
+	iterator	pruneSubtree (iterator& iSubtreeIter);
+	iterator	pruneBranch (iterator& iSubtreeIter);
+	iterator	pruneLeaf (iterator& iLeafIter);
+	void		clear ();
+	void		replace (iterator& iOldIter, iterator& iNewIter);
+
 	void		moveSubtree (iterator& ioNewChild, iterator& ioNewParent);
 	void		collapseNode (iterator ioNodeIter);
 	void		collapseBranch (iterator ioNodeIt);
@@ -132,6 +183,32 @@ public:
 	iterator     addNode (sbl::CaicCode theNewCode);
 	iterator     addNodeHelper (sbl::CaicCode iNewCode, iterator iParentIt);
 
+	// SUBTREE TOTALS
+	// Worked out for every node when first asked for. If the preference is
+	// set, they are then kept up to date by speciate(), killLeaf(), the
+	// pruning calls, collapseNode() & moveSubtree(). Otherwise, or after
+	// other changes to the tree, they are worked out afresh when next asked.
+	size_type      countLeaves (iterator iSubtreeIter);
+	size_type      countAliveLeaves (iterator iSubtreeIter);
+	weight_type    getSubtreeLength (iterator iSubtreeIter);
+	size_type      getHeight (iterator iNodeIter);
+	size_type      getNodeReach (iterator iNodeIter);
+
+	// UNDOING
+	// As for the base tree, but also covering the living & dead leaves,
+	// the node names & stamps and the clock.
+	struct UndoMark
+	{
+		base_type::UndoMark   mTreeMark;
+		size_type             mNumSteps;
+		weight_type           mClock;
+		std::string           mName;
+	};
+	
+	UndoMark    markUndo ();
+	void        rollbackUndo (const UndoMark& iMark);
+	void        releaseUndo (const UndoMark& iMark);
+
 
 	// I/O
 	std::string		writeNewick (TranslationTable* iTranslatorP = NULL);
@@ -147,6 +224,8 @@ public:
 	}
 
 	void 			getLiveLeaves (std::vector<iterator>& ioIters);
+	iterator		getLiveLeaf (size_type iIndex);
+	void 			sampleLiveLeaves (size_type iNum, std::vector<iterator>& ioIters);
 	void 			getLeaves (std::vector<iterator>& ioIters);
 	void			collectLeaveIds (id_type iTargetId, nodeidvec_t& iResultVec);
 	std::string getNodeLabel (MesaTree::id_type iTargetId);
@@ -166,6 +245,85 @@ public:
 private:
 	std::string       mName;
 	membership_type   mDeadList; // store the id's of dead nodes
+	weight_type       mClock;    // time living leaves have aged but not stored
+	
+	// the living leaves, in no particular order, & where each id is in it
+	// (indexed by id, as ids are dense, with -1 for those not living)
+	std::vector<id_type>          mLiveIds;
+	std::vector<long>             mLivePositions;
+	bool                          mLiveIndexValid;
+
+	void        checkLiveIndex ();
+	void        invalidateLiveIndex ();
+	void        insertLiveLeaf (id_type iLeafId);
+	void        forgetDeath (id_type iNodeId);
+	void        eraseLiveLeaf (id_type iLeafId);
+	long        getLivePosition (id_type iLeafId) const
+		{ return (size_type (iLeafId) < mLivePositions.size()) ?
+			mLivePositions[iLeafId] : -1; }
+	void        setLivePosition (id_type iLeafId, long iIndex);
+	
+	// the totals over the subtree of each node, by id, good while valid &
+	// the stamp matches the edit stamp of the tree
+	struct Aggregate
+	{
+		size_type     mNumLeaves;
+		size_type     mNumAliveLeaves;
+		weight_type   mWeight;   // stored weights, less living leaves' stamps
+		size_type     mDepth;    // branches up to the root
+		size_type     mReach;    // branches down to the furthest leaf
+	};
+	
+	std::vector<Aggregate>   mAggregates;
+	bool                     mAggregatesValid;
+	unsigned long            mAggregateStamp;
+	
+	bool        areAggregatesCurrent () const
+		{ return mAggregatesValid and (mAggregateStamp == getEditStamp()); }
+	bool        keepsAggregates () const;
+	Aggregate&  getAggregate (iterator iNodeIter);
+	void        checkAggregates ();
+	bool        tallyAggregate (iterator iNodeIter);
+	void        updateAggregates (iterator iNodeIter);
+	void        spreadAggregates (iterator iNodeIter, const Aggregate& iOldTotals);
+	void        resumeAggregates (iterator iNodeIter);
+	void        setDepths (iterator iSubtreeIter, std::vector<iterator>& oNodes);
+	
+	// the changes to this level of the tree, logged in step with the base
+	enum UndoKind
+	{
+		kUndo_Stamps,
+		kUndo_Name,
+		kUndo_Dead,
+		kUndo_Revived,
+		kUndo_LiveInsert,
+		kUndo_LiveErase,
+		kUndo_LiveSwap,
+		kUndo_LiveLost,
+		kUndo_LiveBuilt
+	};
+	
+	struct UndoStep
+	{
+		UndoKind      mKind;
+		size_type     mNumTreeSteps; // length of the base log at the time
+		id_type       mId;
+		size_type     mIndex;
+		size_type     mOtherIndex;
+		weight_type   mWeight;
+		double        mClockStamp;
+		double        mTraitStamp;
+	};
+	
+	std::vector<UndoStep>      mUndoSteps;
+	std::vector<std::string>   mUndoNames;
+	std::vector< std::vector<id_type> >            mUndoLiveIds;
+	std::vector< std::vector<long> >               mUndoLivePositions;
+	
+	void        logStamps (iterator iNodeIter);
+	void        logUndo (UndoKind iKind, id_type iId, size_type iIndex = 0,
+	               size_type iOtherIndex = 0);
+	void        undoStep (const UndoStep& iStep);
 
 	size_type	getChildIndex (iterator& iChildIter);
 
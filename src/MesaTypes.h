@@ -25,6 +25,7 @@ Changes:
 // *** INCLUDES
 
 #include "callback.hpp"
+#include "DiscState.h"
 #include <vector>
 #include <string>
 
@@ -57,7 +58,7 @@ typedef std::vector<stringvec_t> stringmatrix_t;
 
 // the datatypes for characters
 typedef double conttrait_t;
-typedef std::string disctrait_t;
+typedef DiscState disctrait_t; // interned, converts to & from strings
 
 /**
 The type of data in input file entries.
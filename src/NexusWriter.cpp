@@ -14,6 +14,7 @@ Credits:
 
 #include "NexusWriter.h"
 #include "TranslationTable.h"
+#include "TreeSnapshot.h"
 #include "MesaVersion.h"
 
 using sbl::SimpleMatrix;
@@ -100,6 +101,36 @@ void NexusWriter::writeTaxa (stringvec_t& iTaxaNames)
 }
 
 
+void NexusWriter::writeDistances
+(const TreeSnapshot& iSnapshot, stringvec_t& iLeafNames)
+//: write the distances between the leaves of a tree as a lower triangle
+// The leaves are named in the block & in the order of the snapshot. Each
+// row is worked out as it is written, so the matrix is never held whole.
+{
+	// Preconditions:
+	TreeSnapshot::size_type theNumLeaves = iSnapshot.countLeaves();
+	assert (iLeafNames.size() == theNumLeaves);
+	if (theNumLeaves == 0)
+		return;
+
+	// Main:
+	writeBeginBlock ("DISTANCES");
+	mOutStream << "\tDIMENSIONS NEWTAXA NTAX=" << int (theNumLeaves) << ";\n";
+	mOutStream << "\tFORMAT TRIANGLE=LOWER DIAGONAL LABELS;\n";
+	mOutStream << "\tMATRIX" << "\n";
+	std::vector<TreeSnapshot::weight_type> theRow;
+	for (TreeSnapshot::size_type i = 0; i < theNumLeaves; i++)
+	{
+		iSnapshot.getLeafDistances (i, theRow);
+		mOutStream << "\t\t" << literal (iLeafNames[i]);
+		for (TreeSnapshot::size_type j = 0; j < i; j++)
+			mOutStream << '\t' << theRow[j];
+		mOutStream << '\t' << 0 << '\n';
+	}
+	mOutStream << "\t;" << "\n";
+	writeEndBlock ();
+}
+
 
 // *** WRITING UTILITIES *************************************************/
 
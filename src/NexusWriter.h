@@ -32,6 +32,7 @@ About:
 // *** CONSTANTS & DEFINES
 
 class CharStateSet;
+class TreeSnapshot;
 
 
 // *** CLASS DECLARATION *************************************************/
@@ -56,6 +57,7 @@ public:
 	void	writeContData (ContTraitMatrix& iWrangler);
 	void	writeTrees (TreeWrangler& iWrangler, bool iWriteTransCmd);
 	void	writeTaxa (stringvec_t& iTaxaNames);
+	void	writeDistances (const TreeSnapshot& iSnapshot, stringvec_t& iLeafNames);
 
 	// Nexus writing commands
 	void	writeHeader ();
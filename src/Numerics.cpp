@@ -16,6 +16,7 @@ Credits:
 #include "Numerics.h"
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 
 using std::log;
 
@@ -189,6 +190,46 @@ long recFactorial (long n)
 }
 
 
+/**
+Factor a symmetric positive definite matrix as L L', L lower triangular.
+
+@param  iMatrix  The matrix, stored row by row.
+@param  iSize    The number of rows and columns.
+@param  oLower   The factor L, stored row by row with zeroes above the
+                 diagonal.
+@return          False if the matrix is not positive definite.
+*/
+bool choleskyFactor (const std::vector<double>& iMatrix, long iSize,
+	std::vector<double>& oLower)
+{
+	// Preconditions:
+	assert (0 < iSize);
+	assert ((long) iMatrix.size() == (iSize * iSize));
+	
+	// Main:
+	oLower.assign (iSize * iSize, 0.0);
+	for (long i = 0; i < iSize; i++)
+	{
+		for (long j = 0; j <= i; j++)
+		{
+			double theSum = iMatrix[(i * iSize) + j];
+			for (long k = 0; k < j; k++)
+				theSum -= oLower[(i * iSize) + k] * oLower[(j * iSize) + k];
+			if (i == j)
+			{
+				if (theSum <= 0.0)
+					return false;
+				oLower[(i * iSize) + i] = std::sqrt (theSum);
+			}
+			else
+			{
+				oLower[(i * iSize) + j] = theSum / oLower[(j * iSize) + j];
+			}
+		}
+	}
+	return true;
+}
+
 
 
 // *** END ***************************************************************/
@@ -16,6 +16,8 @@ Credits:
 
 // *** INCLUDES
 
+#include <vector>
+
 // *** CONSTANTS & DEFINES
 
 // *** FUNCTION DECLARATIONS *********************************************/
@@ -33,6 +35,9 @@ double factorialStirling (long n);
 long swing (long n);
 long recFactorial (long n);
 
+bool    choleskyFactor (const std::vector<double>& iMatrix, long iSize,
+           std::vector<double>& oLower);
+
 
 #endif
 // *** END ***************************************************************/
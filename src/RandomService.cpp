@@ -21,8 +21,17 @@ About:
 - This can serve as the base class for a family of RNGs, with the others
   needing only to define their basic "randomness" generator, Generator()
   and perhaps InitSeed() and SetSeed().
-- Implemented as a linear congruential generator, where f(z) = 16807 z mod
-  (2 ** 31 - 1). Uses L. Schrage's method to avoid overflow problems.
+- Implemented as a counter-based generator, Philox 4x32-10 (Salmon et al.
+  (2011) "Parallel Random Numbers: As Easy as 1, 2, 3", SC11). Each block
+  of four 32-bit words is a keyed bijection of a 128-bit counter, so the
+  state is just the key and the counter. The seed sets the key; Split()
+  derives a fresh key for a numbered stream without advancing this one.
+  The multiplications are done on 16-bit halves so that only 32-bit
+  arithmetic is needed.
+- Normals and exponentials use the ziggurat method of Marsaglia & Tsang
+  (2000) J Stat Soft 5:8, with 128 and 256 layers. As recommended by
+  Doornik (2005), the layer is picked with a different word to the one
+  that gives the value, so the two are independent.
 - The names "Float" and "Whole"  are used to avoid implying incorrect
   limitations to the random functions, and also to divide them into two
   broad classes: those that take and return decimal/real numbers and those
@@ -82,8 +91,106 @@ SBL_NAMESPACE_START
 
 // *** CONSTANTS & DEFINES
 
-const long	kRandMax = 2147483647L;
-const long	kA = 16807;         		
+const unsigned long	kWordMask = 0xFFFFFFFFUL;
+
+// Philox multipliers and Weyl key increments
+const unsigned long	kPhiloxM0 = 0xD2511F53UL;
+const unsigned long	kPhiloxM1 = 0xCD9E8D57UL;
+const unsigned long	kPhiloxW0 = 0x9E3779B9UL;
+const unsigned long	kPhiloxW1 = 0xBB67AE85UL;
+const int				kPhiloxRounds = 10;
+
+// marks the counters used to derive the keys of split streams
+const unsigned long	kSplitMark = 0x53504C54UL;
+
+// how many normals or exponentials are made at once for single draws
+const std::size_t		kPoolSize = 256;
+
+// the ziggurats
+const double	kZigNormR = 3.442619855899;
+const double	kZigNormV = 9.91256303526217e-3;
+const double	kZigExpR = 7.697117470131487;
+const double	kZigExpV = 3.949659822581572e-3;
+const double	kTwoTo31 = 2147483648.0;
+const double	kTwoTo32 = 4294967296.0;
+
+struct ZigguratTables
+//: the layer edges (k), widths (w) and densities (f) of both ziggurats
+{
+	double	mNormK[128], mNormW[128], mNormF[128];
+	double	mExpK[256], mExpW[256], mExpF[256];
+	
+	ZigguratTables ()
+	{
+		double theEdge = kZigNormR;
+		double thePrevEdge = theEdge;
+		double q = kZigNormV / std::exp (-0.5 * theEdge * theEdge);
+		mNormK[0] = (theEdge / q) * kTwoTo31;
+		mNormK[1] = 0.0;
+		mNormW[0] = q / kTwoTo31;
+		mNormW[127] = theEdge / kTwoTo31;
+		mNormF[0] = 1.0;
+		mNormF[127] = std::exp (-0.5 * theEdge * theEdge);
+		for (int i = 126; 1 <= i; i--)
+		{
+			theEdge = std::sqrt (-2.0 * std::log (kZigNormV / theEdge +
+				std::exp (-0.5 * theEdge * theEdge)));
+			mNormK[i + 1] = (theEdge / thePrevEdge) * kTwoTo31;
+			thePrevEdge = theEdge;
+			mNormF[i] = std::exp (-0.5 * theEdge * theEdge);
+			mNormW[i] = theEdge / kTwoTo31;
+		}
+		
+		theEdge = kZigExpR;
+		thePrevEdge = theEdge;
+		q = kZigExpV / std::exp (-theEdge);
+		mExpK[0] = (theEdge / q) * kTwoTo32;
+		mExpK[1] = 0.0;
+		mExpW[0] = q / kTwoTo32;
+		mExpW[255] = theEdge / kTwoTo32;
+		mExpF[0] = 1.0;
+		mExpF[255] = std::exp (-theEdge);
+		for (int i = 254; 1 <= i; i--)
+		{
+			theEdge = -std::log (kZigExpV / theEdge + std::exp (-theEdge));
+			mExpK[i + 1] = (theEdge / thePrevEdge) * kTwoTo32;
+			thePrevEdge = theEdge;
+			mExpF[i] = std::exp (-theEdge);
+			mExpW[i] = theEdge / kTwoTo32;
+		}
+	}
+};
+
+static const ZigguratTables& getZigguratTables ()
+{
+	static ZigguratTables theTables;
+	return theTables;
+}
+
+
+static void MultiplyWords (unsigned long iA, unsigned long iB,
+	unsigned long& oHi, unsigned long& oLo)
+//: the high and low 32-bit words of the product of two 32-bit words
+// Where a long is wide enough the product is taken directly; otherwise
+// it is built from 16-bit halves. The test is resolved at compile time.
+{
+	if (8 <= sizeof (unsigned long))
+	{
+		unsigned long theProduct = iA * iB;
+		oLo = theProduct & kWordMask;
+		oHi = ((theProduct >> 16) >> 16) & kWordMask;
+		return;
+	}
+	unsigned long theA0 = iA & 0xFFFF, theA1 = iA >> 16;
+	unsigned long theB0 = iB & 0xFFFF, theB1 = iB >> 16;
+	unsigned long theP00 = theA0 * theB0;
+	unsigned long theP01 = theA0 * theB1;
+	unsigned long theP10 = theA1 * theB0;
+	unsigned long theP11 = theA1 * theB1;
+	unsigned long theMid = (theP00 >> 16) + (theP01 & 0xFFFF) + (theP10 & 0xFFFF);
+	oLo = (((theMid & 0xFFFF) << 16) | (theP00 & 0xFFFF)) & kWordMask;
+	oHi = (theP11 + (theP01 >> 16) + (theP10 >> 16) + (theMid >> 16)) & kWordMask;
+}
 
 
 // *** MAIN BODY *********************************************************/
@@ -121,11 +228,43 @@ void RandomService::InitSeed ()
 // *** ACCESS ************************************************************/
 
 // SET SEED
-// Note how seed is bulletproofed against being set to 0. If linear
-// congruential generators are seeded with 0, the result is Bad.
+// Any value is a good seed for a counter-based generator, including 0. The
+// seed becomes the key, and the counter starts again from zero.
 void RandomService::SetSeed ( long iSeed )
 {
-	mSeed = iSeed ? (iSeed & kRandMax) : 1;
+	unsigned long theSeed = (unsigned long) iSeed;
+	mKey[0] = theSeed & kWordMask;
+	// the shift is split so it is defined where a long is 32 bits
+	mKey[1] = ((theSeed >> 16) >> 16) & kWordMask;
+	mCounter[0] = mCounter[1] = mCounter[2] = mCounter[3] = 0;
+	mBlockPos = 4;
+	ResetPools();
+}
+
+
+RandomService RandomService::Split ( unsigned long iStreamId ) const
+//: return an independent generator for the numbered stream
+// The new key is a Philox block of this key over a counter reserved for
+// splitting, so different stream ids give unrelated streams, the same id
+// always gives the same stream, and this generator is left as it was.
+// Streams can be split again, e.g. by replicate and then by tree.
+{
+	word_type theCounter[4];
+	theCounter[0] = iStreamId & kWordMask;
+	theCounter[1] = ((iStreamId >> 16) >> 16) & kWordMask;
+	theCounter[2] = 0;
+	theCounter[3] = kSplitMark;
+	word_type theBlock[4];
+	Philox (mKey, theCounter, theBlock);
+	
+	RandomService theStream (*this);
+	theStream.mKey[0] = theBlock[0];
+	theStream.mKey[1] = theBlock[1];
+	theStream.mCounter[0] = theStream.mCounter[1] = 0;
+	theStream.mCounter[2] = theStream.mCounter[3] = 0;
+	theStream.mBlockPos = 4;
+	theStream.ResetPools();
+	return theStream;
 }
 
 
@@ -137,31 +276,131 @@ double RandomService::Generate ()
 // (eventually) by all others to generate numbers in the appropriate
 // intervals. It's one of two functions that can be over-ridden in a
 // derived class.
+// Two words give 53 bits, and the half-step offset keeps the result
+// strictly inside (0,1), so callers can safely take logs of it.
+{
+	double theHi = double (NextWord() >> 5);    // 27 bits
+	double theLo = double (NextWord() >> 6);    // 26 bits
+	return ((theHi * 67108864.0) + theLo + 0.5) / 9007199254740992.0;
+}
+
+
+RandomService::word_type RandomService::NextWord ()
+//: return the next 32-bit word, making a new block when needed
+{
+	if (mBlockPos == 4)
+	{
+		Philox (mKey, mCounter, mBlock);
+		mBlockPos = 0;
+		// step the 128-bit counter
+		for (int i = 0; i < 4; i++)
+		{
+			mCounter[i] = (mCounter[i] + 1) & kWordMask;
+			if (mCounter[i] != 0)
+				break;
+		}
+	}
+	return mBlock[mBlockPos++];
+}
+
+
+void RandomService::ResetPools ()
+//: throw away any batched draws, e.g. when the stream changes
+{
+	mNormalPos = mNormalPool.size();
+	mExpPos = mExpPool.size();
+}
+
+
+double RandomService::ZigguratNormal ()
+//: one standard normal deviate
 {
-/*
-GOTCHA: note the typecasting to double in the last line. Without
-this, the return from this function will always be 0, as the result of
-a long divsion will be a long, and as it is less than 1, becomes 0.
-*/
-	unsigned long	theLo, theHi;
-
-	theLo = (unsigned long) (kA * (long) (mSeed & 0xFFFF));
-	theHi = (unsigned long) (kA * (long) ((unsigned long) mSeed >> 16));
-	theLo += (theHi & 0x7FFF) << 16;
-	if (theLo > (unsigned long) kRandMax)
+	const ZigguratTables& theTables = getZigguratTables();
+	while (true)
 	{
-	   theLo &= kRandMax;
-	   ++theLo;
+		int theLayer = int (NextWord() & 127);
+		word_type theWord = NextWord();
+		double theValue = (theWord < 0x80000000UL) ? double (theWord) :
+			double (theWord) - kTwoTo32;
+		
+		// the common case: inside the rectangle of this layer
+		if (std::fabs (theValue) < theTables.mNormK[theLayer])
+			return theValue * theTables.mNormW[theLayer];
+		
+		double x = theValue * theTables.mNormW[theLayer];
+		if (theLayer == 0)
+		{
+			// from the tail, by Marsaglia's method
+			double y;
+			do
+			{
+				x = -std::log (Generate()) / kZigNormR;
+				y = -std::log (Generate());
+			}
+			while ((y + y) < (x * x));
+			return (0.0 < theValue) ? (kZigNormR + x) : (-kZigNormR - x);
+		}
+		
+		// from the wedge under the curve
+		double theF = theTables.mNormF[theLayer];
+		double theFPrev = theTables.mNormF[theLayer - 1];
+		if ((theF + Generate() * (theFPrev - theF)) < std::exp (-0.5 * x * x))
+			return x;
 	}
-	theLo += theHi >> 15;
-	if (theLo > (unsigned long) kRandMax)
+}
+
+
+double RandomService::ZigguratExponential ()
+//: one exponential deviate of unit rate
+{
+	const ZigguratTables& theTables = getZigguratTables();
+	while (true)
 	{
-	   theLo &= kRandMax;
-	   ++theLo;
+		int theLayer = int (NextWord() & 255);
+		double theValue = double (NextWord());
+		
+		if (theValue < theTables.mExpK[theLayer])
+			return theValue * theTables.mExpW[theLayer];
+		
+		if (theLayer == 0)
+			return kZigExpR - std::log (Generate());
+		
+		double x = theValue * theTables.mExpW[theLayer];
+		double theF = theTables.mExpF[theLayer];
+		double theFPrev = theTables.mExpF[theLayer - 1];
+		if ((theF + Generate() * (theFPrev - theF)) < std::exp (-x))
+			return x;
 	}
+}
+
 
-	mSeed = (long) theLo;
-	return (double (mSeed) / double (kRandMax));
+void RandomService::Philox
+( const word_type iKey[2], const word_type iCounter[4], word_type oBlock[4] )
+//: the Philox 4x32-10 bijection of a counter under a key
+{
+	word_type theKey0 = iKey[0], theKey1 = iKey[1];
+	word_type theCtr[4] = { iCounter[0], iCounter[1], iCounter[2], iCounter[3] };
+	
+	for (int r = 0; r < kPhiloxRounds; r++)
+	{
+		if (0 < r)
+		{
+			theKey0 = (theKey0 + kPhiloxW0) & kWordMask;
+			theKey1 = (theKey1 + kPhiloxW1) & kWordMask;
+		}
+		word_type theHi0, theLo0, theHi1, theLo1;
+		MultiplyWords (kPhiloxM0, theCtr[0], theHi0, theLo0);
+		MultiplyWords (kPhiloxM1, theCtr[2], theHi1, theLo1);
+		word_type theNew0 = theHi1 ^ theCtr[1] ^ theKey0;
+		word_type theNew2 = theHi0 ^ theCtr[3] ^ theKey1;
+		theCtr[0] = theNew0;
+		theCtr[1] = theLo1;
+		theCtr[2] = theNew2;
+		theCtr[3] = theLo0;
+	}
+	
+	for (int i = 0; i < 4; i++)
+		oBlock[i] = theCtr[i];
 }
 
 
@@ -197,6 +436,52 @@ long RandomService::UniformWhole ( long iFloor, long iCeiling )
 }
 
 
+// *** BATCHED VARIATES
+// For loops that need many draws, filling a buffer in one call keeps the
+// generator's state in registers and lets the loop run without calls.
+// The single draws come from an internal batch filled the same way.
+
+void RandomService::FillUniform ( double* oBuffer, long iNum )
+{
+	for (long i = 0; i < iNum; i++)
+		oBuffer[i] = Generate();
+}
+
+void RandomService::FillStdNormal ( double* oBuffer, long iNum )
+{
+	for (long i = 0; i < iNum; i++)
+		oBuffer[i] = ZigguratNormal();
+}
+
+void RandomService::FillStdExponential ( double* oBuffer, long iNum )
+{
+	for (long i = 0; i < iNum; i++)
+		oBuffer[i] = ZigguratExponential();
+}
+
+double RandomService::StdNormal ()
+{
+	if (mNormalPool.size() <= mNormalPos)
+	{
+		mNormalPool.resize (kPoolSize);
+		FillStdNormal (&mNormalPool[0], long (kPoolSize));
+		mNormalPos = 0;
+	}
+	return mNormalPool[mNormalPos++];
+}
+
+double RandomService::StdExponential ()
+{
+	if (mExpPool.size() <= mExpPos)
+	{
+		mExpPool.resize (kPoolSize);
+		FillStdExponential (&mExpPool[0], long (kPoolSize));
+		mExpPos = 0;
+	}
+	return mExpPool[mExpPos++];
+}
+
+
 // *** OTHER DISTRIBUTIONS
 
 // *** NORMAL DISTRIBUTION
@@ -232,6 +517,52 @@ long RandomService::NormalWhole ( long iFloor, long iCeiling )
 }
 
 
+// *** POISSON DISTRIBUTION
+
+long RandomService::PoissonWhole ( double iMean )
+// Small means count the uniforms whose product stays above exp(-mean).
+// Large ones would need too many, so use the transformed rejection method
+// of Hormann (1993) Insurance: Math & Econ 12:1, which takes about one
+// pair of uniforms whatever the mean.
+{
+	assert (0.0 <= iMean);
+	
+	if (iMean < 10.0)
+	{
+		double theFloor = std::exp (-iMean);
+		double theProduct = Generate ();
+		long theCount = 0;
+		while (theFloor < theProduct)
+		{
+			theProduct *= Generate ();
+			theCount++;
+		}
+		return theCount;
+	}
+	
+	double theRoot = std::sqrt (iMean);
+	double theLogMean = std::log (iMean);
+	double b = 0.931 + 2.53 * theRoot;
+	double a = -0.059 + 0.02483 * b;
+	double theInvAlpha = 1.1239 + 1.1328 / (b - 3.4);
+	double theAccept = 0.9277 - 3.6224 / (b - 2.0);
+	while (true)
+	{
+		double u = Generate () - 0.5;
+		double v = Generate ();
+		double us = 0.5 - std::fabs (u);
+		long k = long (std::floor ((2.0 * a / us + b) * u + iMean + 0.43));
+		if ((0.07 <= us) and (v <= theAccept))
+			return k;
+		if ((k < 0) or ((us < 0.013) and (us < v)))
+			continue;
+		if ((std::log (v) + std::log (theInvAlpha) - std::log (a / (us * us) + b)) <=
+			(-iMean + k * theLogMean - lgamma (k + 1.0)))
+			return k;
+	}
+}
+
+
 // *** DEPRECATED FUNCTIONS *********************************************/
 
 
@@ -309,11 +640,11 @@ void RandomService::Test()
 {
 	DBG_MSG("*** Testing RandomService class");
 	
-	DBG_MSG("After seeding with 1 & 10K reps, seed == 1043618065");		
-	SetSeed(1);
-   for (int i = 0; i < 10000; ++i)
-		(void) Generate();		
-	DBG_MSG("After 10,000 reps, the seed is " << mSeed);
+	DBG_MSG("Philox 4x32-10 of a zero counter & key is 6627e8d5 e169c58d ...");
+	word_type theZeros[4] = { 0, 0, 0, 0 };
+	word_type theBlock[4];
+	Philox (theZeros, theZeros, theBlock);
+	DBG_MSG("Got " << std::hex << theBlock[0] << " " << theBlock[1] << std::dec);
 	
 	InitSeed();
 	
@@ -16,9 +16,23 @@ Credits:
 
 About:
 
-- A psuedo-random number generator, implemented as a linear congruential
+- A psuedo-random number generator, implemented as a counter-based
 
-  generator, that can serve as the base class for a family of RNG services.
+  generator (Philox 4x32-10), that can serve as the base class for a family
+
+  of RNG services.
+
+- Being counter-based, a generator can be split into independent streams
+
+  in constant time, so each replicate or tree can have its own
+
+  reproducible stream.
+
+- Normal and exponential variates are made by the ziggurat method, a
+
+  whole buffer at a time, so hot loops need neither logs nor trig for
+
+  most draws. Single draws are served from an internal batch.
 
 
 
@@ -40,6 +54,10 @@ About:
 
 #include <cmath>
 
+#include <algorithm>
+
+#include <vector>
+
 
 
 
@@ -76,6 +94,8 @@ public:
 
 	void	SetSeed 	( long iSeed ); // can be overidden
 
+	RandomService	Split	( unsigned long iStreamId ) const;
+
 	
 
 	// RNGs
@@ -107,102 +127,111 @@ public:
 	long		NormalWhole		( long iFloor, long iCeiling );
 
 
+	// Poisson distribution
+
+	long		PoissonWhole	( double iMean );
+
+
 
 
 
 	double   gaussian (double iMean, double iStdDev)
 
-	{
+	//: a normal deviate with this mean and standard deviation
 
-        double u, v;
+	{
 
+		return iMean + iStdDev * StdNormal();
 
+	}
 
-        do
 
-        {
 
-            u = Generate();
+	// Batched variates
 
-            v = Generate();    
+	double	StdNormal		();
 
-        }
+	double	StdExponential	();
 
-        while (v == 0);
+	void	FillUniform		( double* oBuffer, long iNum );
 
+	void	FillStdNormal		( double* oBuffer, long iNum );
 
+	void	FillStdExponential	( double* oBuffer, long iNum );
 
-		// double theSigma = std::sqrt (iVariance);
 
-			
 
-        return iMean + iStdDev * std::sqrt(-2*std::log(v)) * std::cos(3.1415 * (2*u - 1));
+	// Shuffling
 
+	template <typename RANDITER>
 
+	void Shuffle (RANDITER iFirst, RANDITER iLast)
 
-/*		double x, y, r2;
+	//: randomly reorder a range, drawing on this generator
 
+	// Use this rather than std::random_shuffle, which draws on rand().
 
+	{
 
-		do
+		long theSize = long (iLast - iFirst);
 
-		{
+		for (long i = theSize - 1; 0 < i; i--)
 
-			// choose x,y in uniform square (-1,-1) to (+1,+1)
+			std::iter_swap (iFirst + i, iFirst + UniformWhole (i + 1));
 
-			x = -1.0 + 2.0 * Generate ();
+	}
 
-			y = -1.0 + 2.0 * Generate ();
 
 
 
-			// see if it is in the unit circle
 
-			r2 = x * x + y * y;
 
-		}
 
-		while ((r2 > 1.0) or (r2 == 0));
+	// Depreciated & Debug
 
+	void		Test				();
 
 
-		// Box-Muller transform
 
-		return iMean + (iSigma * y * std::sqrt (-2.0 * std::log (r2) / r2));
+	double	Uniform			();
 
-*/
+	double	Uniform			( double iCeiling );
 
-	}
+	double	Uniform			( double iFloor, double iCeiling );	
 
+	long		Uniform			( long iNumChoices );
 
+	long		Uniform			( long iFloor, long iCeiling );
 
 
 
+private:
 
+	// Members
 
-	// Depreciated & Debug
+	typedef unsigned long	word_type;	// only the low 32 bits are used
 
-	void		Test				();
 
 
+	word_type	mKey[2];
 
-	double	Uniform			();
+	word_type	mCounter[4];
 
-	double	Uniform			( double iCeiling );
+	word_type	mBlock[4];
 
-	double	Uniform			( double iFloor, double iCeiling );	
+	int			mBlockPos;
 
-	long		Uniform			( long iNumChoices );
 
-	long		Uniform			( long iFloor, long iCeiling );
 
+	// batches that single normal & exponential draws are served from
 
+	std::vector<double>	mNormalPool;
 
-private:
+	std::vector<double>	mExpPool;
 
-	// Members
+	std::size_t			mNormalPos;
 
-	long		mSeed;
+	std::size_t			mExpPos;
 
 	
 
@@ -212,6 +241,20 @@ private:
 
 	double	Generate		(); 
 
+
+
+	word_type	NextWord		();
+
+	void			ResetPools	();
+
+	double		ZigguratNormal	();
+
+	double		ZigguratExponential	();
+
+	static void	Philox	( const word_type iKey[2], const word_type iCounter[4],
+
+		word_type oBlock[4] );
+
 };
 
 
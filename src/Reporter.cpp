@@ -55,6 +55,56 @@ void Reporter::setFileStream (std::ofstream* iFileStreamP)
 }
 
 
+void Reporter::flush ()
+//: push out anything buffered, e.g. before the process is forked
+{
+	if (mFileStreamP)
+		mFileStreamP->flush();
+}
+
+
+void Reporter::captureTo (std::FILE* iFileOutP, std::FILE* iScreenOutP)
+//: divert all output into these files, to be replayed elsewhere later
+// For replicates run in another process: what would go to the results
+// file goes to the first, and lines for the screen to the second. Output
+// that would not have been made (e.g. no results file is open) is not
+// captured either. Passing NULLs ends capturing.
+{
+	mCaptureFileP = iFileOutP;
+	mCaptureScreenP = iScreenOutP;
+}
+
+
+void Reporter::replayCapture (std::FILE* iFileOutP, std::FILE* iScreenOutP)
+//: send output captured by another reporter on to its real destinations
+{
+	std::rewind (iScreenOutP);
+	string theLine;
+	int theChar;
+	while ((theChar = std::fgetc (iScreenOutP)) != EOF)
+	{
+		if (theChar == '\n')
+		{
+			mProgressCb (kMsg_Analysis, theLine.c_str());
+			theLine.clear();
+		}
+		else
+		{
+			theLine += char (theChar);
+		}
+	}
+	
+	std::rewind (iFileOutP);
+	if (mFileStreamP)
+	{
+		char theBuffer[4096];
+		std::size_t theNumRead;
+		while (0 < (theNumRead = std::fread (theBuffer, 1, sizeof (theBuffer), iFileOutP)))
+			mFileStreamP->write (theBuffer, theNumRead);
+	}
+}
+
+
 void Reporter::pushPrefix (const char* iPrefixStr)
 {
 	assert (iPrefixStr != "");
@@ -237,15 +287,24 @@ void Reporter::rawOutput (std::string& iReportStr, const char* iTitle)
 		theBuffer << iReportStr;
 		string theBufferStr = theBuffer.str();
 		
-		mProgressCb (kMsg_Analysis, theBufferStr.c_str());
+		if (mCaptureScreenP)
+			std::fprintf (mCaptureScreenP, "%s\n", theBufferStr.c_str());
+		else
+			mProgressCb (kMsg_Analysis, theBufferStr.c_str());
 	}
 	
 	if (mFileStreamP)
 	{
-		(*mFileStreamP) << printPrefix();
+		std::stringstream theBuffer;
+		theBuffer << printPrefix();
 		if ((iTitle != NULL) and (iTitle != ""))
-			(*mFileStreamP) << iTitle << "\t";
-		(*mFileStreamP) << iReportStr << std::endl;
+			theBuffer << iTitle << "\t";
+		theBuffer << iReportStr << std::endl;
+		
+		if (mCaptureFileP)
+			std::fputs (theBuffer.str().c_str(), mCaptureFileP);
+		else
+			(*mFileStreamP) << theBuffer.str() << std::flush;
 	}
 }
 
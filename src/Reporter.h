@@ -22,6 +22,7 @@ Credits:
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <cstdio>
 
 
 // *** CONSTANTS & DEFINES
@@ -34,6 +35,7 @@ public:
 	// LIFECYCLE
 	Reporter (progcallback_t& ikProgressCb)
 		: mProgressCb (ikProgressCb), mFileStreamP (NULL)
+		, mCaptureFileP (NULL), mCaptureScreenP (NULL)
 		{}
 	~Reporter ();
 
@@ -42,6 +44,10 @@ public:
 	void	popPrefix ();
 
 	void	setFileStream (std::ofstream* iFileStreamP);
+	void	flush ();
+
+	void	captureTo (std::FILE* iFileOutP, std::FILE* iScreenOutP);
+	void	replayCapture (std::FILE* iFileOutP, std::FILE* iScreenOutP);
 
 	// I/O
 	// note data comes first, result second
@@ -68,6 +74,8 @@ public:
 private:
 	progcallback_t		mProgressCb;
 	std::ofstream*		mFileStreamP;
+	std::FILE*			mCaptureFileP;
+	std::FILE*			mCaptureScreenP;
 
 	std::vector <std::string>		mPrefixStack;
 
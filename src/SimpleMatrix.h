@@ -34,6 +34,7 @@ To Do:
 #include <string>
 #include <algorithm>
 #include <sstream>
+#include <map>
 
 SBL_NAMESPACE_START
 
@@ -128,11 +129,46 @@ public:
 	{
 		assert (0 < iRowIncr);
 		
+		reserveRows (countRows() + iRowIncr);
 		resizeRows (countRows() + iRowIncr, iNewVal);
 	}
 	
 	void appendRow (row_type& iNewRow)
-		{ push_back (iNewRow); }
+	{
+		reserveRows (countRows() + 1);
+		this->push_back (iNewRow);
+	}
+
+	size_type cloneRow (size_type iOrigIndex)
+	//: append a copy of this row, returning the index of the copy
+	// Room is made first, so the original can be copied in one block
+	// straight into the new row.
+	{
+		assertValidIndex (iOrigIndex, 0);
+		reserveRows (countRows() + 1);
+		base_type::push_back (row_type());
+		row_type& theOrigRow = (*this)[iOrigIndex];
+		base_type::back().assign (theOrigRow.begin(), theOrigRow.end());
+		return countRows() - 1;
+	}
+
+	void reserveRows (size_type iNumRows)
+	//: make room for this many rows without copying those already here
+	// Growing the outer vector in the usual way copies every row and all
+	// its contents. Here the capacity is doubled and the old rows are
+	// swapped across, so appending rows is amortised constant time however
+	// wide they are.
+	{
+		if (iNumRows <= base_type::capacity())
+			return;
+		size_type theNumRows = countRows();
+		base_type theNewRows;
+		theNewRows.reserve (std::max (iNumRows, 2 * base_type::capacity()));
+		theNewRows.resize (theNumRows);
+		for (size_type i = 0; i < theNumRows; i++)
+			theNewRows[i].swap ((*this)[i]);
+		base_type::swap (theNewRows);
+	}
 
 	void swapRows (size_type iIndexA, size_type iIndexB)
 	{
@@ -156,6 +192,27 @@ public:
 			erase (base_type::begin() + iRowIndex);
 	}
 
+	void deleteRows (const std::vector<bool>& iDoomedRows)
+	//: delete every row flagged, in a single pass
+	// The surviving rows keep their order and are swapped down rather than
+	// copied, so clearing out many rows is linear rather than quadratic.
+	{
+		assert (iDoomedRows.size() == countRows());
+		size_type theNumKept = 0;
+		for (size_type i = 0; i < countRows(); i++)
+		{
+			if (iDoomedRows[i])
+				continue;
+			if (theNumKept != i)
+				(*this)[theNumKept].swap ((*this)[i]);
+			theNumKept++;
+		}
+		if (theNumKept == 0)
+			resize (0, 0);
+		else
+			base_type::erase (base_type::begin() + theNumKept, base_type::end());
+	}
+
 	void deleteCol (size_type iColIndex)
 	{
 		if (countCols() == 1)
@@ -198,8 +255,34 @@ public:
 	typedef 	typename base_type::row_type			row_type;
 	typedef	typename std::string						label_type;
 	typedef	typename std::vector<label_type>		labellist_type;
+	typedef	unsigned long								stamp_type;
 	
 	// LIFECYCLE
+	LabelledSimpleMatrix ()
+		: mRowIndexValid (false), mRowStamp (getNextRowStamp())
+		, mUndoDepth (0), mLatestMark (0)
+		{}
+	
+	LabelledSimpleMatrix (const LabelledSimpleMatrix& iOther)
+	// A copy starts with no changes logged, whatever the original has.
+		: base_type (iOther)
+		, mRowNames (iOther.mRowNames), mColNames (iOther.mColNames)
+		, mRowIndex (iOther.mRowIndex), mRowIndexValid (iOther.mRowIndexValid)
+		, mRowStamp (iOther.mRowStamp)
+		, mUndoDepth (0), mLatestMark (0)
+		{}
+	
+	LabelledSimpleMatrix& operator= (const LabelledSimpleMatrix& iOther)
+	// A matrix assigned over this one may have its rows in a different
+	// order, so any row indices held outside are no longer good.
+	{
+		saveAll ();
+		base_type::operator= (iOther);
+		mRowNames = iOther.mRowNames;
+		mColNames = iOther.mColNames;
+		invalidateRows ();
+		return *this;
+	}
 	
 	// ACCESSORS
 	label_type getRowName (size_type i)
@@ -240,15 +323,27 @@ public:
 
 	bool hasRowName (const char* iSearchStr)
 	{
-		labellist_type::iterator q = std::find (mRowNames.begin(),
-			mRowNames.end(), label_type (iSearchStr));
-		return (q != mRowNames.end());
+		checkRowIndex ();
+		return (mRowIndex.find (label_type (iSearchStr)) != mRowIndex.end());
 	}
 			
 	size_type findRowNameIndex (const char* iSearchStr)
+	//: return the index of the first row with this name
+	// Uses the index of row names rather than searching them.
 	{
-		return findNameIndex (mRowNames, iSearchStr);
+		checkRowIndex ();
+		typename std::map<label_type, size_type>::iterator q =
+			mRowIndex.find (label_type (iSearchStr));
+		if (q == mRowIndex.end())
+			throwMissingLabel (iSearchStr);
+		return q->second;
 	}
+	
+	stamp_type getRowStamp () const
+	//: return a stamp that changes whenever rows are moved or renamed
+	// Row indices held outside the matrix are good only while the stamp
+	// is unchanged. Adding rows to the end does not change it.
+	{ return mRowStamp; }
 
 	size_type findColNameIndex (const char* iSearchStr)
 	{
@@ -267,12 +362,31 @@ public:
 	}
 	
 	// MUTATORS
+	row_type& referRow (size_type iRowIndex)
+	//: the row at this index, to be written to
+	// Data written other than through here can't be rolled back.
+	{
+		assert (iRowIndex < base_type::countRows());
+		if (isUndoable() and (mRowSaves[iRowIndex] <= mLatestMark))
+			saveRow (iRowIndex);
+		return (*this)[iRowIndex];
+	}
+	
+	X& referData (size_type iRowIndex, size_type iColIndex)
+	//: the datum at this row & column, to be written to
+	{
+		base_type::assertValidIndex (iRowIndex, iColIndex);
+		return referRow (iRowIndex)[iColIndex];
+	}
+	
 	void setRowName (size_type i, const char* iNewName)
 	{
 		assert (0 <= i);
 		assert (i < base_type::countRows());
 		assert (i < mRowNames.size());
+		saveAll ();
 		mRowNames[i] = iNewName;
+		invalidateRows ();
 	}
 
 	void setColName (size_type i, const char* iNewName)
@@ -286,31 +400,50 @@ public:
 	
 	void resize (size_type iNewNumRows, size_type iNewNumCols, const X& iNewVal = X())
 	{
+		saveAll ();
 		base_type::resize (iNewNumRows, iNewNumCols, iNewVal);
 		mRowNames.resize (iNewNumRows, "");
 		mColNames.resize (iNewNumCols, "");
+		invalidateRows ();
 	}
 
 	void appendRow (row_type& iNewRow, const char* iNewName = "")
 	{
 		base_type::appendRow (iNewRow);
 		mRowNames.push_back (label_type (iNewName));
+		indexNewRow ();
+		logAddedRow ();
+	}
+
+	size_type cloneRow (size_type iOrigIndex, const char* iNewName)
+	//: append a copy of this row under the new name, returning its index
+	{
+		size_type theNewIndex = base_type::cloneRow (iOrigIndex);
+		mRowNames.push_back (label_type (iNewName));
+		indexNewRow ();
+		logAddedRow ();
+		return theNewIndex;
 	}
 
 	void sortRows ()
 	//: sort rows by their title
 	{
-		// sort the names
-		labellist_type theSortedNames = mRowNames;
-		std::sort (theSortedNames.begin(), theSortedNames.end());
+		// sort the names, remembering where each came from
+		std::vector< std::pair<label_type, size_type> > theSortedNames;
+		for (size_type i = 0; i < mRowNames.size(); i++)
+			theSortedNames.push_back (std::make_pair (mRowNames[i], i));
+		std::stable_sort (theSortedNames.begin(), theSortedNames.end());
 		
-		// go along the sorted names and swap the rows as need be
-		for (size_type theNewPos = 0; theNewPos < theSortedNames.size(); theNewPos++)
+		// rebuild the rows in that order
+		base_type theSortedRows;
+		saveAll ();
+		for (size_type i = 0; i < theSortedNames.size(); i++)
 		{
-			// find the old position
-			size_type theOldPos = findRowNameIndex (theSortedNames[theNewPos].c_str());
-			swapRows (theNewPos, theOldPos);
+			theSortedRows.appendRow ((*this)[theSortedNames[i].second]);
+			mRowNames[i] = theSortedNames[i].first;
 		}
+		base_type::swap (theSortedRows);
+		invalidateRows ();
 	}
 
 	void addRows (size_type iRowIncr, const X& iNewVal = X())
@@ -319,19 +452,27 @@ public:
 		assert (0 < iRowIncr);	
 		base_type::addRows (iRowIncr, iNewVal);
 		for (size_type i = 0; i < iRowIncr; i++)
+		{
 			mRowNames.push_back (label_type (""));
+			indexNewRow ();
+			logAddedRow ();
+		}
 	}
 
 	void swapRows (size_type iIndexA, size_type iIndexB)
 	{
+		saveAll ();
 		std::swap (mRowNames[iIndexA], mRowNames[iIndexB]);
 		base_type::swapRows (iIndexA, iIndexB);
+		invalidateRows ();
 	}
 
 	void deleteRow (size_type iRowIndex)
 	{
+		saveAll ();
 		mRowNames.erase (mRowNames.begin() + iRowIndex);
 		base_type::deleteRow (iRowIndex);
+		invalidateRows ();
 	}
 
 	void deleteRow (const char* iRowLabel)
@@ -340,18 +481,249 @@ public:
 		deleteRow (theIndex);
 	}
 
+	void deleteRows (const std::vector<bool>& iDoomedRows)
+	{
+		assert (iDoomedRows.size() == mRowNames.size());
+		saveAll ();
+		size_type theNumKept = 0;
+		for (size_type i = 0; i < mRowNames.size(); i++)
+		{
+			if (iDoomedRows[i])
+				continue;
+			if (theNumKept != i)
+				mRowNames[theNumKept].swap (mRowNames[i]);
+			theNumKept++;
+		}
+		mRowNames.resize (theNumKept);
+		base_type::deleteRows (iDoomedRows);
+		invalidateRows ();
+	}
+
 	void deleteCol (size_type iColIndex)
 	{
+		saveAll ();
 		mColNames.erase (mColNames.begin() + iColIndex);
 		base_type::deleteCol (iColIndex);
+		if (isUndoable())
+			mRowSaves.assign (base_type::countRows(), mUndoSteps.size());
+	}
+	
+	// UNDOING
+	// Changes made after a mark are logged, so the matrix can be rolled
+	// back without being copied. Rows added are dropped again, and a row
+	// is saved before it is first written through referRow or referData
+	// after the latest mark. Anything that moves, renames or resizes rows,
+	// which is rare within a simulation, saves the lot.
+	struct UndoMark
+	{
+		size_type   mNumSteps;   // length of the undo log when made
+	};
+	
+	UndoMark markUndo ()
+	//: start logging changes, so the matrix can be rolled back to this point
+	{
+		if (mUndoDepth == 0)
+			mRowSaves.assign (base_type::countRows(), 0);
+		mUndoDepth++;
+		mLatestMark = mUndoSteps.size();
+		UndoMark theMark;
+		theMark.mNumSteps = mUndoSteps.size();
+		return theMark;
+	}
+	
+	void rollbackUndo (const UndoMark& iMark)
+	//: undo every change made to the matrix since this mark
+	{
+		assert (isUndoable());
+		assert (iMark.mNumSteps <= mUndoSteps.size());
+		while (iMark.mNumSteps < mUndoSteps.size())
+		{
+			undoStep (mUndoSteps.back());
+			mUndoSteps.pop_back();
+		}
+		mLatestMark = iMark.mNumSteps;
+	}
+	
+	void releaseUndo (const UndoMark& iMark)
+	//: keep the changes made since this mark & stop logging for it
+	{
+		assert (isUndoable());
+		assert (iMark.mNumSteps <= mUndoSteps.size());
+		mUndoDepth--;
+		if (not isUndoable())
+		{
+			mUndoSteps.clear();
+			mUndoRows.clear();
+			mUndoMatrices.clear();
+			mRowSaves.clear();
+			mLatestMark = 0;
+		}
 	}
 	
+	bool isUndoable () const
+	//: is every change to the matrix being logged, so it can be undone?
+		{ return (0 < mUndoDepth); }
+	
 	// DEPRECIATED & DEBUG
 	
 	// INTERNALS
 private:	
 	labellist_type		mRowNames;
 	labellist_type		mColNames;
+	
+	// the first row with each name, rebuilt lazily when rows move
+	std::map<label_type, size_type>	mRowIndex;
+	bool										mRowIndexValid;
+	stamp_type								mRowStamp;
+	
+	enum UndoKind
+	{
+		kUndo_AddedRow,
+		kUndo_Row,
+		kUndo_All
+	};
+	
+	struct UndoStep
+	{
+		UndoKind    mKind;
+		size_type   mIndex;   // of the row added or saved
+	};
+	
+	// the whole of the matrix, as saved before a change to its layout
+	struct SavedMatrix
+	{
+		base_type        mRows;
+		labellist_type   mRowNames;
+		labellist_type   mColNames;
+	};
+	
+	// rows & matrices are saved in the order their steps are logged, so
+	// each is the last of its kind when its step is undone
+	std::vector<UndoStep>      mUndoSteps;
+	std::vector<row_type>      mUndoRows;
+	std::vector<SavedMatrix>   mUndoMatrices;
+	size_type                  mUndoDepth;    // number of marks open
+	size_type                  mLatestMark;   // log length at the latest
+	// for each row, the log length just after it was last saved or added
+	std::vector<size_type>     mRowSaves;
+	
+	void logUndo (UndoKind iKind, size_type iIndex)
+	{
+		UndoStep theStep;
+		theStep.mKind = iKind;
+		theStep.mIndex = iIndex;
+		mUndoSteps.push_back (theStep);
+	}
+	
+	void logAddedRow ()
+	//: note the last row as added, so it is dropped on rolling back
+	{
+		if (not isUndoable())
+			return;
+		logUndo (kUndo_AddedRow, base_type::countRows() - 1);
+		mRowSaves.push_back (mUndoSteps.size());
+	}
+	
+	void saveRow (size_type iRowIndex)
+	{
+		logUndo (kUndo_Row, iRowIndex);
+		mUndoRows.push_back ((*this)[iRowIndex]);
+		mRowSaves[iRowIndex] = mUndoSteps.size();
+	}
+	
+	void saveAll ()
+	//: save the whole matrix before its layout is changed
+	// Which covers every row until the next mark (see invalidateRows).
+	{
+		if (not isUndoable())
+			return;
+		logUndo (kUndo_All, 0);
+		mUndoMatrices.push_back (SavedMatrix());
+		SavedMatrix& theSaved = mUndoMatrices.back();
+		theSaved.mRows = *this;
+		theSaved.mRowNames = mRowNames;
+		theSaved.mColNames = mColNames;
+	}
+	
+	void undoStep (const UndoStep& iStep)
+	{
+		switch (iStep.mKind)
+		{
+			case kUndo_AddedRow:
+			{
+				assert (iStep.mIndex == base_type::countRows() - 1);
+				typename std::map<label_type, size_type>::iterator q =
+					mRowIndex.find (mRowNames.back());
+				if (mRowIndexValid and (q != mRowIndex.end()) and (q->second == iStep.mIndex))
+					mRowIndex.erase (q);
+				base_type::pop_back();
+				mRowNames.pop_back();
+				mRowSaves.pop_back();
+				break;
+			}
+				
+			case kUndo_Row:
+				(*this)[iStep.mIndex].swap (mUndoRows.back());
+				mUndoRows.pop_back();
+				mRowSaves[iStep.mIndex] = 0;
+				break;
+				
+			case kUndo_All:
+			{
+				SavedMatrix& theSaved = mUndoMatrices.back();
+				base_type::swap (theSaved.mRows);
+				mRowNames.swap (theSaved.mRowNames);
+				mColNames.swap (theSaved.mColNames);
+				mUndoMatrices.pop_back();
+				mRowIndexValid = false;
+				mRowStamp = getNextRowStamp();
+				mRowSaves.assign (base_type::countRows(), 0);
+				break;
+			}
+				
+			default:
+				assert (false);
+		}
+	}
+	
+	static stamp_type getNextRowStamp ()
+	{
+		static stamp_type theLastStamp = 0;
+		return ++theLastStamp;
+	}
+	
+	void invalidateRows ()
+	//: after the rows have moved, which saveAll must have been called for
+	{
+		mRowIndexValid = false;
+		mRowStamp = getNextRowStamp();
+		if (isUndoable())
+			mRowSaves.assign (base_type::countRows(), mUndoSteps.size());
+	}
+	
+	void checkRowIndex ()
+	{
+		if (mRowIndexValid)
+			return;
+		mRowIndex.clear();
+		for (size_type i = mRowNames.size(); 0 < i; i--)
+			mRowIndex[mRowNames[i - 1]] = i - 1;
+		mRowIndexValid = true;
+	}
+	
+	void indexNewRow ()
+	//: add the last row to the index, unless its name is already taken
+	{
+		if (mRowIndexValid)
+			mRowIndex.insert (std::make_pair (mRowNames.back(), mRowNames.size() - 1));
+	}
+	
+	void throwMissingLabel (const char* iSearchStr)
+	{
+		std::stringstream theBuffer;
+		theBuffer << "label \'" << iSearchStr << "\' does not exist in container";
+		throw sbl::IndexError ((theBuffer.str()).c_str());
+	}
 		
 	size_type findNameIndex (labellist_type& iLabels, const char* iSearchStr)
 	{
@@ -360,11 +732,7 @@ private:
 		if (q != iLabels.end())
 			return (q - iLabels.begin());
 		else
-		{
-			std::stringstream theBuffer;
-			theBuffer << "label \'" << iSearchStr << "\' does not exist in container";
-			throw sbl::IndexError ((theBuffer.str()).c_str());
-		}
+			throwMissingLabel (iSearchStr);
 		return -1; // just to keep the compiler happy
 	}	
 };
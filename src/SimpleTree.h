@@ -21,6 +21,7 @@
 #include <iterator>
 #include <vector>
 #include <algorithm>
+#include <cstddef>
 
 SBL_NAMESPACE_START
 
@@ -93,30 +94,106 @@ protected:
 private:
 // PRIVATE TYPE INTERFACE
 
+	/**
+	The children of a node.
+	
+	Nearly every node in a phylogeny has two children or none, so up to two
+	ids are kept inline in the node and only polytomies need an allocation.
+	Presents the fragment of the vector interface that Node used.
+	*/
+	class ChildList
+	{
+	public:
+		typedef id_type*      iterator;
+		typedef std::size_t   size_type;
+		
+		ChildList ()
+			: mSize (0)
+			{}
+			
+		size_type size () const
+			{ return mSize; }
+		iterator begin ()
+			{ return isInline() ? mInline : &mOverflow[0]; }
+		iterator end ()
+			{ return begin() + mSize; }
+			
+		void push_back (id_type iId)
+		{
+			if (mSize < kNumInline)
+			{
+				mInline[mSize] = iId;
+			}
+			else
+			{
+				if (mSize == kNumInline)
+					mOverflow.assign (mInline, mInline + kNumInline);
+				mOverflow.push_back (iId);
+			}
+			mSize++;
+		}
+		
+		void insert (size_type iIndex, id_type iId)
+		{
+			push_back (iId);
+			std::rotate (begin() + iIndex, end() - 1, end());
+		}
+		
+		void erase (iterator iPosn)
+		{
+			if (isInline())
+			{
+				std::copy (iPosn + 1, end(), iPosn);
+				mSize--;
+			}
+			else
+			{
+				mOverflow.erase (mOverflow.begin() + (iPosn - begin()));
+				mSize--;
+				if (mSize == kNumInline)
+				{
+					std::copy (mOverflow.begin(), mOverflow.end(), mInline);
+					std::vector<id_type>().swap (mOverflow);
+				}
+			}
+		}
+		
+	private:
+		enum { kNumInline = 2 };
+		
+		id_type                mInline[kNumInline];
+		size_type              mSize;
+		std::vector<id_type>   mOverflow;
+		
+		bool isInline () const
+			{ return (mSize <= size_type (kNumInline)); }
+	};
+	
 	/// the internal data structure used to represent topology
-	class Node: public std::vector<id_type>
+	class Node: public ChildList
 	{
 	public:
    /// @name TYPE INTERFACE
    //@{
-		typedef std::vector<id_type>   base_type;
-		typedef base_type::iterator    iterator;
-		typedef base_type::size_type   size_type;   
+		typedef ChildList              base_type;
+		typedef typename base_type::iterator    iterator;
+		typedef typename base_type::size_type   size_type;   
 		
 		id_type                        mParent;
 		nodedata_type                  mData;
 		weight_type                    mWeight;
+		unsigned long                  mSerial;   ///< order of creation
    //@}
          
    /// @name LIFECYCLE
    //@{
 		Node ()
-			: mParent (kTree_IdNone)
+			: mParent (kTree_IdNone), mWeight (kTree_DefaultWt), mSerial (0)
 			///<default ctor.
 			{};
 		
 		Node (id_type iParId)
-			: mParent (iParId)
+			: mParent (iParId), mWeight (kTree_DefaultWt), mSerial (0)
 			///<ctor that sets the parent as per the argument.
 			{};
    //@}
@@ -124,7 +201,7 @@ private:
    /// @name ACCESSORS
    //@{
 		inline size_type countChildren () const
-			{ return size(); }
+			{ return base_type::size(); }
 		
 		bool isLeaf ()
 			///<is this node a terminal (i.e has no children)?
@@ -150,26 +227,38 @@ private:
 
 		inline void addChild (id_type iChildId)
 			///<Add a child of the given ID to this node
-			{ push_back (iChildId); }
+			{ base_type::push_back (iChildId); }
 
 		inline void removeChild (id_type iChildId)
 			///<Remove a child of the given ID from this node
 			{ 
-				for (iterator q = begin (); q != end (); q++)
+				for (iterator q = base_type::begin (); q != base_type::end (); q++)
 				{
 					if (*q == iChildId)
 					{
-						erase (q);
+						base_type::erase (q);
 						return;
 					}
 				}
 			}
+
+		inline void insertChild (size_type iIndex, id_type iChildId)
+			///<Put a child of the given ID back at this position
+			{ base_type::insert (iIndex, iChildId); }
    //@}
 		
+		size_type findChild (id_type iChildId)
+			///<Return the position of the child with the given ID
+			{
+				iterator q = std::find (base_type::begin(), base_type::end(), iChildId);
+				assert (q != base_type::end());
+				return size_type (q - base_type::begin());
+			}
+		
 		id_type getChildId (size_type iIndex)
 		{
 			assert (0 <= iIndex);
-			assert (iIndex < size());
+			assert (iIndex < base_type::size());
 			iterator q = base_type::begin();
 			std::advance (q, iIndex);
 			return *q;
@@ -185,17 +274,84 @@ private:
    // end of Node declaration
    
 	typedef Node                          value_type;
-	typedef std::map<id_type,value_type>  nodecontainer_type;
 	
 	
 // MORE PUBLIC TYPE INTERFACE
  public:
+	/// an id & node pair, as a map would store it
+	typedef std::pair<id_type, value_type>   entry_type;
 	/// type of node index 
-	typedef typename nodecontainer_type::size_type        size_type;
+	typedef std::size_t                      size_type;
+	
+	/**
+	An iterator over the nodes of a tree, in order of id.
+	
+	This is what was once the map iterator and behaves like it, so that
+	iter->first is the id and iter->second the node. It stores the tree and
+	the id rather than a pointer to the node, so it is not invalidated when
+	the node pool grows. But the pointers & references it hands out (via *
+	and ->) are into the pool, and so are only good until the next node is
+	added to the tree: don't hold on to them across an insert.
+	*/
+	template <typename TREE, typename ENTRY>
+	class NodeIterator
+	{
+	public:
+		typedef std::forward_iterator_tag   iterator_category;
+		typedef ENTRY                       value_type;
+		typedef std::ptrdiff_t              difference_type;
+		typedef ENTRY*                      pointer;
+		typedef ENTRY&                      reference;
+		
+		NodeIterator ()
+			: mTreeP (NULL), mId (kTree_IdNone)
+			{}
+		NodeIterator (TREE* iTreeP, id_type iId)
+			: mTreeP (iTreeP), mId (iId)
+			{}
+		template <typename T2, typename E2>
+		NodeIterator (const NodeIterator<T2,E2>& iOther)
+			: mTreeP (iOther.getTreeP()), mId (iOther.getNodeId())
+			{}
+			
+		reference operator* () const
+			{ return mTreeP->getEntry (mId); }
+		pointer operator-> () const
+			{ return &(mTreeP->getEntry (mId)); }
+			
+		NodeIterator& operator++ ()
+		{
+			mId = mTreeP->findNextId (mId);
+			return *this;
+		}
+		NodeIterator operator++ (int)
+		{
+			NodeIterator theOldIter (*this);
+			mId = mTreeP->findNextId (mId);
+			return theOldIter;
+		}
+		
+		template <typename T2, typename E2>
+		bool operator== (const NodeIterator<T2,E2>& iOther) const
+			{ return ((mId == iOther.getNodeId()) and (mTreeP == iOther.getTreeP())); }
+		template <typename T2, typename E2>
+		bool operator!= (const NodeIterator<T2,E2>& iOther) const
+			{ return not (*this == iOther); }
+			
+		TREE* getTreeP () const
+			{ return mTreeP; }
+		id_type getNodeId () const
+			{ return mId; }
+			
+	private:
+		TREE*     mTreeP;
+		id_type   mId;
+	};
+	
 	/// iterator over nodes
-	typedef typename nodecontainer_type::iterator         iterator;
+	typedef NodeIterator<SimpleTree, entry_type>               iterator;
 	/// constant iterator over nodes
-	typedef typename nodecontainer_type::const_iterator   const_iterator;
+	typedef NodeIterator<const SimpleTree, const entry_type>   const_iterator;
 	
 	
 /// LIFECYCLE
@@ -241,10 +397,18 @@ private:
 		assert (q != end());
 		assert (q->second.mParent == iParId);
 		
+		logWeight (q);
+		mEditStamp++;
 		q->second.mWeight = theDist;
 	}
 
 	nodedata_type* getNodeDataP (const iterator& iNodeIter) const;
+	
+	unsigned long getEditStamp () const
+		///<a stamp that changes whenever the shape or weights of the tree do
+		// Anything worked out from the tree & kept outside it is good only
+		// while the stamp is unchanged. It is never reset, not even by clear().
+		{ return mEditStamp; }
 
 
 // TRAVERSAL & SEARCH
@@ -266,6 +430,25 @@ private:
 	void       clear ();
 	void       replace (iterator& iOldIter, iterator& iNewIter);
 
+
+/// UNDOING
+///@{
+	/// a point in the history of the tree that it can be rolled back to
+	struct UndoMark
+	{
+		size_type   mNumSteps;    ///< length of the undo log when made
+		id_type     mFloorId;     ///< newest node when made
+		id_type     mOldFloorId;  ///< newest node of the enclosing mark
+	};
+	
+	UndoMark   markUndo ();
+	void       rollbackUndo (const UndoMark& iMark);
+	void       releaseUndo (const UndoMark& iMark);
+	bool       isUndoable () const
+		///<is every change to the tree being logged, so it can be undone?
+		{ return (0 < mUndoDepth); }
+///@}
+
 	
 /*
 	template <class INSERTITER>
@@ -388,6 +571,30 @@ iterator getIter (id_type iId)
 	return findNode (iId);
 }
 
+entry_type& getEntry (id_type iId)
+///<the pool entry for a node that is known to exist
+{
+	assert (hasNode (iId));
+	return mPool[mSlots[iId]];
+}
+
+const entry_type& getEntry (id_type iId) const
+{
+	assert (hasNode (iId));
+	return mPool[mSlots[iId]];
+}
+
+id_type findNextId (id_type iId) const
+///<the next id in use after this one, or kTree_IdNone if there isn't one
+{
+	for (id_type i = iId + 1; i <= mMaxId; i++)
+	{
+		if (mSlots[i] != kTree_IdNone)
+			return i;
+	}
+	return kTree_IdNone;
+}
+
 
 id_type getId (iterator& iIter)
 {
@@ -395,38 +602,27 @@ id_type getId (iterator& iIter)
 }
 
 iterator getOldestNode ()
+///<the first made of the nodes in the tree
+// As the ids of deleted nodes are reused, they are not the order of
+// creation. Instead every node is numbered as it is made, and this (& the
+// next) go by that number.
 {
-	if (countNodes() == 0)
+	sortByAge ();
+	if (mAgeOrder.empty())
 		return end();
-	else
-	{
-		for (id_type i = 0; i < mMaxId; i++)
-		{
-			iterator p = getIter (i);
-			if (p != end())
-			{
-				assert (p == getRoot());
-				return p;
-			}
-		}   
-	}
-	
-	// Postconditions & return:
-	assert (false);   // should never get here
-	return end();     // just to shut compiler up
+	return getIter (mAgeOrder[0]);
 }
 
 
 iterator getNextOldestNode (iterator iCurrIter)
+///<the node made after this one
+// The order is worked out once for each state of the tree, so going over
+// the whole tree like this costs a sort, as long as it isn't changed.
 {
-	for (id_type i = iCurrIter->first + 1; i <= mMaxId; i++)
-	{
-		iterator p = getIter (i);
-		if (p != end())
-		{
-			return p;
-		}
-	}
+	sortByAge ();
+	size_type theRank = mAgeRanks[iCurrIter->first] + 1;
+	if (theRank < mAgeOrder.size())
+		return getIter (mAgeOrder[theRank]);
 	return end();
 }
 
@@ -442,14 +638,98 @@ iterator getNextOldestNode (iterator iCurrIter)
 	void       deleteChildrenEdges (iterator iParent);
 	iterator   findNode (id_type iTargetId)
 	{ 
-		return mNodes.find (iTargetId);
+		if (hasNode (iTargetId))
+			return iterator (this, iTargetId);
+		else
+			return end();
 	}
+	bool       hasNode (id_type iTargetId) const
+	{
+		return ((0 < iTargetId) and (iTargetId <= mMaxId) and
+			(mSlots[iTargetId] != kTree_IdNone));
+	}
+	
+	bool       needsUndo (id_type iNodeId) const
+	///<must a change to the contents of this node be logged?
+	// Nodes made since the last mark are simply thrown away on rollback,
+	// so only older ones need their old contents kept.
+	{
+		return ((0 < mUndoDepth) and (iNodeId <= mUndoFloorId));
+	}
+	size_type  countUndoSteps () const
+		{ return mUndoSteps.size(); }
+	void       undoLastStep ();
+	void       logWeight (iterator iNodeIter);
 
 private:   
-	nodecontainer_type   mNodes;  // where nodes are stored
+	// Nodes are held in a contiguous pool, and found via a table from id to
+	// position in the pool. The ids & pool entries of deleted nodes are
+	// reused, so the table & pool only grow as large as the tree has been
+	// at its biggest, and going over the ids is O(that) at worst.
+	std::vector<entry_type>  mPool;       // where nodes are stored
+	std::vector<id_type>     mSlots;      // pool index of each id, or none
+	std::vector<id_type>     mFreeSlots;  // pool entries available for reuse
+	std::vector<id_type>     mFreeIds;    // ids available for reuse
+	size_type            mNumNodes;
 	id_type              mRootId;   // id of the root node
 	id_type              mMaxId;   
 	id_type              getNextId ()    { return (++mMaxId); }
+	unsigned long        mEditStamp;
+	unsigned long        mNumMade;   // nodes ever made, to number them
+	
+	// the nodes in order of creation, & the place of each id in it
+	std::vector<id_type>     mAgeOrder;
+	std::vector<size_type>   mAgeRanks;
+	unsigned long            mAgeOrderStamp;
+	bool                     mAgeOrderValid;
+	
+	void         sortByAge ();
+	
+	// While there is a mark, every change to the structure is logged with
+	// what is needed to reverse it, so rolling back costs only as much as
+	// the changes did rather than a copy of the whole tree.
+	enum UndoKind
+	{
+		kUndo_NewNode,
+		kUndo_DeleteNode,
+		kUndo_NewEdge,
+		kUndo_DeleteEdge,
+		kUndo_SetRoot,
+		kUndo_Weight,
+		kUndo_Clear
+	};
+	
+	struct UndoStep
+	{
+		UndoKind      mKind;
+		id_type       mId;       // the node changed
+		id_type       mOtherId;  // its parent, the old root or if slot recycled
+		id_type       mOldId;    // its old parent or if id recycled
+		size_type     mIndex;    // pool slot or child position
+		weight_type   mWeight;   // its old weight
+	};
+	
+	/// the contents of the tree as they were before a clear()
+	struct ClearedTree
+	{
+		std::vector<entry_type>  mPool;
+		std::vector<id_type>     mSlots;
+		std::vector<id_type>     mFreeSlots;
+		std::vector<id_type>     mFreeIds;
+		size_type                mNumNodes;
+		id_type                  mRootId;
+		id_type                  mMaxId;
+	};
+	
+	std::vector<UndoStep>      mUndoSteps;
+	std::vector<entry_type>    mUndoEntries;   // nodes as they were deleted
+	std::vector<ClearedTree>   mUndoClears;
+	size_type                  mUndoDepth;     // number of marks open
+	id_type                    mUndoFloorId;
+	
+	void         logUndo (UndoKind iKind, id_type iId, id_type iOtherId = kTree_IdNone,
+	                id_type iOldId = kTree_IdNone, size_type iIndex = 0,
+	                weight_type iWeight = kTree_DefaultWt);
 
 	
 	void         init ();
@@ -465,6 +745,8 @@ private:
 /// Default ctor.
 template <typename X>
 SimpleTree<X>::SimpleTree ()
+	: mEditStamp (0), mNumMade (0), mAgeOrderStamp (0), mAgeOrderValid (false)
+	, mUndoDepth (0), mUndoFloorId (0)
 {
 	init();
 }
@@ -479,7 +761,7 @@ template <typename X>
 typename SimpleTree<X>::size_type
 SimpleTree<X>::isEmpty () const
 {
-	return (mNodes.size () == 0);
+	return (mNumNodes == 0);
 }
 
 
@@ -488,7 +770,7 @@ template <typename X>
 typename SimpleTree<X>::size_type
 SimpleTree<X>::countNodes () const
 {
-	return mNodes.size ();
+	return mNumNodes;
 }
 
 
@@ -893,6 +1175,8 @@ SimpleTree<X>::setEdgeWeight (iterator iNodeIter, weight_type iNewWt)
 	assert (0.0 <= iNewWt);
 	
 	// Main:
+	logWeight (iNodeIter);
+	mEditStamp++;
 	iNodeIter->second.setWeight (iNewWt);
 }
 
@@ -915,7 +1199,7 @@ template <typename X>
 typename SimpleTree<X>::iterator
 SimpleTree<X>::begin ()
 {
-	return mNodes.begin ();
+	return iterator (this, findNextId (0));
 }
 
 
@@ -923,7 +1207,7 @@ template <typename X>
 typename SimpleTree<X>::iterator
 SimpleTree<X>::end ()
 {
-	return mNodes.end ();
+	return iterator (this, kTree_IdNone);
 }
 
 
@@ -931,7 +1215,7 @@ template <typename X>
 typename SimpleTree<X>::const_iterator
 SimpleTree<X>::begin () const
 {
-	return mNodes.begin ();
+	return const_iterator (this, findNextId (0));
 }
 
 
@@ -939,7 +1223,7 @@ template <typename X>
 typename SimpleTree<X>::const_iterator
 SimpleTree<X>::end () const
 {
-	return mNodes.end ();
+	return const_iterator (this, kTree_IdNone);
 }
 
 
@@ -1073,7 +1357,26 @@ template <typename X>
 void
 SimpleTree<X>::clear ()
 {
-	mNodes.clear ();
+	if (isUndoable())
+	{
+		// keep the old contents by swapping them out, which costs nothing
+		logUndo (kUndo_Clear, kTree_IdNone, kTree_IdNone, kTree_IdNone,
+			mUndoClears.size());
+		mUndoClears.push_back (ClearedTree());
+		ClearedTree& theOldTree = mUndoClears.back();
+		theOldTree.mPool.swap (mPool);
+		theOldTree.mSlots.swap (mSlots);
+		theOldTree.mFreeSlots.swap (mFreeSlots);
+		theOldTree.mFreeIds.swap (mFreeIds);
+		theOldTree.mNumNodes = mNumNodes;
+		theOldTree.mRootId = mRootId;
+		theOldTree.mMaxId = mMaxId;
+	}
+	mPool.clear ();
+	mSlots.clear ();
+	mFreeSlots.clear ();
+	mFreeIds.clear ();
+	mEditStamp++;
 	init ();
 }
 
@@ -1125,6 +1428,187 @@ SimpleTree<X>::replace (iterator& iOldIter, iterator& iNewIter)
 }
 
 
+// *** UNDOING
+
+/**
+Start logging changes, so the tree can later be rolled back to this point.
+
+Marks nest, so long as each is released in the reverse order to that
+in which they were made. Rolling back to a mark leaves it in place, so a
+tree can be rolled back to the same point again and again.
+*/
+template <typename X>
+typename SimpleTree<X>::UndoMark
+SimpleTree<X>::markUndo ()
+{
+	UndoMark theMark;
+	theMark.mNumSteps = mUndoSteps.size();
+	theMark.mFloorId = mMaxId;
+	theMark.mOldFloorId = mUndoFloorId;
+	mUndoDepth++;
+	mUndoFloorId = mMaxId;
+	return theMark;
+}
+
+
+/// Undo every change made to the tree since this mark
+template <typename X>
+void
+SimpleTree<X>::rollbackUndo (const UndoMark& iMark)
+{
+	// Preconditions:
+	assert (isUndoable());
+	assert (iMark.mNumSteps <= mUndoSteps.size());
+	
+	// Main:
+	while (iMark.mNumSteps < mUndoSteps.size())
+		undoLastStep ();
+	
+	// Postconditions:
+	assert (mMaxId == iMark.mFloorId);
+}
+
+
+/// Keep the changes made since this mark & stop logging for it
+template <typename X>
+void
+SimpleTree<X>::releaseUndo (const UndoMark& iMark)
+{
+	// Preconditions:
+	assert (isUndoable());
+	
+	// Main:
+	mUndoDepth--;
+	mUndoFloorId = iMark.mOldFloorId;
+	if (mUndoDepth == 0)
+	{
+		mUndoSteps.clear();
+		mUndoEntries.clear();
+		mUndoClears.clear();
+	}
+}
+
+
+/// Reverse the most recent change in the log
+template <typename X>
+void
+SimpleTree<X>::undoLastStep ()
+{
+	// Preconditions:
+	assert (not mUndoSteps.empty());
+	
+	// Main:
+	UndoStep theStep = mUndoSteps.back();
+	mUndoSteps.pop_back();
+	mEditStamp++;
+	switch (theStep.mKind)
+	{
+		case kUndo_NewNode:
+			// the node goes, and its id & entry back where they came from
+			mPool[theStep.mIndex] = entry_type();
+			if (theStep.mOtherId)
+				mFreeSlots.push_back (id_type (theStep.mIndex));
+			else
+			{
+				assert (theStep.mIndex == mPool.size() - 1);
+				mPool.pop_back();
+			}
+			if (theStep.mOldId)
+			{
+				mSlots[theStep.mId] = kTree_IdNone;
+				mFreeIds.push_back (theStep.mId);
+			}
+			else
+			{
+				assert (theStep.mId == mMaxId);
+				mSlots.pop_back();
+				mMaxId--;
+			}
+			mNumNodes--;
+			break;
+			
+		case kUndo_DeleteNode:
+			// edges were logged separately, before the node went
+			assert (mFreeSlots.back() == id_type (theStep.mIndex));
+			mFreeSlots.pop_back();
+			assert (mFreeIds.back() == theStep.mId);
+			mFreeIds.pop_back();
+			mPool[theStep.mIndex] = mUndoEntries.back();
+			mUndoEntries.pop_back();
+			mSlots[theStep.mId] = id_type (theStep.mIndex);
+			mNumNodes++;
+			break;
+			
+		case kUndo_NewEdge:
+			getEntry (theStep.mOtherId).second.removeChild (theStep.mId);
+			getEntry (theStep.mId).second.mParent = theStep.mOldId;
+			break;
+			
+		case kUndo_DeleteEdge:
+			getEntry (theStep.mOtherId).second.insertChild (theStep.mIndex, theStep.mId);
+			getEntry (theStep.mId).second.mParent = theStep.mOldId;
+			break;
+			
+		case kUndo_SetRoot:
+			mRootId = theStep.mOtherId;
+			getEntry (theStep.mId).second.mParent = theStep.mOldId;
+			break;
+			
+		case kUndo_Weight:
+			getEntry (theStep.mId).second.mWeight = theStep.mWeight;
+			break;
+			
+		case kUndo_Clear:
+		{
+			assert (theStep.mIndex == mUndoClears.size() - 1);
+			ClearedTree& theOldTree = mUndoClears.back();
+			mPool.swap (theOldTree.mPool);
+			mSlots.swap (theOldTree.mSlots);
+			mFreeSlots.swap (theOldTree.mFreeSlots);
+			mFreeIds.swap (theOldTree.mFreeIds);
+			mNumNodes = theOldTree.mNumNodes;
+			mRootId = theOldTree.mRootId;
+			mMaxId = theOldTree.mMaxId;
+			mUndoClears.pop_back();
+			break;
+		}
+			
+		default:
+			// should never get here
+			assert (false);
+	}
+}
+
+
+/// Keep the weight of this node, if it will have to be restored
+template <typename X>
+void
+SimpleTree<X>::logWeight (iterator iNodeIter)
+{
+	if (needsUndo (iNodeIter->first))
+	{
+		logUndo (kUndo_Weight, iNodeIter->first, kTree_IdNone, kTree_IdNone, 0,
+			iNodeIter->second.mWeight);
+	}
+}
+
+
+template <typename X>
+void
+SimpleTree<X>::logUndo (UndoKind iKind, id_type iId, id_type iOtherId,
+	id_type iOldId, size_type iIndex, weight_type iWeight)
+{
+	UndoStep theStep;
+	theStep.mKind = iKind;
+	theStep.mId = iId;
+	theStep.mOtherId = iOtherId;
+	theStep.mOldId = iOldId;
+	theStep.mIndex = iIndex;
+	theStep.mWeight = iWeight;
+	mUndoSteps.push_back (theStep);
+}
+
+
 // *** INTERNALS
 // These are the raw building-block methods for tree construction &
 // manipulation. They are will maintain tree consistency (correctness)
@@ -1132,6 +1616,32 @@ SimpleTree<X>::replace (iterator& iOldIter, iterator& iNewIter)
 // global sense (e.g. without a root or disconnected). Hence conditions
 // are more sparsely used here.
 
+/// Put the ids of the nodes in the order they were made, if not done already
+template <typename X>
+void
+SimpleTree<X>::sortByAge ()
+{
+	if (mAgeOrderValid and (mAgeOrderStamp == mEditStamp))
+		return;
+	
+	std::vector< std::pair<unsigned long, id_type> > theSerials;
+	theSerials.reserve (mNumNodes);
+	for (iterator q = begin(); q != end(); q++)
+		theSerials.push_back (std::make_pair (q->second.mSerial, q->first));
+	std::sort (theSerials.begin(), theSerials.end());
+	
+	mAgeOrder.resize (theSerials.size());
+	mAgeRanks.assign (mMaxId + 1, 0);
+	for (size_type i = 0; i < theSerials.size(); i++)
+	{
+		mAgeOrder[i] = theSerials[i].second;
+		mAgeRanks[theSerials[i].second] = i;
+	}
+	mAgeOrderStamp = mEditStamp;
+	mAgeOrderValid = true;
+}
+
+
 /// General initialisation function for use in ctor.
 template <typename X>
 void
@@ -1139,6 +1649,9 @@ SimpleTree<X>::init ()
 {
 	mMaxId = 0;
 	mRootId = kTree_IdNone;
+	mNumNodes = 0;
+	// slot 0 stands for the unused id 0
+	mSlots.assign (1, kTree_IdNone);
 	
 	// Postconditions:
 	// validate ();
@@ -1154,6 +1667,9 @@ SimpleTree<X>::setRoot (iterator iNodeIter)
 	// validate (iNodeIter);
 	
 	// Main:
+	if (isUndoable())
+		logUndo (kUndo_SetRoot, iNodeIter->first, mRootId, iNodeIter->second.mParent);
+	mEditStamp++;
 	mRootId = iNodeIter->first;
 	iNodeIter->second.mParent = kTree_IdNone;
 }
@@ -1169,6 +1685,9 @@ SimpleTree<X>::newEdge (iterator iParent, iterator iChild)
 	// validate (iChild);
 	
 	// Main:
+	if (isUndoable())
+		logUndo (kUndo_NewEdge, iChild->first, iParent->first, iChild->second.mParent);
+	mEditStamp++;
 	iParent->second.addChild (iChild->first);
 	iChild->second.mParent = iParent->first;
 }
@@ -1184,6 +1703,10 @@ SimpleTree<X>::deleteEdge (iterator iParent, iterator iChild)
 	// validate (iChild);
 	
 	// Main:
+	if (isUndoable())
+		logUndo (kUndo_DeleteEdge, iChild->first, iParent->first,
+			iChild->second.mParent, iParent->second.findChild (iChild->first));
+	mEditStamp++;
 	iParent->second.removeChild (iChild->first);
 	iChild->second.mParent = kTree_IdNone;
 }
@@ -1227,15 +1750,48 @@ typename SimpleTree<X>::iterator
 SimpleTree<X>::newNode (const nodedata_type& iNewData, weight_type iNewWeight)
 {
 	// Main:
-	// allocate ID for new node
-	id_type theNewId = getNextId ();
+	// allocate ID for new node, reusing that of a deleted node if possible
+	id_type theNewId;
+	bool theIsIdRecycled = not mFreeIds.empty();
+	if (theIsIdRecycled)
+	{
+		theNewId = mFreeIds.back();
+		mFreeIds.pop_back();
+	}
+	else
+	{
+		theNewId = getNextId ();
+	}
 	assert (isIdPresent (theNewId) == false);
 
-	// construct new node
-	Node   theNewNode;
-	theNewNode.mData = iNewData;
-	theNewNode.mWeight = iNewWeight;
-	mNodes[theNewId] = theNewNode;
+	// construct new node, in a recycled pool entry if there is one
+	id_type theSlot;
+	bool theIsRecycled = not mFreeSlots.empty();
+	if (not theIsRecycled)
+	{
+		theSlot = id_type (mPool.size());
+		mPool.push_back (entry_type());
+	}
+	else
+	{
+		theSlot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	if (isUndoable())
+		logUndo (kUndo_NewNode, theNewId, theIsRecycled ? 1 : 0,
+			theIsIdRecycled ? 1 : 0, size_type (theSlot));
+	mEditStamp++;
+	entry_type& theEntry = mPool[theSlot];
+	theEntry.first = theNewId;
+	theEntry.second.mData = iNewData;
+	theEntry.second.mWeight = iNewWeight;
+	theEntry.second.mSerial = ++mNumMade;
+	if (theIsIdRecycled)
+		mSlots[theNewId] = theSlot;
+	else
+		mSlots.push_back (theSlot);
+	assert (mSlots.size() == size_type (mMaxId + 1));
+	mNumNodes++;
 	iterator theNodeIter = findNode (theNewId);
 	
 	// Postconditions & return:
@@ -1264,8 +1820,21 @@ SimpleTree<X>::deleteNode (iterator& iTargetIter)
 	theParentIter = getParent (iTargetIter);
 	if (theParentIter != end())
 		deleteEdge (theParentIter, iTargetIter);
-	// physically delete this node
-	mNodes.erase (iTargetIter);
+	// physically delete this node, resetting the entry to free its storage
+	id_type theId = iTargetIter->first;
+	id_type theSlot = mSlots[theId];
+	if (isUndoable())
+	{
+		logUndo (kUndo_DeleteNode, theId, kTree_IdNone, kTree_IdNone,
+			size_type (theSlot));
+		mUndoEntries.push_back (mPool[theSlot]);
+	}
+	mEditStamp++;
+	mPool[theSlot] = entry_type();
+	mFreeSlots.push_back (theSlot);
+	mFreeIds.push_back (theId);
+	mSlots[theId] = kTree_IdNone;
+	mNumNodes--;
 	
 	// Postconditions & return:
 	iTargetIter = end();
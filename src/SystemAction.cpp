@@ -456,6 +456,8 @@ const char* DeleteDeadTaxaSysAction::describeSysAction ()
 
 void DeleteDeadTraitsSysAction::executeSystem ()
 //: get rid of the chracter values for dead taxa
+// The dead rows are marked and then cleared out of each matrix in one go,
+// rather than deleted one at a time.
 {
 	// Preconditions:
 	MesaTree* theTreeP = getActiveTreeP();
@@ -467,31 +469,30 @@ void DeleteDeadTraitsSysAction::executeSystem ()
 	// get row names of disc data
 	stringvec_t theDiscTaxaNames;
 	MesaGlobals::mDiscDataP->collectRowNames (theDiscTaxaNames);
-	// for each name
-	stringvec_t::iterator p;
-	for (p = theDiscTaxaNames.begin(); p != theDiscTaxaNames.end(); p++)
+	// mark each row whose node is not alive
+	std::vector<bool> theDeadDiscRows (theDiscTaxaNames.size(), false);
+	for (stringvec_t::size_type i = 0; i < theDiscTaxaNames.size(); i++)
 	{
-		// get the node for that name
-		nodeiter_t theCurrNode = theTreeP->getIter (p->c_str());
-		// if it's not alive
-		if (not theTreeP->isNodeAlive (theCurrNode))
-			// delete the data
-			MesaGlobals::mDiscDataP->deleteRow (p->c_str());
+		nodeiter_t theCurrNode = theTreeP->getIter (theDiscTaxaNames[i].c_str());
+		theDeadDiscRows[i] = not theTreeP->isNodeAlive (theCurrNode);
 	}
+	// and delete the data
+	if (not theDiscTaxaNames.empty())
+		MesaGlobals::mDiscDataP->deleteRows (theDeadDiscRows);
 
 	// get row names of cont data
 	stringvec_t theContTaxaNames;
 	MesaGlobals::mContDataP->collectRowNames (theContTaxaNames);
-	// for each name
-	for (p = theContTaxaNames.begin(); p != theContTaxaNames.end(); p++)
+	// mark each row whose node is not alive
+	std::vector<bool> theDeadContRows (theContTaxaNames.size(), false);
+	for (stringvec_t::size_type i = 0; i < theContTaxaNames.size(); i++)
 	{
-		// get the node for that name
-		nodeiter_t theCurrNode = theTreeP->getIter (p->c_str());
-		// if it's not alive
-		if (not theTreeP->isNodeAlive (theCurrNode))
-			// delete the data
-			MesaGlobals::mContDataP->deleteRow (p->c_str());
+		nodeiter_t theCurrNode = theTreeP->getIter (theContTaxaNames[i].c_str());
+		theDeadContRows[i] = not theTreeP->isNodeAlive (theCurrNode);
 	}
+	// and delete the data
+	if (not theContTaxaNames.empty())
+		MesaGlobals::mContDataP->deleteRows (theDeadContRows);
 
 
 	// Postconditions:
@@ -95,11 +95,17 @@ public:
 	}
 
 	X& getData (const char* iRowName, size_type iColIndex)
-	// TO DO: use binary search
 	// NOTE: assertion of indexes takes place in base class
+	// Data written through here, rather than referData, can't be rolled back.
 	{
 		size_type theRowIndex = base_type::findRowNameIndex (iRowName);
-		return at(theRowIndex, iColIndex);
+		return this->at (theRowIndex, iColIndex);
+	}
+
+	X& getData (size_type iRowIndex, size_type iColIndex)
+	//: the datum at this row, for callers that have kept the row index
+	{
+		return this->at (iRowIndex, iColIndex);
 	}
 
 
@@ -126,14 +132,17 @@ public:
 		else
 		{
 			size_type theOrigIndex = base_type::findRowNameIndex (iOrigName);
-			base_type::addRows (1);
-			size_type theNewRowIndex = base_type::countRows() - 1;
-			setRowName (theNewRowIndex, iNewName);
-			for (size_type i = 0; i < base_type::countCols(); i++)
-				(*this)[theNewRowIndex][i] = (*this)[theOrigIndex][i];
+			cloneRow (theOrigIndex, iNewName);
 		}
 	}
 
+	size_type cloneRow (size_type iOrigIndex, const char* iNewName)
+	//: duplicate this row under the new name, returning the new index
+	// Appending keeps the row stamp, so indices held elsewhere stay good.
+	{
+		return base_type::cloneRow (iOrigIndex, iNewName);
+	}
+
 
 	void addCols (size_type iColIncr, const X& iNewVal = X())
 	//: increase the number of columns by this increment & give default name
@@ -155,7 +164,7 @@ public:
 		{
 			// swap with a taxa after it
 			int theNewRow = int (MesaGlobals::mRng.UniformWhole (i, theNumTaxa - 1));
-			std::swap ((*this)[i][iIndex], (*this)[theNewRow][iIndex]);
+			std::swap (this->referData (i, iIndex), this->referData (theNewRow, iIndex));
 		}
 	}
 
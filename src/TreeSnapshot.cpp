@@ -0,0 +1,394 @@
+/**************************************************************************
+TreeSnapshot.cpp - a frozen, flat copy of a tree for analysis
+
+Credits:
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <mail://mesa@agapow.net> <http://www.agapow.net/software/mesa/>
+
+About:
+- Everything is worked out in a few linear passes when the snapshot is
+  made, except the table for common ancestors. The ages follow the
+  definitions in MesaTree, so the answers are the same as asking the
+  tree, give or take rounding.
+- The common ancestor of two nodes that are not the same is the parent of
+  the shallowest node after the first of them in the pre-order, up to &
+  including the second. The table has the shallowest node for every run
+  whose length is a power of 2, & any range is covered by two such runs,
+  so each question takes constant time for N log N to build the table.
+- In the same way, the split between two leaves is the shallowest of the
+  splits between neighbouring leaves from the one to the other in the
+  pre-order. As times only grow going down the tree, the time to root of
+  the split is the least of theirs. So a row of distances from one leaf
+  to all those before it is a running minimum back along the row,
+  followed by plain arithmetic over contiguous arrays.
+
+**************************************************************************/
+
+
+// *** INCLUDES
+
+#include "TreeSnapshot.h"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+using std::vector;
+
+
+// *** CONSTANTS & DEFINES
+
+typedef TreeSnapshot::size_type     size_type;
+typedef TreeSnapshot::weight_type   weight_type;
+typedef TreeSnapshot::iterator      iterator;
+
+const size_type TreeSnapshot::kNoIndex;
+
+
+// *** LIFECYCLE *********************************************************/
+
+TreeSnapshot::TreeSnapshot (MesaTree& iTree)
+	: mRootAge (0.0)
+	, mPhyloAge (0.0)
+{
+	if (iTree.isEmpty())
+	{
+		mFirstChildren.push_back (0);
+		return;
+	}
+
+	listNodes (iTree);
+	listOrders ();
+	measureNodes (iTree);
+	listLeaves ();
+}
+
+
+// *** ACCESSORS *********************************************************/
+
+size_type TreeSnapshot::getIndex (iterator iNodeIter) const
+//: where is this node of the tree in the snapshot?
+{
+	size_type theId = size_type (iNodeIter->first);
+	assert (theId < mIndices.size());
+	assert (mIndices[theId] != kNoIndex);
+	return mIndices[theId];
+}
+
+
+weight_type TreeSnapshot::getNodeAge (size_type iIndex) const
+//: the age of the node, being the age of the root less its time to root
+// As MesaTree::getNodeAge().
+{
+	weight_type theNodeAge = mRootAge - mTimesToRoot[iIndex];
+	if (not isRoot (iIndex))
+		assert (0.0 <= theNodeAge);
+	return theNodeAge;
+}
+
+
+weight_type TreeSnapshot::getTimeSinceNodeTerminus (size_type iIndex) const
+//: how much time has passed since this node stopped existing?
+// As MesaTree::getTimeSinceNodeTerminus(), including its flattening of
+// the tiny values that rounding leaves on the extant tips.
+{
+	if (mAlive[iIndex])
+		return 0.0;
+
+	weight_type theTime = mRootAge - mTimesToRoot[iIndex];
+	if (std::abs (theTime) < .0001)
+		theTime = 0.0;
+	assert (0.0 <= theTime);
+	return theTime;
+}
+
+
+weight_type TreeSnapshot::getTimeSinceNodeOrigin (size_type iIndex) const
+//: how much time has passed since this node sprang into existence?
+{
+	return getTimeSinceNodeTerminus (iIndex) + mEdgeWeights[iIndex];
+}
+
+
+// *** ANCESTRY **********************************************************/
+
+bool TreeSnapshot::isAncestorOf (size_type iOldIndex, size_type iNewIndex) const
+//: is the first node above the second?
+// As SimpleTree::isAncestorOf(), a node is not its own ancestor. Its
+// descendants are the nodes that follow it in the pre-order.
+{
+	size_type theOldRank = mPreorderRanks[iOldIndex];
+	size_type theNewRank = mPreorderRanks[iNewIndex];
+	return (theOldRank < theNewRank) and
+		(theNewRank < theOldRank + mSubtreeSizes[iOldIndex]);
+}
+
+
+weight_type TreeSnapshot::getTimeFromNodeToAncestor
+(size_type iIndex, size_type iAncestorIndex) const
+//: what is the sum of weights from this node up to the ancestor?
+{
+	assert ((iIndex == iAncestorIndex) or isAncestorOf (iAncestorIndex, iIndex));
+	return mTimesToRoot[iIndex] - mTimesToRoot[iAncestorIndex];
+}
+
+
+size_type TreeSnapshot::getCommonAncestor (size_type iIndexA, size_type iIndexB)
+//: what is the most recent common ancestor of these two nodes?
+// If one is above the other, that is the answer.
+{
+	if (iIndexA == iIndexB)
+		return iIndexA;
+	checkAncestorIndex ();
+
+	size_type theStart = mPreorderRanks[iIndexA];
+	size_type theStop = mPreorderRanks[iIndexB];
+	if (theStop < theStart)
+		std::swap (theStart, theStop);
+	theStart++;
+
+	size_type theLevel = mFloorLogs[theStop - theStart + 1];
+	const vector<size_type>& theRuns = mShallowest[theLevel];
+	size_type theShallowest = getShallower (theRuns[theStart],
+		theRuns[theStop + 1 - (size_type (1) << theLevel)]);
+	return mParents[theShallowest];
+}
+
+
+weight_type TreeSnapshot::getTimeBetweenNodes (size_type iIndexA, size_type iIndexB)
+//: what is the patristic distance, the sum of weights between two nodes?
+{
+	size_type theAncestor = getCommonAncestor (iIndexA, iIndexB);
+	return (mTimesToRoot[iIndexA] - mTimesToRoot[theAncestor]) +
+		(mTimesToRoot[iIndexB] - mTimesToRoot[theAncestor]);
+}
+
+
+size_type TreeSnapshot::getStepsBetweenNodes (size_type iIndexA, size_type iIndexB)
+//: how many branches are there between two nodes?
+{
+	size_type theAncestor = getCommonAncestor (iIndexA, iIndexB);
+	return (mDepths[iIndexA] + mDepths[iIndexB]) - (2 * mDepths[theAncestor]);
+}
+
+
+// *** LEAF DISTANCES ****************************************************/
+
+void TreeSnapshot::getLeafDistances
+(size_type iLeafNum, vector<weight_type>& oRow) const
+//: the patristic distances from this leaf to each leaf before it
+// That is, a row of the lower triangle of the distance matrix, in the
+// order of the leaves, without the zero on the diagonal.
+{
+	assert (iLeafNum < countLeaves());
+	oRow.resize (iLeafNum);
+	if (iLeafNum == 0)
+		return;
+
+	// first the time to root of the split shared with each earlier leaf
+	weight_type* theRowP = &oRow[0];
+	weight_type theShared = mLeafSplits[iLeafNum];
+	for (size_type j = iLeafNum; 0 < j; j--)
+	{
+		if (mLeafSplits[j] < theShared)
+			theShared = mLeafSplits[j];
+		theRowP[j - 1] = theShared;
+	}
+
+	// then the distances, which has no dependence between places
+	const weight_type* theTimesP = &mLeafTimes[0];
+	weight_type theTime = mLeafTimes[iLeafNum];
+	for (size_type j = 0; j < iLeafNum; j++)
+		theRowP[j] = (theTime - theRowP[j]) + (theTimesP[j] - theRowP[j]);
+}
+
+
+// *** INTERNALS *********************************************************/
+
+void TreeSnapshot::listNodes (MesaTree& iTree)
+//: number the nodes in level order & record the shape of the tree
+// Each node is listed after its parent, so the children of every node
+// are listed together & the first of them is where the list had got to.
+{
+	mIters.reserve (iTree.countNodes());
+	mParents.reserve (iTree.countNodes());
+	mFirstChildren.reserve (iTree.countNodes() + 1);
+
+	mIters.push_back (iTree.getRoot());
+	mParents.push_back (kNoIndex);
+	for (size_type i = 0; i < mIters.size(); i++)
+	{
+		iterator theNodeIter = mIters[i];
+		mFirstChildren.push_back (mIters.size());
+		size_type theNumChildren = iTree.countChildren (theNodeIter);
+		for (size_type j = 0; j < theNumChildren; j++)
+		{
+			mIters.push_back (iTree.getChild (theNodeIter, j));
+			mParents.push_back (i);
+		}
+	}
+	mFirstChildren.push_back (mIters.size());
+
+	// & the way back from the tree
+	for (size_type i = 0; i < mIters.size(); i++)
+	{
+		size_type theId = size_type (mIters[i]->first);
+		if (mIndices.size() <= theId)
+			mIndices.resize (theId + 1, kNoIndex);
+		mIndices[theId] = i;
+	}
+}
+
+
+void TreeSnapshot::listOrders ()
+//: list the nodes depth first, both parents first & children first
+// Walking with a stack & taking the children in reverse lists the tree
+// root, last child, ... which backwards is the post-order.
+{
+	size_type theNumNodes = countNodes();
+	vector<size_type> theStack;
+
+	mPreorder.reserve (theNumNodes);
+	theStack.push_back (getRoot());
+	while (not theStack.empty())
+	{
+		size_type theIndex = theStack.back();
+		theStack.pop_back();
+		mPreorder.push_back (theIndex);
+		for (size_type j = countChildren (theIndex); 0 < j; j--)
+			theStack.push_back (getChild (theIndex, j - 1));
+	}
+
+	mPreorderRanks.resize (theNumNodes);
+	for (size_type i = 0; i < theNumNodes; i++)
+		mPreorderRanks[mPreorder[i]] = i;
+
+	mPostorder.reserve (theNumNodes);
+	theStack.push_back (getRoot());
+	while (not theStack.empty())
+	{
+		size_type theIndex = theStack.back();
+		theStack.pop_back();
+		mPostorder.push_back (theIndex);
+		for (size_type j = 0; j < countChildren (theIndex); j++)
+			theStack.push_back (getChild (theIndex, j));
+	}
+	std::reverse (mPostorder.begin(), mPostorder.end());
+
+	// children come after their parents, so total from the end
+	mSubtreeSizes.assign (theNumNodes, 1);
+	for (size_type i = theNumNodes; 1 < i; i--)
+		mSubtreeSizes[mParents[i - 1]] += mSubtreeSizes[i - 1];
+}
+
+
+void TreeSnapshot::measureNodes (MesaTree& iTree)
+//: record the state, branch length & distance to root of every node
+// The age of the root is worked out as in MesaTree::getRootAge(): from the
+// first living tip in order of id if there is one, otherwise the furthest
+// node from the root.
+{
+	size_type theNumNodes = countNodes();
+	mAlive.resize (theNumNodes);
+	mDepths.resize (theNumNodes);
+	mEdgeWeights.resize (theNumNodes);
+	mTimesToRoot.resize (theNumNodes);
+
+	// the tree keeps a list of the living leaves, which saves looking every
+	// node up in its dead list, & is asked in the order it stores the nodes,
+	// which is much quicker than jumping about it in level order
+	vector<iterator> theLiveIters;
+	iTree.getLiveLeaves (theLiveIters);
+	for (size_type i = 0; i < theLiveIters.size(); i++)
+		mAlive[getIndex (theLiveIters[i])] = true;
+
+	for (iterator q = iTree.begin(); q != iTree.end(); q++)
+	{
+		size_type theIndex = getIndex (q);
+		mEdgeWeights[theIndex] = iTree.getEdgeWeight (q, mAlive[theIndex]);
+	}
+
+	for (size_type i = 0; i < theNumNodes; i++)
+	{
+		if (isRoot (i))
+		{
+			mDepths[i] = 0;
+			mTimesToRoot[i] = 0.0;
+		}
+		else
+		{
+			size_type theParent = mParents[i];
+			mDepths[i] = mDepths[theParent] + 1;
+			mTimesToRoot[i] = mTimesToRoot[theParent] + mEdgeWeights[i];
+		}
+	}
+
+	mPhyloAge = *(std::max_element (mTimesToRoot.begin(), mTimesToRoot.end()));
+	mRootAge = mPhyloAge;
+	for (size_type theId = 0; theId < mIndices.size(); theId++)
+	{
+		size_type theIndex = mIndices[theId];
+		if ((theIndex != kNoIndex) and mAlive[theIndex])
+		{
+			mRootAge = mTimesToRoot[theIndex];
+			break;
+		}
+	}
+	assert (0.0 <= mRootAge);
+}
+
+
+void TreeSnapshot::listLeaves ()
+//: list the leaves in pre-order, with the time to root of each split
+// The split between two neighbouring leaves is the parent of the
+// shallowest node after the first, up to & including the second.
+{
+	size_type theShallowest = kNoIndex;
+	for (size_type i = 0; i < mPreorder.size(); i++)
+	{
+		size_type theIndex = mPreorder[i];
+		if ((theShallowest == kNoIndex) or
+			(mDepths[theIndex] < mDepths[theShallowest]))
+			theShallowest = theIndex;
+
+		if (isLeaf (theIndex))
+		{
+			if (mLeaves.empty())
+				mLeafSplits.push_back (0.0);
+			else
+				mLeafSplits.push_back (mTimesToRoot[mParents[theShallowest]]);
+			mLeaves.push_back (theIndex);
+			mLeafTimes.push_back (mTimesToRoot[theIndex]);
+			theShallowest = kNoIndex;
+		}
+	}
+}
+
+
+void TreeSnapshot::checkAncestorIndex ()
+//: make the table for common ancestors, if it has not been made
+{
+	if (not mShallowest.empty())
+		return;
+
+	size_type theNumNodes = countNodes();
+	mFloorLogs.assign (theNumNodes + 1, 0);
+	for (size_type i = 2; i <= theNumNodes; i++)
+		mFloorLogs[i] = mFloorLogs[i / 2] + 1;
+
+	mShallowest.resize (mFloorLogs[theNumNodes] + 1);
+	mShallowest[0] = mPreorder;
+	for (size_type k = 1; k < mShallowest.size(); k++)
+	{
+		const vector<size_type>& theShorter = mShallowest[k - 1];
+		vector<size_type>& theLonger = mShallowest[k];
+		size_type theHalf = size_type (1) << (k - 1);
+		size_type theNumRuns = theNumNodes + 1 - (2 * theHalf);
+		theLonger.resize (theNumRuns);
+		for (size_type j = 0; j < theNumRuns; j++)
+			theLonger[j] = getShallower (theShorter[j], theShorter[j + theHalf]);
+	}
+}
+
+
+// *** END ***************************************************************/
@@ -0,0 +1,159 @@
+/**************************************************************************
+TreeSnapshot.h - a frozen, flat copy of a tree for analysis
+
+Credits:
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <mail://mesa@agapow.net> <http://www.agapow.net/software/mesa/>
+
+About:
+- MesaTree keeps its nodes in a map and works out times & ages by walking
+  to the root, so an analysis that asks for the age of every node takes
+  quadratic time. A snapshot reads the tree once and keeps the shape,
+  branch lengths, depths & ages of every node in plain arrays.
+- Nodes are numbered in level order, so parents always come before their
+  children, the children of a node are consecutive and the root is 0.
+  Pre- & post-order listings are also kept.
+- Whether one node is an ancestor of another is answered from where they
+  fall in the pre-order. The most recent common ancestor of two nodes,
+  and so the distance between them, is answered from a table of the
+  shallowest node in runs of the pre-order, made on the first question.
+- The distances from a leaf to all the leaves before it in the pre-order
+  can be had as a row, for writing out the distances between all the
+  leaves a row at a time, without holding the whole matrix.
+- It is not updated: any change to the tree makes it wrong, so make one
+  at the start of an analysis and throw it away at the end.
+
+**************************************************************************/
+
+#pragma once
+#ifndef TREESNAPSHOT_H
+#define TREESNAPSHOT_H
+
+
+// *** INCLUDES
+
+#include "MesaTree.h"
+#include <vector>
+
+
+// *** CONSTANTS & DEFINES
+
+// *** CLASS DECLARATION *************************************************/
+
+class TreeSnapshot
+{
+public:
+	// PUBLIC TYPE INTERFACE
+	typedef MesaTree::iterator      iterator;
+	typedef MesaTree::size_type     size_type;
+	typedef MesaTree::weight_type   weight_type;
+
+	static const size_type kNoIndex = size_type (-1);
+
+	// LIFECYCLE
+	TreeSnapshot (MesaTree& iTree);
+
+	// ACCESSORS
+	size_type      countNodes () const
+		{ return mIters.size(); }
+	size_type      getRoot () const
+		{ return 0; }
+	size_type      getIndex (iterator iNodeIter) const;
+	iterator       getIter (size_type iIndex) const
+		{ return mIters[iIndex]; }
+
+	size_type      getParent (size_type iIndex) const
+		{ return mParents[iIndex]; }
+	size_type      countChildren (size_type iIndex) const
+		{ return mFirstChildren[iIndex + 1] - mFirstChildren[iIndex]; }
+	size_type      getChild (size_type iIndex, size_type iChildNum) const
+		{ return mFirstChildren[iIndex] + iChildNum; }
+	bool           isRoot (size_type iIndex) const
+		{ return (iIndex == 0); }
+	bool           isLeaf (size_type iIndex) const
+		{ return (countChildren (iIndex) == 0); }
+	bool           isNodeAlive (size_type iIndex) const
+		{ return mAlive[iIndex]; }
+
+	const std::vector<size_type>&   getPreorder () const
+		{ return mPreorder; }
+	const std::vector<size_type>&   getPostorder () const
+		{ return mPostorder; }
+
+	size_type      getDepth (size_type iIndex) const
+		{ return mDepths[iIndex]; }
+	weight_type    getEdgeWeight (size_type iIndex) const
+		{ return mEdgeWeights[iIndex]; }
+	weight_type    getTimeFromNodeToRoot (size_type iIndex) const
+		{ return mTimesToRoot[iIndex]; }
+	weight_type    getNodeAge (size_type iIndex) const;
+	weight_type    getTimeSinceNodeTerminus (size_type iIndex) const;
+	weight_type    getTimeSinceNodeOrigin (size_type iIndex) const;
+
+	weight_type    getRootAge () const
+		{ return mRootAge; }
+	weight_type    getPhyloAge () const
+		{ return mPhyloAge; }
+
+	// ANCESTRY
+	bool           isAncestorOf (size_type iOldIndex, size_type iNewIndex) const;
+	bool           isDescendantOf (size_type iNewIndex, size_type iOldIndex) const
+		{ return isAncestorOf (iOldIndex, iNewIndex); }
+	size_type      countSubtree (size_type iIndex) const
+		{ return mSubtreeSizes[iIndex]; }
+	weight_type    getTimeFromNodeToAncestor (size_type iIndex,
+	                  size_type iAncestorIndex) const;
+
+	size_type      getCommonAncestor (size_type iIndexA, size_type iIndexB);
+	weight_type    getTimeBetweenNodes (size_type iIndexA, size_type iIndexB);
+	size_type      getStepsBetweenNodes (size_type iIndexA, size_type iIndexB);
+
+	// LEAF DISTANCES
+	size_type      countLeaves () const
+		{ return mLeaves.size(); }
+	size_type      getLeaf (size_type iLeafNum) const
+		{ return mLeaves[iLeafNum]; }
+	void           getLeafDistances (size_type iLeafNum,
+	                  std::vector<weight_type>& oRow) const;
+
+	// INTERNALS
+private:
+	std::vector<iterator>      mIters;          // by index
+	std::vector<size_type>     mIndices;        // by node id
+	std::vector<size_type>     mParents;        // kNoIndex for the root
+	std::vector<size_type>     mFirstChildren;  // one more than the nodes
+	std::vector<size_type>     mPreorder;
+	std::vector<size_type>     mPostorder;
+	std::vector<size_type>     mPreorderRanks;  // where each is in the pre-order
+	std::vector<size_type>     mSubtreeSizes;
+	std::vector<bool>          mAlive;
+	std::vector<size_type>     mDepths;
+	std::vector<weight_type>   mEdgeWeights;    // allowing for the clock
+	std::vector<weight_type>   mTimesToRoot;
+	weight_type                mRootAge;
+	weight_type                mPhyloAge;
+
+	// the leaves in pre-order, their times to root & that of the split
+	// between each & the one before
+	std::vector<size_type>     mLeaves;
+	std::vector<weight_type>   mLeafTimes;
+	std::vector<weight_type>   mLeafSplits;
+
+	// for each power of 2, the shallowest node in the run of that length
+	// starting at each place in the pre-order
+	std::vector< std::vector<size_type> >   mShallowest;
+	std::vector<size_type>                  mFloorLogs;
+
+	void        listNodes (MesaTree& iTree);
+	void        listOrders ();
+	void        measureNodes (MesaTree& iTree);
+	void        listLeaves ();
+	void        checkAncestorIndex ();
+	size_type   getShallower (size_type iIndexA, size_type iIndexB) const
+		{ return (mDepths[iIndexB] < mDepths[iIndexA]) ? iIndexB : iIndexA; }
+};
+
+
+#endif
+// *** END ***************************************************************/
@@ -116,6 +116,7 @@ void TreeWrangler::deleteTree (int iIndex)
 	
 	// now that's done we can erase the tree
 	erase (begin() + iIndex);
+	mNumDeleted++;
 }
 
 
@@ -187,6 +188,42 @@ void TreeWrangler::calcTranslationTable (TranslationTable* iTableP)
 }
 	
 
+// *** UNDOING ***********************************************************/
+
+
+TreeWrangler::UndoMark TreeWrangler::markUndo ()
+//: start logging changes to every tree, so they can be rolled back
+{
+	UndoMark theMark;
+	theMark.mNumTrees = size();
+	theMark.mNumDeleted = mNumDeleted;
+	theMark.mDefIndex = mDefIndex;
+	for (iterator q = begin(); q != end(); q++)
+		theMark.mTreeMarks.push_back (q->markUndo());
+	return theMark;
+}
+
+void TreeWrangler::rollbackUndo (const UndoMark& iMark)
+//: put the trees back as they were at the mark
+{
+	assert (iMark.mNumDeleted == mNumDeleted);
+	assert (iMark.mNumTrees <= size());
+	erase (begin() + iMark.mNumTrees, end());
+	for (size_type i = 0; i < iMark.mNumTrees; i++)
+		(*this)[i].rollbackUndo (iMark.mTreeMarks[i]);
+	mDefIndex = iMark.mDefIndex;
+}
+
+void TreeWrangler::releaseUndo (const UndoMark& iMark)
+//: keep the trees as they are & stop logging changes to them
+{
+	assert (iMark.mNumDeleted == mNumDeleted);
+	assert (iMark.mNumTrees <= size());
+	for (size_type i = 0; i < iMark.mNumTrees; i++)
+		(*this)[i].releaseUndo (iMark.mTreeMarks[i]);
+}
+
+
 // *** I/O ***************************************************************/
 
 
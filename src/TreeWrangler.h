@@ -39,7 +39,7 @@ public:
 	
 	// LIFECYCLE
 	TreeWrangler ()
-		: mDefIndex (0), mPrefsCollapseInternalNodes (true)
+		: mDefIndex (0), mPrefsCollapseInternalNodes (true), mNumDeleted (0)
 		{}
 	
 	// SERVICES
@@ -66,6 +66,21 @@ public:
 	void				setTreeName (size_type iIndex, const char* iNewName);
 	
 	void				calcTranslationTable (TranslationTable* iTableP);
+	
+	// UNDOING
+	// Trees may be added after a mark, but none taken away, which is
+	// checked by a count of the trees ever deleted.
+	struct UndoMark
+	{
+		size_type                       mNumTrees;
+		size_type                       mNumDeleted;
+		size_type                       mDefIndex;
+		std::vector<MesaTree::UndoMark>  mTreeMarks;
+	};
+	
+	UndoMark			markUndo ();
+	void				rollbackUndo (const UndoMark& iMark);
+	void				releaseUndo (const UndoMark& iMark);
 		
 	// I/O
 	void 				summarise (std::ostream& ioOutStream);
@@ -86,6 +101,7 @@ public:
 private:
 	size_type				mDefIndex;
 	bool						mPrefsCollapseInternalNodes;
+	size_type				mNumDeleted;
 
 	MesaTree& 		refActiveTree ();
 	static const char* nextFakeName ();
@@ -0,0 +1,273 @@
+/**************************************************************************
+XIndexedHeap.h - a priority queue whose entries can be found & updated
+
+Credits:
+- From SIBIL, the Silwood Biocomputing Library.
+- By Paul-Michael Agapow, 2000-2012, Health Protection Agency (UK)
+- <mail://pma@agapow.net>
+- <mail://mesa@agapow.net> <http://www.agapow.net/software/mesa/>
+
+About:
+- A binary min-heap of keys ordered by a priority, with an index from key
+  to position in the heap. So the smallest priority can be got in O(1) and
+  any key can be inserted, reprioritised or removed in O(log N). This is
+  what is needed for a "next reaction" scheduler, where the soonest event
+  is wanted and a few events are rescheduled after each.
+
+**************************************************************************/
+
+#pragma once
+#ifndef XINDEXEDHEAP_H
+#define XINDEXEDHEAP_H
+
+
+// *** INCLUDES
+
+#include "Sbl.h"
+#include <vector>
+#include <map>
+
+SBL_NAMESPACE_START
+
+
+// *** CONSTANTS & DEFINES
+
+// *** CLASS DECLARATION *************************************************/
+
+template <typename K>
+class XIndexedHeap
+{
+public:
+// PUBLIC TYPE INTERFACE
+	typedef double                     priority_type;
+	typedef typename std::vector<K>::size_type   size_type;
+
+// LIFECYCLE
+	// use defaults
+
+// ACCESSORS
+	bool            isEmpty () const
+		{ return mHeap.empty(); }
+	size_type       size () const
+		{ return mHeap.size(); }
+	bool            isMember (const K& iKey) const;
+	const K&        topKey () const;
+	priority_type   topPriority () const;
+
+// MUTATORS
+	void            set (const K& iKey, priority_type iPriority);
+	void            remove (const K& iKey);
+	void            clear ();
+
+	void            append (const K& iKey, priority_type iPriority);
+	void            heapify ();
+
+// DEPRECIATED & DEBUG
+	void            validate ();
+
+// INTERNALS
+private:
+	struct Entry
+	{
+		K               mKey;
+		priority_type   mPriority;
+	};
+
+	std::vector<Entry>     mHeap;
+	std::map<K, size_type> mPositions;
+
+	void   siftUp (size_type iIndex);
+	void   siftDown (size_type iIndex);
+	void   swapEntries (size_type iIndexA, size_type iIndexB);
+};
+
+
+
+// *** CLASS DEFINITION **************************************************/
+
+// *** ACCESSORS
+
+template <typename K>
+bool
+XIndexedHeap<K>::isMember (const K& iKey) const
+{
+	return (mPositions.find (iKey) != mPositions.end());
+}
+
+template <typename K>
+const K&
+XIndexedHeap<K>::topKey () const
+//: return the key with the smallest priority
+{
+	assert (not isEmpty());
+	return mHeap[0].mKey;
+}
+
+template <typename K>
+typename XIndexedHeap<K>::priority_type
+XIndexedHeap<K>::topPriority () const
+//: return the smallest priority
+{
+	assert (not isEmpty());
+	return mHeap[0].mPriority;
+}
+
+
+// *** MUTATORS
+
+template <typename K>
+void
+XIndexedHeap<K>::set (const K& iKey, priority_type iPriority)
+//: insert the key with this priority, or reprioritise it if present
+{
+	typename std::map<K, size_type>::iterator q = mPositions.find (iKey);
+	if (q == mPositions.end())
+	{
+		Entry theNewEntry;
+		theNewEntry.mKey = iKey;
+		theNewEntry.mPriority = iPriority;
+		mHeap.push_back (theNewEntry);
+		mPositions[iKey] = mHeap.size() - 1;
+		siftUp (mHeap.size() - 1);
+	}
+	else
+	{
+		size_type theIndex = q->second;
+		priority_type theOldPriority = mHeap[theIndex].mPriority;
+		mHeap[theIndex].mPriority = iPriority;
+		if (iPriority < theOldPriority)
+			siftUp (theIndex);
+		else
+			siftDown (theIndex);
+	}
+}
+
+template <typename K>
+void
+XIndexedHeap<K>::remove (const K& iKey)
+//: take this key out of the heap, if it is there
+{
+	typename std::map<K, size_type>::iterator q = mPositions.find (iKey);
+	if (q == mPositions.end())
+		return;
+
+	size_type theIndex = q->second;
+	size_type theLast = mHeap.size() - 1;
+	if (theIndex != theLast)
+		swapEntries (theIndex, theLast);
+	mPositions.erase (iKey);
+	mHeap.pop_back ();
+
+	// the entry moved into the gap may need to go either way
+	if (theIndex < mHeap.size())
+	{
+		siftUp (theIndex);
+		siftDown (theIndex);
+	}
+}
+
+template <typename K>
+void
+XIndexedHeap<K>::clear ()
+{
+	mHeap.clear();
+	mPositions.clear();
+}
+
+template <typename K>
+void
+XIndexedHeap<K>::append (const K& iKey, priority_type iPriority)
+//: add a new key without restoring heap order
+// For building a large heap in one go: append everything, then call
+// heapify() once, which is linear rather than N log N.
+{
+	assert (not isMember (iKey));
+	Entry theNewEntry;
+	theNewEntry.mKey = iKey;
+	theNewEntry.mPriority = iPriority;
+	mHeap.push_back (theNewEntry);
+	mPositions[iKey] = mHeap.size() - 1;
+}
+
+template <typename K>
+void
+XIndexedHeap<K>::heapify ()
+//: restore heap order after a series of appends
+{
+	for (size_type i = mHeap.size() / 2; 0 < i; i--)
+		siftDown (i - 1);
+}
+
+
+// *** DEPRECIATED & DEBUG
+
+template <typename K>
+void
+XIndexedHeap<K>::validate ()
+{
+	assert (mHeap.size() == mPositions.size());
+	for (size_type i = 0; i < mHeap.size(); i++)
+	{
+		assert (mPositions[mHeap[i].mKey] == i);
+		if (0 < i)
+			assert (mHeap[(i - 1) / 2].mPriority <= mHeap[i].mPriority);
+	}
+}
+
+
+// *** INTERNALS
+
+template <typename K>
+void
+XIndexedHeap<K>::siftUp (size_type iIndex)
+{
+	while (0 < iIndex)
+	{
+		size_type theParent = (iIndex - 1) / 2;
+		if (mHeap[theParent].mPriority <= mHeap[iIndex].mPriority)
+			break;
+		swapEntries (iIndex, theParent);
+		iIndex = theParent;
+	}
+}
+
+template <typename K>
+void
+XIndexedHeap<K>::siftDown (size_type iIndex)
+{
+	size_type theSize = mHeap.size();
+	while (true)
+	{
+		size_type theLeft = (2 * iIndex) + 1;
+		size_type theRight = theLeft + 1;
+		size_type theSmallest = iIndex;
+		if ((theLeft < theSize) and
+			(mHeap[theLeft].mPriority < mHeap[theSmallest].mPriority))
+			theSmallest = theLeft;
+		if ((theRight < theSize) and
+			(mHeap[theRight].mPriority < mHeap[theSmallest].mPriority))
+			theSmallest = theRight;
+		if (theSmallest == iIndex)
+			break;
+		swapEntries (iIndex, theSmallest);
+		iIndex = theSmallest;
+	}
+}
+
+template <typename K>
+void
+XIndexedHeap<K>::swapEntries (size_type iIndexA, size_type iIndexB)
+{
+	Entry theTemp = mHeap[iIndexA];
+	mHeap[iIndexA] = mHeap[iIndexB];
+	mHeap[iIndexB] = theTemp;
+	mPositions[mHeap[iIndexA].mKey] = iIndexA;
+	mPositions[mHeap[iIndexB].mKey] = iIndexB;
+}
+
+
+
+SBL_NAMESPACE_STOP
+
+#endif
+// *** END ***************************************************************/
@@ -48,6 +48,8 @@ public:
 // ACCESSORS
 	virtual rate_t getRate (nodeiter_t iCurrNode);
 	virtual rate_t calculateRate (nodeiter_t iCurrNode);
+	virtual bool   isAgeDependent ()
+		{ return false; }
 	
 	void finishInit ();
 	
@@ -101,6 +103,8 @@ public:
 
 // ACCESSORS
 	rate_t calculateRate (nodeiter_t iCurrNode);
+	bool   isAgeDependent ()
+		{ return (mDependentVar == kDependentVariable_Age); }
 
 	virtual rate_t calculateDependentRate (double iInputVal);
 	